@@ -9,5 +9,6 @@
 #include "../src/sw_map.hh"
 #include "../src/sw_ref.hh"
 #include "../src/time.hh"
+#include "../src/timer_wheel.hh"
 
 #endif
@@ -0,0 +1,83 @@
+#ifndef _DISTREF_ACCESS_TRACKER_HH_
+#define _DISTREF_ACCESS_TRACKER_HH_
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "key.hh"
+#include "key_space.hh"
+
+#define ACCESS_SAMPLE_RATE 16  // power of 2
+#define ACCESS_TRACK_KEYS 64
+
+typedef std::pair<std::size_t, uint64_t> HotKey;  // (placement hash, count)
+
+/*
+ * Per-key access rate of the keys managed by this worker.
+ *
+ * Keys are counted by KeySpace::get_placement_hash(), i.e., per group of keys
+ * that are placed together. One of ACCESS_SAMPLE_RATE accesses is sampled
+ * into a space-saving table of ACCESS_TRACK_KEYS counters, which keeps the
+ * heaviest groups (with overestimated counts) at a bounded cost.
+ */
+class AccessTracker {
+ private:
+  uint64_t accesses = 0;
+  std::unordered_map<std::size_t, uint64_t> counts;
+
+ public:
+  void record(int map_id, const Key *key) {
+    if (accesses++ & (ACCESS_SAMPLE_RATE - 1))
+      return;
+
+    std::size_t hash = KeySpace::get_placement_hash(map_id, key);
+
+    auto iter = counts.find(hash);
+    if (iter != counts.end()) {
+      iter->second++;
+      return;
+    }
+
+    if (counts.size() < ACCESS_TRACK_KEYS) {
+      counts[hash] = 1;
+      return;
+    }
+
+    // replaces the least counted one, and inherits its count
+    auto min = counts.begin();
+    for (auto it = counts.begin(); it != counts.end(); ++it)
+      if (it->second < min->second)
+        min = it;
+
+    uint64_t cnt = min->second + 1;
+    counts.erase(min);
+    counts[hash] = cnt;
+  }
+
+  uint64_t get_accesses() const { return accesses; }
+
+  // adds up to k heaviest keys (count in accesses, not samples) into out
+  void get_hot_keys(std::size_t k, std::vector<HotKey> &out) const {
+    std::vector<HotKey> all(counts.begin(), counts.end());
+    k = std::min(k, all.size());
+
+    std::partial_sort(all.begin(), all.begin() + k, all.end(),
+                      [](const HotKey &a, const HotKey &b) {
+                        return a.second > b.second;
+                      });
+
+    for (std::size_t i = 0; i < k; i++)
+      out.push_back(HotKey(all[i].first, all[i].second * ACCESS_SAMPLE_RATE));
+  }
+
+  // starts a new interval
+  void reset() {
+    accesses = 0;
+    counts.clear();
+  }
+};
+
+#endif /* _DISTREF_ACCESS_TRACKER_HH_ */
@@ -13,6 +13,7 @@ class Application {
   background_func bgf_arr[MAX_BGFUNC_CNT];
   packet_func pf;
   init_func initf = nullptr;
+  key_extract_func kef = nullptr;
 
  public:
   int set_background_func(background_func bg) {
@@ -34,6 +35,12 @@ class Application {
     return 0;
   }
 
+  // optional, to overlap the lease requests of a burst with its processing
+  int set_key_extract_func(key_extract_func kef) {
+    this->kef = kef;
+    return 0;
+  }
+
   background_func get_background_func(int idx) {
     if (idx >= bg_count)
       return nullptr;
@@ -44,6 +51,8 @@ class Application {
   packet_func get_packet_func() { return pf; };
 
   init_func get_init_func() { return initf; };
+
+  key_extract_func get_key_extract_func() { return kef; };
 };
 
 Application *create_application();
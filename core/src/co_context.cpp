@@ -0,0 +1,208 @@
+#include "co_context.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "log.hh"
+
+CoStackPool::CoStackPool(std::size_t stack_size) {
+  std::size_t page = sysconf(_SC_PAGESIZE);
+
+  // at least one usable page above the guard page
+  if (stack_size < 2 * page)
+    stack_size = 2 * page;
+  this->stack_size = (stack_size + page - 1) & ~(page - 1);
+}
+
+CoStackPool::~CoStackPool() {
+  for (void *chunk : chunks)
+    munmap(chunk, CO_STACK_CHUNK * stack_size);
+}
+
+int CoStackPool::grow() {
+  std::size_t page = sysconf(_SC_PAGESIZE);
+  std::size_t size = CO_STACK_CHUNK * stack_size;
+
+  void *chunk = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (chunk == MAP_FAILED) {
+    DEBUG_ERR("Fail to map coroutine stacks: " << strerror(errno));
+    return -1;
+  }
+
+  chunks.push_back(chunk);
+
+  for (int i = CO_STACK_CHUNK - 1; i >= 0; i--) {
+    char *stack = static_cast<char *>(chunk) + i * stack_size;
+    if (mprotect(stack, page, PROT_NONE) != 0)
+      DEBUG_WARN("No guard page for a coroutine stack");
+    free_stacks.push_back(stack);
+  }
+
+  return 0;
+}
+
+void *CoStackPool::alloc() {
+  if (free_stacks.empty() && grow() < 0)
+    return nullptr;
+
+  void *stack = free_stacks.back();
+  free_stacks.pop_back();
+  return stack;
+}
+
+void CoStackPool::free(void *stack) {
+  std::size_t page = sysconf(_SC_PAGESIZE);
+
+  // drops the resident pages; the next user starts from zero pages
+  madvise(static_cast<char *>(stack) + page, stack_size - page, MADV_DONTNEED);
+  free_stacks.push_back(stack);
+}
+
+#ifdef S6_CO_BOOST
+
+CoContext::~CoContext() {
+  delete call;
+}
+
+int CoContext::init(CoStackPool *pool, co_func func, void *arg) {
+  this->func = func;
+  this->arg = arg;
+
+  std::size_t size = pool ? pool->get_stack_size() : CO_STACK_SIZE;
+  size = std::max(size, boost::coroutines::stack_traits::minimum_size());
+  boost::coroutines::attributes attrs(size);
+
+  call = new call_type(
+      [this](yield_type &y) {
+        yield = &y;
+        while (true) {
+          this->func(this->arg);
+          (*yield)();
+        }
+      },
+      attrs);
+
+  return 0;
+}
+
+void CoContext::resume() {
+  (*call)();
+}
+
+void CoContext::suspend() {
+  (*yield)();
+}
+
+#else  // !S6_CO_BOOST
+
+/*
+ * s6_co_switch(save_sp, load_sp): pushes the callee-saved registers (and the
+ * SSE/x87 control words) on the current stack, stores the stack pointer to
+ * *save_sp, and pops the ones of the other context from load_sp.
+ *
+ * s6_co_start: first return address of a new context, with the context
+ * pointer in %r12.
+ */
+extern "C" void s6_co_switch(void **save_sp, void *load_sp);
+extern "C" void s6_co_start();
+
+asm(R"(
+  .text
+  .globl s6_co_switch
+  .hidden s6_co_switch
+  .type s6_co_switch, @function
+s6_co_switch:
+  pushq %rbp
+  pushq %rbx
+  pushq %r12
+  pushq %r13
+  pushq %r14
+  pushq %r15
+  subq $8, %rsp
+  stmxcsr (%rsp)
+  fnstcw 4(%rsp)
+  movq %rsp, (%rdi)
+  movq %rsi, %rsp
+  ldmxcsr (%rsp)
+  fldcw 4(%rsp)
+  addq $8, %rsp
+  popq %r15
+  popq %r14
+  popq %r13
+  popq %r12
+  popq %rbx
+  popq %rbp
+  ret
+  .size s6_co_switch, .-s6_co_switch
+
+  .globl s6_co_start
+  .hidden s6_co_start
+  .type s6_co_start, @function
+s6_co_start:
+  movq %r12, %rdi
+  call s6_co_main_entry
+  ud2
+  .size s6_co_start, .-s6_co_start
+)");
+
+void s6_co_main(CoContext *ctx) {
+  while (true) {
+    ctx->func(ctx->arg);
+    ctx->suspend();
+  }
+}
+
+extern "C" __attribute__((visibility("hidden"), used)) void s6_co_main_entry(
+    CoContext *ctx) {
+  s6_co_main(ctx);
+}
+
+CoContext::~CoContext() {
+  if (pool && stack)
+    pool->free(stack);
+}
+
+int CoContext::init(CoStackPool *pool, co_func func, void *arg) {
+  assert(pool);
+
+  this->func = func;
+  this->arg = arg;
+  this->pool = pool;
+
+  stack = pool->alloc();
+  if (!stack)
+    return -1;
+
+  // the frame popped by the first s6_co_switch(), 16-byte aligned
+  uintptr_t top = reinterpret_cast<uintptr_t>(stack) + pool->get_stack_size();
+  uint64_t *frame = reinterpret_cast<uint64_t *>((top & ~uintptr_t(15)) - 80);
+
+  uint32_t mxcsr;
+  uint16_t fpucw;
+  asm volatile("stmxcsr %0" : "=m"(mxcsr));
+  asm volatile("fnstcw %0" : "=m"(fpucw));
+
+  memset(frame, 0, 80);
+  frame[0] = mxcsr | (uint64_t(fpucw) << 32);
+  frame[4] = reinterpret_cast<uint64_t>(this);         // r12
+  frame[7] = reinterpret_cast<uint64_t>(s6_co_start);  // return address
+
+  sp = frame;
+  return 0;
+}
+
+void CoContext::resume() {
+  s6_co_switch(&caller_sp, sp);
+}
+
+void CoContext::suspend() {
+  s6_co_switch(&sp, caller_sp);
+}
+
+#endif  // S6_CO_BOOST
@@ -0,0 +1,98 @@
+#ifndef _DISTREF_CO_CONTEXT_HH_
+#define _DISTREF_CO_CONTEXT_HH_
+
+#include <cstddef>
+#include <vector>
+
+// boost::coroutines is the fallback on other architectures
+#if !defined(__x86_64__) && !defined(S6_CO_BOOST)
+#define S6_CO_BOOST
+#endif
+
+#ifdef S6_CO_BOOST
+#include <boost/coroutine/all.hpp>
+
+typedef boost::coroutines::symmetric_coroutine<void>::call_type call_type;
+typedef boost::coroutines::symmetric_coroutine<void>::yield_type yield_type;
+#endif
+
+#define CO_STACK_SIZE (64 * 1024)  // including a guard page
+#define CO_STACK_CHUNK 64          // stacks mapped at once
+
+/*
+ * Stacks for CoContext
+ *
+ * Stacks are mapped in chunks of CO_STACK_CHUNK, with a guard page below each
+ * one, and recycled through a free list. Pages are backed on first touch, so
+ * an idle coroutine costs the few pages its deepest call has used, and
+ * nothing once its stack is freed.
+ *
+ * NOTE:
+ * - Not thread-safe; one pool per scheduler.
+ */
+class CoStackPool {
+ private:
+  std::size_t stack_size;
+  std::vector<void *> free_stacks;
+  std::vector<void *> chunks;
+
+  int grow();
+
+ public:
+  explicit CoStackPool(std::size_t stack_size = CO_STACK_SIZE);
+  ~CoStackPool();
+
+  std::size_t get_stack_size() const { return stack_size; }
+  std::size_t get_mapped_bytes() const {
+    return chunks.size() * CO_STACK_CHUNK * stack_size;
+  }
+
+  void *alloc();           // returns the lowest address (the guard page)
+  void free(void *stack);  // also releases its resident pages
+};
+
+/*
+ * Execution context of a coroutine
+ *
+ * resume() runs the coroutine until it calls suspend(), which returns to the
+ * resume() caller. When func returns, the context suspends itself and calls
+ * func again on the next resume().
+ *
+ * The default backend switches stacks with a few instructions (callee-saved
+ * registers only) on stacks from a CoStackPool. Define S6_CO_BOOST to use
+ * boost::coroutines::symmetric_coroutine instead; the stack size is then a
+ * hint to boost.
+ */
+class CoContext {
+ public:
+  typedef void (*co_func)(void *arg);
+
+ private:
+  co_func func = nullptr;
+  void *arg = nullptr;
+
+#ifdef S6_CO_BOOST
+  call_type *call = nullptr;
+  yield_type *yield = nullptr;
+#else
+  CoStackPool *pool = nullptr;
+  void *stack = nullptr;
+  void *sp = nullptr;         // of this coroutine, while suspended
+  void *caller_sp = nullptr;  // of the resume() caller, while running
+
+  friend void s6_co_main(CoContext *ctx);
+#endif
+
+ public:
+  CoContext() {}
+  ~CoContext();
+  CoContext(const CoContext &) = delete;
+  CoContext &operator=(const CoContext &) = delete;
+
+  int init(CoStackPool *pool, co_func func, void *arg);
+
+  void resume();
+  void suspend();
+};
+
+#endif /* _DISTREF_CO_CONTEXT_HH_ */
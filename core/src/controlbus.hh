@@ -1,6 +1,8 @@
 #ifndef _DISTREF_CONTROL_BUS_HH_
 #define _DISTREF_CONTROL_BUS_HH_
 
+#include <cstdlib>
+
 #include "type.hh"
 #include "worker_address.hh"
 
@@ -56,6 +58,10 @@ class ControlBus {
       const std::size_t messageSize) const = 0;
   virtual MessageBuffer *init_message(uint8_t *buf,
                                       std::size_t buf_size) const = 0;
+  // releases a message returned by Connector::receive()
+  virtual void free_message(MessageBuffer *message) const {
+    std::free(message);
+  }
   struct CbusStats get_stats() {
     return stats;
   }
@@ -10,6 +10,9 @@
 #define _FLAG_STALE (1 << 0)
 #define _FLAG_BEHIND (1 << 1)
 
+// keys up to this size are stored inside SwRef/MwRef, without an allocation
+#define REF_KEY_BUF_SIZE 64
+
 enum DObjType : int8_t { DOBJECT_UNKNOWN = 0, DOBJECT_SW, DOBJECT_MW };
 
 struct _DR_ClassInfo {
@@ -1,9 +1,11 @@
 #include "d_routine.hh"
 
-#include <bitset>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <queue>
+#include <sstream>
 #include <string>
 #include <time.h>
 
@@ -16,9 +18,28 @@
 #include <rte_mbuf.h>
 #include <rte_udp.h>
 
+#include "co_context.hh"
 #include "dpdk.hh"
 #include "time.hh"
 
+// smallest i with pct % of the samples in hist[0..i], 0 if no samples
+static int histogram_percentile(const size_t *hist, int n, double pct) {
+  uint64_t total = 0;
+  for (int i = 0; i < n; i++)
+    total += hist[i];
+  if (total == 0)
+    return 0;
+
+  uint64_t rank = std::max<uint64_t>(1, total * pct / 100);
+  uint64_t t_total = 0;
+  for (int i = 0; i < n; i++) {
+    t_total += hist[i];
+    if (t_total >= rank)
+      return i;
+  }
+  return n - 1;
+}
+
 #define IP_PRINT(ip)                                                       \
   (ip >> 24 & 0xFF) << "." << (ip >> 16 & 0xFF) << "." << (ip >> 8 & 0xFF) \
                     << "." << (ip & 0xFF)
@@ -26,11 +47,36 @@
 struct Droutine {
   int idx;  // for debugging
   RTYPE type;
-  call_type *call;
-  yield_type *yield;
+  CoContext ctx;
   std::atomic<bool> loop_coroutine;
+
+  // wait list (while blocked) or wake list (once woken up)
+  Droutine *next_waiter = nullptr;
+  Droutine *last_waiter = nullptr;  // of the wait list, at its head only
+  const Key *wait_key = nullptr;    // of the yield_block() caller
+  int wait_map_id = 0;
+  int wait_block_id = 0;
+  uint64_t ready_tsc = 0;     // when woken up
+  uint8_t block_causes = 0;  // of the current packet, 1 << PKT_LAT_CLASS
 };
 
+static_assert((WAIT_INDEX_SIZE & (WAIT_INDEX_SIZE - 1)) == 0,
+              "WAIT_INDEX_SIZE must be a power of two");
+static_assert(WAIT_INDEX_SIZE > MAX_ROUTINE_IDX,
+              "WAIT_INDEX_SIZE must leave empty slots");
+
+static inline std::size_t wait_hash(std::size_t key_hash, int map_id,
+                                    int block_id) {
+  return key_hash + (uint64_t)(uint32_t)block_id * 0xff51afd7ed558ccdULL +
+         (uint64_t)(uint32_t)map_id * 0xc4ceb9fe1a85ec53ULL;
+}
+
+static inline std::size_t wait_index_of(std::size_t hash) {
+  // Fibonacci hashing, Key::_hash() of many keys is weak
+  constexpr int shift = 64 - __builtin_ctz(WAIT_INDEX_SIZE);
+  return (hash * 0x9e3779b97f4a7c15ULL) >> shift;
+}
+
 // XXX Move to packet generator
 /* Copied from a bess native_apps/source.c */
 /* Copied from a DPDK example */
@@ -102,22 +148,32 @@ static void build_template(char *pkt_tmp, int size) {
   udp_tmp->dgram_cksum = rte_cpu_to_be_16(0);
 }
 
-DroutineScheduler::DroutineScheduler(int node_id, bool is_dpdk, char *log_dir) {
-  this->pkt_routine_pool = nullptr;
-  this->bg_routine = nullptr;
+DroutineScheduler::DroutineScheduler(int node_id, bool is_dpdk, char *log_dir,
+                                     uint16_t qid) {
+  this->stack_pool = new CoStackPool();
   this->pkt_callback = nullptr;
-  this->bg_callback = nullptr;
   this->is_new_pkt_routine = false;
-  this->is_new_bg_routine = false;
-  this->is_bg_routine_running = false;
   this->cur_routine = nullptr;
 
   this->max_pkts_proc = 0;  // 0 for processing packets infinitely
                             // until dies
   this->is_dpdk = is_dpdk;
+  this->qid = qid;
   stats = {0};
 
-  wait_unblocked.set();
+  recv_stats.start_tsc = get_cur_rdtsc(true);
+  recv_stats.last_call_tsc = recv_stats.start_tsc;
+  recv_stats.max_diff_tsc = 0;
+  recv_stats.print_empty_pool = true;
+
+  wait_slots.assign(WAIT_INDEX_SIZE, WaitSlot{nullptr, 0});
+  idx_blocked.assign(MAX_ROUTINE_IDX + 1, nullptr);
+
+  memset(class_lat, 0, sizeof(class_lat));
+
+  adapt_interval_tsc = get_tsc_freq() / 1000 * POOL_ADAPT_INTERVAL_MS;
+  pool_stats = {0};
+  pool_stats.last_adapt_tsc = recv_stats.start_tsc;
 
   if (!is_dpdk) {
     int p_size = 64;
@@ -159,110 +215,211 @@ DroutineScheduler::~DroutineScheduler() {
   /* clear coroutines, coroutine containers - stack, queue, map */
   while (!idle_stack.empty())
     idle_stack.pop();
-  while (!wait_queue.empty())
-    wait_queue.pop();
-  for (int i = 0; i < _MAX_DMAPS; i++) {
-    block_map_arr[i].clear();
-  }
+  wake_head = wake_tail = nullptr;
 
-  if (bg_routine != nullptr) {
-    delete bg_routine->call;
-    delete bg_routine;
-  }
+  for (int fid = 0; fid < bg_routine_cnt; fid++)
+    delete bg_routines[fid].routine;
 
-  for (int i = 0; i < pkt_coroutine_cnt; i++) {
-    Droutine *routine = &pkt_routine_pool[i];
-    delete routine->call;
-  }
+  for (Droutine *routine : pkt_routines)
+    delete routine;
+  pkt_routines.clear();
+
+  delete stack_pool;
+}
 
-  free(pkt_routine_pool);
+void DroutineScheduler::run_pkt_routine(void *arg) {
+  static_cast<DroutineScheduler *>(arg)->pkt_routine_loop();
+}
+
+void DroutineScheduler::pkt_routine_loop() {
+  int pkt_count = 0;
+  int loop_count = 0;
+  while (true) {
+    loop_count++;
+
+    if (loop_count >= policy.idle_loops) {
+      pkt_count = 0;
+      loop_count = 0;
+      yield_idle();
+      continue;
+    }
+
+    if ((max_pkts_proc > 0) && (stats.tot_pkts_proc >= max_pkts_proc)) {
+      yield_idle();
+      continue;
+    }
+
+    struct rte_mbuf *pkt_p = get_next_packet();
+    if (!pkt_p) {
+      yield_idle();
+      continue;
+    }
+
+    pkt_count++;
+    loop_count--;
+
+    cur_routine->block_causes = 0;
+    int forward = pkt_callback(pkt_p);
+    record_pkt_latency(pkt_p, cur_routine->block_causes);
+    if (forward)
+      forward_packet(pkt_p);
+    else
+      drop_packet(pkt_p);
+
+    if (!cur_routine->loop_coroutine || pkt_count >= policy.slice_pkts) {
+      pkt_count = 0;
+      loop_count = 0;
+      yield_idle();
+      continue;
+    }
+  }  // end for while
 }
 
 int DroutineScheduler::pkt_routine_init() {
-  pkt_calltype = ([&](yield_type &yield) {
-    int pkt_count = 0;
-    int loop_count = 0;
-    int count = 0;
-    while (true) {
-      loop_count++;
-
-      if (loop_count >= 4) {
-        pkt_count = 0;
-        loop_count = 0;
-        yield_idle();
-        continue;
-      }
-
-      cur_routine->yield = &yield;
-
-      if ((max_pkts_proc > 0) && (stats.tot_pkts_proc >= max_pkts_proc)) {
-        yield_idle();
-        continue;
-      }
-
-      struct rte_mbuf *pkt_p = get_next_packet();
-      if (!pkt_p) {
-        yield_idle();
-        continue;
-      }
-
-      pkt_count++;
-      loop_count--;
-
-      int forward = pkt_callback(pkt_p);
-      if (forward)
-        forward_packet(pkt_p);
-      else
-        drop_packet(pkt_p);
-
-      if (!cur_routine->loop_coroutine || pkt_count >= 96) {
-        pkt_count = 0;
-        loop_count = 0;
-        yield_idle();
-        continue;
-      }
-    }  // end for while
-  });
-
-  pkt_routine_pool =
-      (Droutine *)std::malloc(pkt_coroutine_cnt * sizeof(Droutine));
-  if (!pkt_routine_pool) {
+  if (grow_pkt_routines() <= 0) {
     errno = -ENOMEM;
     return -1;
   }
 
-  for (int i = 0; i < pkt_coroutine_cnt; i++) {
-    Droutine *routine = &pkt_routine_pool[i];
-    routine->idx = pkt_coroutine_cnt - i;
+  is_new_pkt_routine = true;
+
+  return 0;
+}
+
+// doubles the packet routines (up to pkt_coroutine_cnt), returns # of new ones
+int DroutineScheduler::grow_pkt_routines() {
+  int cur_cnt = pkt_routines.size();
+  int cnt = std::min(std::max(cur_cnt, INIT_COROUTINE_CNT),
+                     pkt_coroutine_cnt - cur_cnt);
+
+  for (int i = 0; i < cnt; i++) {
+    Droutine *routine = new Droutine();
+    // idx is the d_idx of blocked routines: reuse the ones of destroyed
+    // routines, all of 1..size are in use otherwise
+    if (free_routine_idx.empty()) {
+      routine->idx = pkt_routines.size() + 1;
+    } else {
+      routine->idx = free_routine_idx.back();
+      free_routine_idx.pop_back();
+    }
     routine->type = PKT_ROUTINE;
-    routine->call = new call_type(pkt_calltype);
-    routine->yield = nullptr;
     routine->loop_coroutine = true;
 
+    if (routine->ctx.init(stack_pool, run_pkt_routine, this) < 0) {
+      DEBUG_ERR("Fail to create packet routine " << routine->idx);
+      free_routine_idx.push_back(routine->idx);
+      delete routine;
+      return i;
+    }
+
+    pkt_routines.push_back(routine);
     idle_stack.push(routine);
   }
 
-  is_new_pkt_routine = true;
+  if (cur_cnt > 0) {
+    DEBUG_MTH("packet routines " << cur_cnt << " -> " << cur_cnt + cnt);
+    pool_stats.tot_grow++;
+  }
 
-  return 0;
+  pool_stats.max_routines =
+      std::max(pool_stats.max_routines, (int)pkt_routines.size());
+
+  return cnt;
+}
+
+// destroys idle packet routines down to target, returns # of destroyed ones
+int DroutineScheduler::shrink_pkt_routines(int target) {
+  int cur_cnt = pkt_routines.size();
+  int cnt = std::min(cur_cnt - target, (int)idle_stack.size());
+  if (cnt <= 0)
+    return 0;
+
+  std::vector<Droutine *> victims;
+  for (int i = 0; i < cnt; i++) {
+    victims.push_back(idle_stack.top());
+    idle_stack.pop();
+  }
+
+  std::sort(victims.begin(), victims.end());
+  pkt_routines.erase(
+      std::remove_if(pkt_routines.begin(), pkt_routines.end(),
+                     [&victims](Droutine *r) {
+                       return std::binary_search(victims.begin(),
+                                                 victims.end(), r);
+                     }),
+      pkt_routines.end());
+
+  // idle routines are suspended in yield_idle(), nothing to unwind
+  for (Droutine *routine : victims) {
+    free_routine_idx.push_back(routine->idx);
+    delete routine;
+  }
+
+  DEBUG_MTH("packet routines " << cur_cnt << " -> " << cur_cnt - cnt);
+  pool_stats.tot_shrink++;
+
+  return cnt;
 }
 
-int DroutineScheduler::bg_routine_init() {
-  bg_calltype = ([&](yield_type &yield) {
+/*
+ * Sizes the packet routine pool from the busy routines (running, blocked on
+ * remote objects or RPCs) recorded at each dispatch since the last call.
+ * The pool grows on demand in call_scheduler(); it shrinks to twice the
+ * POOL_DEMAND_PERCENTILE of busy routines (rounded up to a power of two)
+ * once it has been larger than that for POOL_SHRINK_WINDOWS calls in a row,
+ * e.g., after a scaling event has drained the blocked routines.
+ *
+ * Called every POOL_ADAPT_INTERVAL_MS by call_scheduler(); returns the pool
+ * size.
+ */
+int DroutineScheduler::adapt_pkt_routines() {
+  int busy = pkt_routines.size() - idle_stack.size();
+  int demand = std::max(
+      busy, histogram_percentile(window_count, MAX_COROUTINE_CNT + 1,
+                                 POOL_DEMAND_PERCENTILE));
+  std::fill(window_count, window_count + MAX_COROUTINE_CNT + 1, 0);
+
+  int target = INIT_COROUTINE_CNT;
+  while (target < 2 * demand)
+    target <<= 1;
+
+  if ((int)pkt_routines.size() <= target) {
+    pool_stats.oversized_windows = 0;
+    pool_stats.shrink_target = 0;
+    return pkt_routines.size();
+  }
+
+  pool_stats.shrink_target = std::max(pool_stats.shrink_target, target);
+  if (++pool_stats.oversized_windows >= POOL_SHRINK_WINDOWS) {
+    shrink_pkt_routines(pool_stats.shrink_target);
+    pool_stats.oversized_windows = 0;
+    pool_stats.shrink_target = 0;
+  }
+
+  return pkt_routines.size();
+}
+
+void DroutineScheduler::run_bg_routine(void *arg) {
+  BgRoutine *bg = static_cast<BgRoutine *>(arg);
 
-    cur_routine->yield = &yield;
+  bg->cb();
 
-    bg_callback();
+  bg->is_running = false;
+}
+
+int DroutineScheduler::bg_routine_init(BgRoutine *bg, int fid) {
+  Droutine *routine = new Droutine();
+  routine->idx = MAX_COROUTINE_CNT + 1 + fid;
+  routine->type = BG_ROUTINE;
+  routine->loop_coroutine = false;
 
-    is_bg_routine_running = false;
-  });
+  if (routine->ctx.init(stack_pool, run_bg_routine, bg) < 0) {
+    DEBUG_ERR("Fail to create background routine " << fid);
+    delete routine;
+    return -1;
+  }
 
-  bg_routine = new Droutine();
-  bg_routine->idx = MAX_COROUTINE_CNT;
-  bg_routine->type = BG_ROUTINE;
-  bg_routine->call = new call_type(bg_calltype);
-  bg_routine->yield = nullptr;
-  bg_routine->loop_coroutine = false;
+  bg->routine = routine;
   return 0;
 }
 
@@ -272,45 +429,48 @@ int DroutineScheduler::recv_pkts() {
 
   static const uint64_t hz = get_tsc_freq();
 
-  static const uint64_t start_tsc = get_cur_rdtsc(true);
-  static uint64_t last_call_tsc = start_tsc;
-  static uint64_t max_diff_tsc = 0;
-
   s6_gettimeofday(true);
 
-  static bool print_empty_pool = true;
   if (pkt_queue.size() > MAX_PKT_BUFF_SIZE) {
-    if (print_empty_pool) {
+    if (recv_stats.print_empty_pool) {
       DEBUG_WARN("number of packets exceeds the predefined maximum "
                  << MAX_PKT_BUFF_SIZE);
-      print_empty_pool = false;
+      recv_stats.print_empty_pool = false;
     }
     return -1;
   }
 
   rte_mbuf *pkt_pool[BATCH_SIZE];
 
-  int ret = dpdk_receive_pkts(pkt_pool, BATCH_SIZE);
+  int ret = dpdk_receive_pkts(qid, pkt_pool, BATCH_SIZE);
   if (ret <= 0)
     return -1;
 
-  for (int i = 0; i < ret; i++)
+  uint64_t recv_tsc = get_cur_rdtsc(true);
+
+  for (int i = 0; i < ret; i++) {
+    pkt_pool[i]->timestamp = recv_tsc;  // for SC_PKT latency
     pkt_queue.push(pkt_pool[i]);
+  }
+
+  // the leases of the burst are on the way while its packets are processed
+  if (key_extractor) {
+    for (int i = 0; i < ret; i++)
+      key_extractor(pkt_pool[i]);
+  }
 
   stats.tot_pkts_recv += ret;
   stats.cur_pkts_buff += ret;
-
-  uint64_t recv_tsc = get_cur_rdtsc(true);
-  if (max_diff_tsc < recv_tsc - last_call_tsc) {
-    max_diff_tsc = recv_tsc - last_call_tsc;
-    double t = max_diff_tsc / (double)hz * 1000;  // ms
+  if (recv_stats.max_diff_tsc < recv_tsc - recv_stats.last_call_tsc) {
+    recv_stats.max_diff_tsc = recv_tsc - recv_stats.last_call_tsc;
+    double t = recv_stats.max_diff_tsc / (double)hz * 1000;  // ms
     DEBUG_TIME("[dpdk_receive_pkts] new max time diff between two calls "
                << t << " ms");
   }
-  last_call_tsc = recv_tsc;
+  recv_stats.last_call_tsc = recv_tsc;
 
   if (stats.cur_pkts_buff > stats.max_pkts_buff &&
-      recv_tsc - start_tsc > (double)hz * 5) {  // ignore first 5 sec
+      recv_tsc - recv_stats.start_tsc > (double)hz * 5) {  // ignore first 5 sec
     stats.max_pkts_buff = stats.cur_pkts_buff;
   }
 
@@ -325,6 +485,10 @@ struct rte_mbuf *DroutineScheduler::get_next_packet() {
     rte_mbuf *pkt = pkt_queue.front();
     pkt_queue.pop();
     stats.tot_pkts_proc++;
+
+    // synthetic packets are stamped once recycled
+    if (pkt->timestamp)
+      record_latency(SC_PKT, rte_rdtsc() - pkt->timestamp);
     return pkt;
   }
 
@@ -345,11 +509,13 @@ struct rte_mbuf *DroutineScheduler::get_next_packet() {
   rte_mbuf *pkt = pkt_queue.front();
   pkt_queue.pop();
   stats.tot_pkts_proc++;
+  record_latency(SC_PKT, rte_rdtsc() - pkt->timestamp);
   return pkt;
 }
 
 void DroutineScheduler::drop_packet(struct rte_mbuf *pkt) {
   if (!is_dpdk) {
+    pkt->timestamp = rte_rdtsc();
     pkt_queue.push(pkt);
     return;
   }
@@ -361,19 +527,45 @@ void DroutineScheduler::drop_packet(struct rte_mbuf *pkt) {
 
 void DroutineScheduler::forward_packet(struct rte_mbuf *pkt) {
   if (!is_dpdk) {
+    pkt->timestamp = rte_rdtsc();
     pkt_queue.push(pkt);
     return;
   }
 
-  uint16_t tx = dpdk_send_pkt(pkt);
-  if (tx == 0)
-    rte_pktmbuf_free(pkt);
+  tx_buf[tx_cnt++] = pkt;
+  if (tx_cnt == BATCH_SIZE)
+    flush_tx_buf();
+}
 
-  stats.tot_pkts_free++;
-  stats.cur_pkts_buff--;
+void DroutineScheduler::flush_tx_buf() {
+  if (tx_cnt == 0)
+    return;
+
+  int sent = 0;
+  for (int retry = 0; retry < MAX_TX_RETRY && sent < tx_cnt; retry++) {
+    if (retry > 0)
+      stats.tot_tx_retry++;
+
+    sent += dpdk_send_pkts(qid, tx_buf + sent, tx_cnt - sent);
+    stats.tot_tx_bursts++;
+  }
+
+  // backpressure: tx ring is still full, drop what is left
+  for (int i = sent; i < tx_cnt; i++)
+    rte_pktmbuf_free(tx_buf[i]);
+
+  stats.tot_pkts_return += sent;
+  stats.tot_pkts_free += tx_cnt - sent;
+  stats.tot_tx_drop += tx_cnt - sent;
+  stats.cur_pkts_buff -= tx_cnt;
+
+  tx_cnt = 0;
 }
 
 void DroutineScheduler::teardown() {
+  if (is_dpdk)
+    flush_tx_buf();
+
   while (!pkt_queue.empty()) {
     rte_mbuf *pkt = pkt_queue.front();
     pkt_queue.pop();
@@ -400,19 +592,84 @@ int DroutineScheduler::set_packet_routine(packet_func cb, int coroutine_cnt) {
   return pkt_routine_init();
 };
 
-int DroutineScheduler::set_background_routine(background_func cb) {
-  bg_callback = cb;
-  bg_routine_init();
+/* spec: "key=value,..." with wake, pkt, slice, idle (see SchedPolicy) and
+ * wake_first (0 or 1); unspecified ones are kept */
+int parse_sched_policy(const char *spec, SchedPolicy *policy) {
+  SchedPolicy p = *policy;
+  std::stringstream ss(spec);
+  std::string item;
+
+  while (std::getline(ss, item, ',')) {
+    std::size_t eq = item.find('=');
+    char *end = nullptr;
+    long val = eq == std::string::npos
+                   ? -1
+                   : strtol(item.c_str() + eq + 1, &end, 10);
+    if (val < 0 || !end || *end != '\0') {
+      DEBUG_ERR("Invalid scheduler policy item: " << item);
+      return -1;
+    }
+
+    std::string key = item.substr(0, eq);
+    if (key == "wake")
+      p.wake_weight = val;
+    else if (key == "pkt")
+      p.pkt_weight = val;
+    else if (key == "slice")
+      p.slice_pkts = val;
+    else if (key == "idle")
+      p.idle_loops = val;
+    else if (key == "wake_first")
+      p.wake_first = (val != 0);
+    else {
+      DEBUG_ERR("Unknown scheduler policy key: " << key);
+      return -1;
+    }
+  }
+
+  if (p.pkt_weight < 1 || p.slice_pkts < 1 || p.idle_loops < 1) {
+    DEBUG_ERR("pkt, slice and idle of scheduler policy should be positive");
+    return -1;
+  }
 
+  *policy = p;
   return 0;
+}
+
+int DroutineScheduler::set_background_routine(background_func cb) {
+  if (cb == nullptr)
+    return -1;
+
+  if (bg_routine_cnt >= MAX_BGFUNC_CNT) {
+    DEBUG_ERR("The number of background routines exceeds the maximum "
+              << MAX_BGFUNC_CNT);
+    return -1;
+  }
+
+  int fid = bg_routine_cnt;
+  BgRoutine *bg = &bg_routines[fid];
+  *bg = BgRoutine{cb, nullptr, false, false, 0};
+  if (bg_routine_init(bg, fid) < 0)
+    return -1;
+
+  bg_routine_cnt++;
+  return fid;
 };
 
-int DroutineScheduler::run_background_routine() {
-  if (is_bg_routine_running || bg_callback == nullptr)
+// background routines run concurrently, but each one once at a time
+int DroutineScheduler::run_background_routine(int fid) {
+  if (fid < 0 || fid >= bg_routine_cnt) {
+    DEBUG_ERR("No background routine " << fid);
+    return -1;
+  }
+
+  BgRoutine *bg = &bg_routines[fid];
+  if (bg->is_running)
     return -1;
 
-  is_new_bg_routine = true;
-  is_bg_routine_running = true;
+  bg->is_new = true;
+  bg->is_running = true;
+  bg->ready_tsc = rte_rdtsc();
 
   return 0;
 };
@@ -426,8 +683,6 @@ int DroutineScheduler::get_cur_routine_idx() {
 
 /* scheduling routines -Dummiest scheduler ever ;( */
 bool DroutineScheduler::call_scheduler() {
-  static bool warn_coroutine_pool = false;
-
 #ifdef NO_COROUTINE  // e.g, valgrind test
   if (is_new_pkt_routine) {
     struct rte_mbuf *pkt_p = get_next_packet();
@@ -440,56 +695,56 @@ bool DroutineScheduler::call_scheduler() {
     return true;
   }
 
-  if (is_new_bg_routine) {
-    DEBUG_MTH("schedule bg_routine " << bg_routine->idx);
-    bg_callback();
-    return false;
+  bool is_new_bg_routine = false;
+  for (int fid = 0; fid < bg_routine_cnt; fid++) {
+    BgRoutine *bg = &bg_routines[fid];
+    if (!bg->is_new)
+      continue;
+
+    DEBUG_MTH("run background function " << fid);
+    bg->is_new = false;
+    bg->cb();
+    bg->is_running = false;
+    is_new_bg_routine = true;
   }
+  if (is_new_bg_routine)
+    return false;
 #else  // undef NO_COROUTINE
 
-  /* executing idle routines with new packets */
-  if (is_new_pkt_routine) {
-    DEBUG_MTH("Schedule new packet routine");
-    if (!idle_stack.empty()) {
-      Droutine *idle_routine = idle_stack.top();
-      idle_stack.pop();
-      DEBUG_MTH("schedule idle_routine " << idle_routine->idx);
+  /* order and quotas of each round are set by SchedPolicy */
+  if (policy.wake_first)
+    run_woken_routines();
 
-      int cnt = pkt_coroutine_cnt - idle_stack.size();
-      assert(cnt >= 0 && cnt <= MAX_COROUTINE_CNT);
-      thread_count[cnt]++;
+  for (int i = 0; i < policy.pkt_weight && is_new_pkt_routine; i++)
+    dispatch_pkt_routine();
 
-      schedule(idle_routine, RT_LOOP);
-    } else {
-      // no alert
-      warn_coroutine_pool = true;
-      if (!warn_coroutine_pool)
-        DEBUG_WARN("There is no idle routine!!");
-    }
+  for (int fid = 0; fid < bg_routine_cnt; fid++) {
+    BgRoutine *bg = &bg_routines[fid];
+    if (!bg->is_new)
+      continue;
 
-    if ((max_pkts_proc > 0) && (stats.tot_pkts_proc >= max_pkts_proc))
-      is_new_pkt_routine = false;
+    bg->is_new = false;
+    DEBUG_MTH("schedule bg_routine " << bg->routine->idx);
+    record_latency(SC_BG, rte_rdtsc() - bg->ready_tsc);
+    schedule(bg->routine, RT_BLOCKED);
   }
 
-  // XXX Need to implement priority scheduler
-  // pkt_routine >> bg_routine
-  if (bg_routine && is_new_bg_routine) {
-    is_new_bg_routine = false;
-    DEBUG_MTH("schedule bg_routine " << bg_routine->idx);
-    schedule(bg_routine, RT_BLOCKED);
-  }
+  if (!policy.wake_first)
+    run_woken_routines();
 
-  /* executing wait routines */
-  while (!wait_queue.empty()) {
-    DEBUG_MTH("Schedule new waiting routines");
-    Droutine *wait_routine = wait_queue.front();
-    wait_queue.pop();
-    DEBUG_MTH("schedule wait_routine " << wait_routine->idx);
-    schedule(wait_routine, RT_BLOCKED);
+  if (is_dpdk)
+    flush_tx_buf();
+
+  if (pkt_callback) {
+    uint64_t now_tsc = get_cur_rdtsc();
+    if (now_tsc - pool_stats.last_adapt_tsc > adapt_interval_tsc) {
+      pool_stats.last_adapt_tsc = now_tsc;
+      adapt_pkt_routines();
+    }
   }
 
-  if (!is_new_pkt_routine && wait_unblocked.all() && wait_queue.empty() &&
-      block_routine_map.empty()) {
+  if (!is_new_pkt_routine && wait_list_cnt == 0 && !wake_head &&
+      idx_blocked_cnt == 0) {
     DEBUG_MTH("Stop scheduler");
     return false;
   }
@@ -498,36 +753,102 @@ bool DroutineScheduler::call_scheduler() {
   return true;
 }
 
-void DroutineScheduler::reset_micro_threads_stat() {
-  thread_count[MAX_COROUTINE_CNT + 1] = {0};
-}
+/* executing idle routines with new packets */
+void DroutineScheduler::dispatch_pkt_routine() {
+  static bool warn_coroutine_pool = false;
 
-void DroutineScheduler::print_micro_threads_stat() {
-  uint64_t total = 0;
-  uint64_t max = 0;
+  DEBUG_MTH("Schedule new packet routine");
+  if (idle_stack.empty() && (int)pkt_routines.size() < pkt_coroutine_cnt)
+    grow_pkt_routines();
 
-  for (int i = 0; i < MAX_COROUTINE_CNT; i++) {
-    if (thread_count[i] > 0) {
-      total += thread_count[i];
-      max = i;
-    }
+  if (!idle_stack.empty()) {
+    Droutine *idle_routine = idle_stack.top();
+    idle_stack.pop();
+    DEBUG_MTH("schedule idle_routine " << idle_routine->idx);
+
+    int cnt = pkt_routines.size() - idle_stack.size();
+    assert(cnt >= 0 && cnt <= MAX_COROUTINE_CNT);
+    thread_count[cnt]++;
+    window_count[cnt]++;
+
+    schedule(idle_routine, RT_LOOP);
+  } else {
+    // no alert
+    warn_coroutine_pool = true;
+    if (!warn_coroutine_pool)
+      DEBUG_WARN("There is no idle routine!!");
   }
-  DEBUG_INFO("The maximum number of multi-threads is " << max);
 
-  uint64_t median_cnt = total / 2;
-  uint64_t t_total = 0;
-  for (int i = 0; i < MAX_COROUTINE_CNT; i++) {
-    if (thread_count[i] == 0)
-      continue;
+  if ((max_pkts_proc > 0) && (stats.tot_pkts_proc >= max_pkts_proc))
+    is_new_pkt_routine = false;
+}
 
-    // DEBUG_ERR( i << " " << thread_count[i]);
+/* executing wait routines, up to policy.wake_weight */
+int DroutineScheduler::run_woken_routines() {
+  int cnt = 0;
 
-    t_total += thread_count[i];
-    if (median_cnt < t_total) {
-      DEBUG_INFO("The median number of multi-threads is " << i);
-      break;
-    }
+  while (wake_head && (policy.wake_weight <= 0 || cnt < policy.wake_weight)) {
+    DEBUG_MTH("Schedule new waiting routines");
+    Droutine *wait_routine = wake_head;
+    wake_head = wait_routine->next_waiter;
+    if (!wake_head)
+      wake_tail = nullptr;
+    wait_routine->next_waiter = nullptr;
+
+    DEBUG_MTH("schedule wait_routine " << wait_routine->idx);
+    record_latency(SC_WAKE, rte_rdtsc() - wait_routine->ready_tsc);
+    schedule(wait_routine, RT_BLOCKED);
+    cnt++;
   }
+
+  return cnt;
+}
+
+void DroutineScheduler::record_pkt_latency(struct rte_mbuf *pkt,
+                                           uint8_t block_causes) {
+  // synthetic packets are stamped once recycled
+  if (!pkt->timestamp)
+    return;
+
+  int pl = PL_LOCAL;
+  if (block_causes & (block_causes - 1))
+    pl = PL_MIXED;
+  else if (block_causes)
+    pl = __builtin_ctz(block_causes);
+
+  pkt_lat[pl].record(rte_rdtsc() - pkt->timestamp);
+}
+
+void DroutineScheduler::reset_pkt_latency() {
+  for (int pl = 0; pl < PL_MAX; pl++)
+    pkt_lat[pl].reset();
+}
+
+const char *DroutineScheduler::pkt_latency_name(int pl) {
+  static const char *names[PL_MAX] = {"local", "sw", "strict", "stale",
+                                      "mixed"};
+  return names[pl];
+}
+
+void DroutineScheduler::reset_micro_threads_stat() {
+  std::fill(thread_count, thread_count + MAX_COROUTINE_CNT + 1, 0);
+}
+
+void DroutineScheduler::print_micro_threads_stat() {
+  const int n = MAX_COROUTINE_CNT + 1;
+
+  DEBUG_INFO("The maximum number of multi-threads is "
+             << histogram_percentile(thread_count, n, 100));
+  DEBUG_INFO("The median number of multi-threads is "
+             << histogram_percentile(thread_count, n, 50));
+  DEBUG_INFO("The " << POOL_DEMAND_PERCENTILE
+                    << "th percentile number of multi-threads is "
+                    << histogram_percentile(thread_count, n,
+                                            POOL_DEMAND_PERCENTILE));
+  DEBUG_INFO("Packet routines: " << pkt_routines.size()
+                                 << " max: " << pool_stats.max_routines
+                                 << " grown: " << pool_stats.tot_grow
+                                 << " shrunk: " << pool_stats.tot_shrink);
 }
 
 void DroutineScheduler::print_stat(int node_id) {
@@ -537,33 +858,136 @@ void DroutineScheduler::print_stat(int node_id) {
   DEBUG_INFO("Returned to DPDK: " << stats.tot_pkts_return);
   DEBUG_INFO("Freed internally: " << stats.tot_pkts_free);
   DEBUG_INFO("Discarded during tear-down: " << stats.tot_pkts_discard);
+  DEBUG_INFO("TX bursts: " << stats.tot_tx_bursts
+                           << " retried: " << stats.tot_tx_retry
+                           << " dropped (tx ring full): " << stats.tot_tx_drop);
+  DEBUG_INFO("New flows not admitted: " << stats.tot_flows_reject);
   DEBUG_INFO("[w" << node_id
                   << "] Maximum buffer occupancy: " << stats.max_pkts_buff);
+
+  static const char *class_names[SC_MAX] = {"woken", "packet", "background"};
+  double us_per_tsc = 1.0E+6 / get_tsc_freq();
+  for (int sc = 0; sc < SC_MAX; sc++) {
+    if (class_lat[sc].cnt == 0)
+      continue;
+
+    DEBUG_INFO("Scheduling latency (" << class_names[sc] << "): "
+                                      << class_lat[sc].cnt << " runs, avg "
+                                      << class_lat[sc].tot_tsc * us_per_tsc /
+                                             class_lat[sc].cnt
+                                      << " us, max "
+                                      << class_lat[sc].max_tsc * us_per_tsc
+                                      << " us");
+  }
+
+  for (int pl = 0; pl < PL_MAX; pl++) {
+    const LatencyHist &h = pkt_lat[pl];
+    if (h.count() == 0)
+      continue;
+
+    DEBUG_INFO("Packet latency (" << pkt_latency_name(pl) << "): "
+                                  << h.count() << " pkts, p50 "
+                                  << h.percentile(50) * us_per_tsc
+                                  << " us, p99 "
+                                  << h.percentile(99) * us_per_tsc
+                                  << " us, max " << h.max() * us_per_tsc
+                                  << " us");
+  }
 }
 
 void DroutineScheduler::yield_block(int d_idx) {
   DEBUG_MTH("\tyield_block " << cur_routine->idx);
 
-  block_routine_map[d_idx] = cur_routine;
+  assert(d_idx > 0 && d_idx <= MAX_ROUTINE_IDX);
+  cur_routine->block_causes |= 1 << PL_STRICT;
+  if (!idx_blocked[d_idx])
+    idx_blocked_cnt++;
+  idx_blocked[d_idx] = cur_routine;
 
-  yield_type *yield = cur_routine->yield;
+  Droutine *routine = cur_routine;
   cur_routine = nullptr;
-  (*yield)();
+  routine->ctx.suspend();
 
   DEBUG_MTH("\tyield_block back " << cur_routine->idx);
 };
 
+// the wait list of (map_id, key, block_id), or the empty slot to insert it
+DroutineScheduler::WaitSlot *DroutineScheduler::find_wait_slot(
+    int map_id, const Key *key, int block_id, std::size_t hash) {
+  KeyOps ops = __get_key_ops(map_id);
+
+  for (std::size_t i = wait_index_of(hash);;
+       i = (i + 1) & (WAIT_INDEX_SIZE - 1)) {
+    WaitSlot *slot = &wait_slots[i];
+    if (!slot->head)
+      return slot;
+
+    Droutine *head = slot->head;
+    if (slot->hash == hash && head->wait_map_id == map_id &&
+        head->wait_block_id == block_id && ops.equal(head->wait_key, key))
+      return slot;
+  }
+}
+
+void DroutineScheduler::erase_wait_slot(WaitSlot *slot) {
+  const std::size_t mask = WAIT_INDEX_SIZE - 1;
+  std::size_t i = slot - wait_slots.data();
+
+  // moves back the following entries which probed past slot i
+  for (std::size_t j = (i + 1) & mask; wait_slots[j].head; j = (j + 1) & mask) {
+    std::size_t k = wait_index_of(wait_slots[j].hash);
+    if (((j - k) & mask) >= ((j - i) & mask)) {
+      wait_slots[i] = wait_slots[j];
+      i = j;
+    }
+  }
+
+  wait_slots[i].head = nullptr;
+  wait_list_cnt--;
+}
+
+void DroutineScheduler::push_wake(Droutine *first, Droutine *last) {
+  uint64_t now_tsc = rte_rdtsc();
+  for (Droutine *d = first;; d = d->next_waiter) {
+    d->ready_tsc = now_tsc;
+    if (d == last)
+      break;
+  }
+
+  if (wake_tail)
+    wake_tail->next_waiter = first;
+  else
+    wake_head = first;
+  wake_tail = last;
+}
+
 void DroutineScheduler::yield_block(int map_id, const Key *key, int block_id) {
   DEBUG_MTH("\tyield_block " << cur_routine->idx);
 
-  std::queue<Droutine *> &block_queue =
-      block_map_arr[map_id][VKey(key, block_id)];
-  wait_unblocked.reset(map_id);
-  block_queue.push(cur_routine);
+  Droutine *routine = cur_routine;
+  std::size_t hash =
+      wait_hash(__get_key_ops(map_id).hash(key), map_id, block_id);
+  WaitSlot *slot = find_wait_slot(map_id, key, block_id, hash);
+
+  // block_id >= 0 is the method id of a stale RPC (see BLOCK_ID)
+  routine->block_causes |= 1 << (block_id < 0 ? PL_SW : PL_STALE);
+  routine->next_waiter = nullptr;
+  if (slot->head) {
+    slot->head->last_waiter->next_waiter = routine;
+    slot->head->last_waiter = routine;
+  } else {
+    // the key stays valid, as the caller blocks until the list is woken up
+    routine->last_waiter = routine;
+    routine->wait_key = key;
+    routine->wait_map_id = map_id;
+    routine->wait_block_id = block_id;
+    slot->head = routine;
+    slot->hash = hash;
+    wait_list_cnt++;
+  }
 
-  yield_type *yield = cur_routine->yield;
   cur_routine = nullptr;
-  (*yield)();
+  routine->ctx.suspend();
 
   DEBUG_MTH("\tyield_block back " << cur_routine->idx);
 }
@@ -572,9 +996,9 @@ void DroutineScheduler::yield_idle() {
   DEBUG_MTH("\tyield_idle " << cur_routine->idx);
   idle_stack.push(cur_routine);
 
-  yield_type *yield = cur_routine->yield;
+  Droutine *routine = cur_routine;
   cur_routine = nullptr;
-  (*yield)();
+  routine->ctx.suspend();
 
   DEBUG_MTH("\tyield_idle back " << cur_routine->idx);
 }
@@ -588,41 +1012,38 @@ void DroutineScheduler::schedule(Droutine *routine, operationID opr) {
     routine->loop_coroutine = false;
 
   cur_routine = routine;
-  call_type *call = cur_routine->call;
-  (*call)();
+  routine->ctx.resume();
 }
 
 void DroutineScheduler::notify_to_wake_up(int d_idx) {
-  auto it = block_routine_map.find(d_idx);
-  if (it == block_routine_map.end()) {
+  if (d_idx <= 0 || d_idx > MAX_ROUTINE_IDX || !idx_blocked[d_idx]) {
     DEBUG_MTH("No waiting queue in strict " << d_idx);
     return;
   }
 
   DEBUG_MTH("wait to be scheduled in queue " << d_idx);
-  Droutine *d = it->second;
-  block_routine_map.erase(it);
-  wait_queue.push(d);
+  Droutine *d = idx_blocked[d_idx];
+  idx_blocked[d_idx] = nullptr;
+  idx_blocked_cnt--;
+
+  d->next_waiter = nullptr;
+  push_wake(d, d);
 }
 
 void DroutineScheduler::notify_to_wake_up(int map_id, const Key *key,
                                           int block_id) {
-  // pop the coroutines from the wake_up queue
-  std::queue<Droutine *> &block_queue =
-      block_map_arr[map_id][VKey(key, block_id)];
+  std::size_t hash =
+      wait_hash(__get_key_ops(map_id).hash(key), map_id, block_id);
+  WaitSlot *slot = find_wait_slot(map_id, key, block_id, hash);
 
-  if (block_queue.empty())
+  if (!slot->head) {
     DEBUG_MTH("No waiting queue in cached ");
-
-  while (!block_queue.empty()) {
-    DEBUG_MTH("Move to wake up queue");
-    Droutine *block_routine = block_queue.front();
-    block_queue.pop();
-    wait_queue.push(block_routine);
+    return;
   }
 
-  block_map_arr[map_id].erase(VKey(key, block_id));
-
-  if (block_map_arr[map_id].empty())
-    wait_unblocked.set(map_id);
+  // moves the whole wait list to the wake up list
+  DEBUG_MTH("Move to wake up queue");
+  Droutine *head = slot->head;
+  erase_wait_slot(slot);
+  push_wake(head, head->last_waiter);
 }
@@ -2,65 +2,141 @@
 #define _DISTREF_DROUTINE_HH_
 
 #include <atomic>
-#include <boost/coroutine/all.hpp>
 #include <queue>
 #include <stack>
 #include <stdio.h>
-#include <unordered_map>
+#include <vector>
 
 #include "log.hh"
 
+#include "application.hh"
 #include "key.hh"
+#include "latency_hist.hh"
 #include "type.hh"
 
 #define BATCH_SIZE 32
+#define MAX_TX_RETRY 4  // tx_burst attempts before dropping the rest
 #define MAX_PKT_BUFF_SIZE (4096)
 //#define MAX_PKT_BUFF_SIZE (32*4096*16)
 #define MAX_COROUTINE_CNT (MAX_PKT_BUFF_SIZE)
+// packet routines are 1..MAX_COROUTINE_CNT, background ones follow
+#define MAX_ROUTINE_IDX (MAX_COROUTINE_CNT + MAX_BGFUNC_CNT)
+#define INIT_COROUTINE_CNT 64  // the pool doubles up to the requested count
+#define POOL_ADAPT_INTERVAL_MS 1000  // length of a pool sizing window
+#define POOL_SHRINK_WINDOWS 3        // oversized windows before shrinking
+#define POOL_DEMAND_PERCENTILE 99.0  // of the busy routines in a window
 
-#ifdef BOOST_COROUTINES_SYMMETRIC_COROUTINE_H
-// only Droutine.cpp needs the complete type information
-typedef boost::coroutines::symmetric_coroutine<void>::call_type call_type;
-typedef boost::coroutines::symmetric_coroutine<void>::yield_type yield_type;
-#else
-struct call_type;
-struct yield_type;
-#endif
+// wait lists of yield_block(map_id, key, block_id), at most one per routine
+#define WAIT_INDEX_SIZE (2 * MAX_COROUTINE_CNT)  // power of two
 
 enum operationID { RT_LOOP, RT_BLOCKED };
 
 enum RTYPE { PKT_ROUTINE, BG_ROUTINE };
 
-enum BLOCK_ID { SW_RW_BLOCK = -3, SW_RO_BLOCK = -2, SW_OBJ_BLOCK = -1 };
+enum BLOCK_ID {
+  SW_RO_OBJ_BLOCK = -4,  // copy of an object for a read-only replica
+  SW_RW_BLOCK = -3,
+  SW_RO_BLOCK = -2,
+  SW_OBJ_BLOCK = -1
+};
+
+// runnable routines, by what made them runnable
+enum SCHED_CLASS { SC_WAKE, SC_PKT, SC_BG, SC_MAX };
+
+// packets, by what their routine blocked on (more than one cause: PL_MIXED)
+enum PKT_LAT_CLASS {
+  PL_LOCAL,   // never blocked
+  PL_SW,      // SW object or ownership (SW_*_BLOCK)
+  PL_STRICT,  // reply of a strict RPC
+  PL_STALE,   // stale RPC cache miss
+  PL_MIXED,
+  PL_MAX
+};
+
+/*
+ * Scheduling policy of DroutineScheduler
+ *
+ * Each call_scheduler() round runs routines woken up from yield_block(),
+ * dispatches idle routines on new packets, and runs the requested background
+ * routines. Woken routines often hold the ownership of objects that
+ * remote workers wait for, so they run ahead of new packets by default.
+ *
+ * Set with "key=value,..." (see parse_sched_policy()), e.g., "wake=64,pkt=2".
+ */
+struct SchedPolicy {
+  int wake_weight = 0;  // woken routines per round, 0 for all of them
+  int pkt_weight = 1;   // idle routines dispatched on new packets per round
+  int slice_pkts = 96;  // packets a routine processes before yielding
+  int idle_loops = 4;   // loops without a new packet before yielding
+  bool wake_first = true;
+};
+
+int parse_sched_policy(const char *spec, SchedPolicy *policy);
 
 struct Droutine;
+class CoStackPool;
 
 class DroutineScheduler {
  private:
-  int pkt_coroutine_cnt = 0;
-  Droutine *pkt_routine_pool;
-  Droutine *bg_routine;  // XXX support single background routine
+  int pkt_coroutine_cnt = 0;             // maximum
+  std::vector<Droutine *> pkt_routines;  // created so far
+  std::vector<int> free_routine_idx;     // of the destroyed ones
+  CoStackPool *stack_pool;
 
   packet_func pkt_callback;
-  std::function<void(yield_type &yield)> pkt_calltype;
-  background_func bg_callback;
-  std::function<void(yield_type &yield)> bg_calltype;
+  key_extract_func key_extractor = nullptr;  // run on each rx burst
+
+  // one coroutine per background function, indexed by fid
+  struct BgRoutine {
+    background_func cb;
+    Droutine *routine;
+    bool is_new;      // requested, to be scheduled
+    bool is_running;  // until cb returns
+    uint64_t ready_tsc;
+  };
+  BgRoutine bg_routines[MAX_BGFUNC_CNT];
+  int bg_routine_cnt = 0;
 
   std::stack<Droutine *> idle_stack;  // idle_routine which does nothing
-  std::queue<Droutine *> wait_queue;  // waiting to wakeup list
 
-  std::unordered_map<VKey, std::queue<Droutine *>, _dr_vkey_hash,
-                     _dr_vkey_equal_to>
-      block_map_arr[_MAX_DMAPS];
-  std::bitset<_MAX_DMAPS> wait_unblocked;
-  std::unordered_map<int, Droutine *> block_routine_map;
+  // woken routines to be scheduled, linked through Droutine::next_waiter
+  Droutine *wake_head = nullptr;
+  Droutine *wake_tail = nullptr;
+
+  /*
+   * Open-addressing index of the wait lists, linked through the blocked
+   * routines themselves. A slot holds the first waiter (which has the
+   * map_id, key and block_id of the list) and the hash; it is erased by
+   * backward shifting, so there are no tombstones. Sized for every routine
+   * to block on a distinct key, so it never grows.
+   */
+  struct WaitSlot {
+    Droutine *head;  // nullptr: empty
+    std::size_t hash;
+  };
+  std::vector<WaitSlot> wait_slots;
+  int wait_list_cnt = 0;
+
+  // routines blocked in yield_block(d_idx), indexed by d_idx
+  std::vector<Droutine *> idx_blocked;
+  int idx_blocked_cnt = 0;
 
   bool is_new_pkt_routine;
-  bool is_new_bg_routine;
-  bool is_bg_routine_running;
 
   Droutine *cur_routine;
 
+  SchedPolicy policy;
+
+  // cycles from being runnable to running (queueing in rx ring excluded)
+  struct {
+    uint64_t cnt;
+    uint64_t tot_tsc;
+    uint64_t max_tsc;
+  } class_lat[SC_MAX];
+
+  // cycles from recv_pkts() to forward/drop, by PKT_LAT_CLASS
+  LatencyHist pkt_lat[PL_MAX];
+
   int max_pkts_proc;  // the number of packets to be processed
   struct {
     int tot_pkts_recv;     // the number of packets received
@@ -70,40 +146,114 @@ class DroutineScheduler {
     int tot_pkts_discard;  // the number of packets freed during teardown
     int cur_pkts_buff;     // the number of packets in buffer
     int max_pkts_buff;     // the number of packets in buffer
+    int tot_tx_bursts;     // the number of tx_burst calls
+    int tot_tx_retry;      // the number of tx_burst calls with partial send
+    int tot_tx_drop;       // the number of packets dropped due to full ring
+    int tot_flows_reject;  // the number of new flows not admitted
   } stats;
 
+  bool admit_new_flows = true;  // off under memory pressure
+
   bool is_dpdk = false;
+  uint16_t qid = 0;  // dpdk rx/tx queue owned by this scheduler
+
+  // forwarded packets are sent in bursts, not one by one
+  struct rte_mbuf *tx_buf[BATCH_SIZE];
+  int tx_cnt = 0;
+
+  struct {
+    uint64_t start_tsc;
+    uint64_t last_call_tsc;
+    uint64_t max_diff_tsc;
+    bool print_empty_pool;
+  } recv_stats;
 
   std::queue<struct rte_mbuf *> pkt_queue;
 
   size_t thread_count[MAX_COROUTINE_CNT + 1] = {0};
 
+  // busy routines at each dispatch, since the last adapt_pkt_routines()
+  size_t window_count[MAX_COROUTINE_CNT + 1] = {0};
+  uint64_t adapt_interval_tsc;
+  struct {
+    uint64_t last_adapt_tsc;
+    int oversized_windows;  // in a row
+    int shrink_target;      // the largest target of those windows
+    int tot_grow;
+    int tot_shrink;
+    int max_routines;
+  } pool_stats;
+
+  WaitSlot *find_wait_slot(int map_id, const Key *key, int block_id,
+                           std::size_t hash);
+  void erase_wait_slot(WaitSlot *slot);
+  void push_wake(Droutine *first, Droutine *last);
+
   int pkt_routine_init();
-  int bg_routine_init();
+  int bg_routine_init(BgRoutine *bg, int fid);
+  int grow_pkt_routines();
+  int shrink_pkt_routines(int target);
+
+  static void run_pkt_routine(void *arg);
+  static void run_bg_routine(void *arg);
+  void pkt_routine_loop();
 
   void schedule(Droutine *routine, operationID opr);
+  int run_woken_routines();
+  void dispatch_pkt_routine();
+  void record_pkt_latency(struct rte_mbuf *pkt, uint8_t block_causes);
+  void record_latency(SCHED_CLASS sc, uint64_t tsc) {
+    class_lat[sc].cnt++;
+    class_lat[sc].tot_tsc += tsc;
+    if (class_lat[sc].max_tsc < tsc)
+      class_lat[sc].max_tsc = tsc;
+  }
   void yield_idle();
 
   struct rte_mbuf *get_next_packet();
   void drop_packet(struct rte_mbuf *);
   void forward_packet(struct rte_mbuf *);
+  void flush_tx_buf();
 
  public:
-  DroutineScheduler(int node_id, bool is_dpdk, char *log_dir = nullptr);
+  DroutineScheduler(int node_id, bool is_dpdk, char *log_dir = nullptr,
+                    uint16_t qid = 0);
   ~DroutineScheduler();
 
   void teardown();
   int set_packet_routine(packet_func cb, int coroutine_cnt);
-  int set_background_routine(background_func cb);
-  int run_background_routine();
+  void set_key_extractor(key_extract_func kef) { this->key_extractor = kef; }
+  int set_background_routine(background_func cb);  // returns the fid
+  int run_background_routine(int fid = 0);
+  int get_background_routine_cnt() const { return bg_routine_cnt; }
   int get_cur_routine_idx();
+  int get_pkt_routine_cnt() const { return pkt_routines.size(); }
+  int adapt_pkt_routines();
 
   void set_max_new_packets(int p_cnt) { this->max_pkts_proc = p_cnt; }
+  void set_policy(const SchedPolicy &policy) { this->policy = policy; }
+
+  // admission control of new flows (state), e.g., off under memory pressure
+  void set_admission(bool admit) { this->admit_new_flows = admit; }
+  bool is_admitting() const { return admit_new_flows; }
+  bool admit_new_flow() {
+    if (admit_new_flows)
+      return true;
+    stats.tot_flows_reject++;
+    return false;
+  }
+  const SchedPolicy &get_policy() const { return policy; }
 
   int recv_pkts();
   bool call_scheduler();
+  // nothing to run in the next round until a packet or a message arrives
+  bool is_idle() const { return !wake_head && pkt_queue.empty(); }
   void tear_down();
 
+  const LatencyHist &get_pkt_latency(int pl) const { return pkt_lat[pl]; }
+  void reset_pkt_latency();
+  static const char *pkt_latency_name(int pl);
+
   void reset_micro_threads_stat();
   void print_micro_threads_stat();
   void print_stat(int node_id);
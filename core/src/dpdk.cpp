@@ -16,25 +16,57 @@
 #define RX_RING_SIZE 128
 #define TX_RING_SIZE 512
 
-static const struct rte_eth_conf port_conf_default() {
+static uint16_t nb_dpdk_queues = 1;
+
+static const struct rte_eth_conf port_conf_default(uint16_t nb_queues,
+                                                   uint64_t rss_hf) {
   struct rte_eth_conf ret = rte_eth_conf();
   ret.rxmode.max_rx_pkt_len = ETHER_MAX_LEN;
+
+  /* Spread flows over the RX queues; each queue is polled by one worker */
+  if (nb_queues > 1) {
+    ret.rxmode.mq_mode = ETH_MQ_RX_RSS;
+    ret.rx_adv_conf.rss_conf.rss_key = NULL;
+    ret.rx_adv_conf.rss_conf.rss_hf = rss_hf;
+  }
   return ret;
 }
 
-static inline int init_port(uint8_t port, struct rte_mempool *mbuf_pool) {
-  struct rte_eth_conf port_conf = port_conf_default();
-  const uint16_t rx_rings = 1;
-  const uint16_t tx_rings = 1;
+/* *nb_queues is lowered to 1 if the port cannot spread flows over queues */
+static inline int init_port(uint8_t port, struct rte_mempool *mbuf_pool,
+                            uint16_t *nb_queues) {
   int retval;
   uint16_t q;
 
+  struct rte_eth_dev_info dev_info;
+  rte_eth_dev_info_get(port, &dev_info);
+
+  /* Only the hash types the NIC supports, or configure fails */
+  uint64_t rss_hf = (ETH_RSS_IP | ETH_RSS_UDP | ETH_RSS_TCP) &
+                    dev_info.flow_type_rss_offloads;
+  if (*nb_queues > 1 && rss_hf == 0) {
+    DEBUG_WARN("Port " << (unsigned)port
+                       << " has no IP/UDP/TCP RSS, use a single queue");
+    *nb_queues = 1;
+  }
+
+  struct rte_eth_conf port_conf = port_conf_default(*nb_queues, rss_hf);
+  const uint16_t rx_rings = *nb_queues;
+  const uint16_t tx_rings = *nb_queues;
+
+  if (rx_rings > dev_info.max_rx_queues || tx_rings > dev_info.max_tx_queues) {
+    DEBUG_ERR("Port " << (unsigned)port << " supports at most "
+                      << dev_info.max_rx_queues << " rx and "
+                      << dev_info.max_tx_queues << " tx queues");
+    return -EINVAL;
+  }
+
   /* Configrue the Ethernet device. */
   retval = rte_eth_dev_configure(port, rx_rings, tx_rings, &port_conf);
   if (retval != 0)
     return retval;
 
-  /* Allocate and set up 1 TX queue per Ethernet port. */
+  /* Allocate and set up TX queues, one per worker. */
   for (q = 0; q < tx_rings; q++) {
     retval = rte_eth_tx_queue_setup(port, q, TX_RING_SIZE,
                                     rte_eth_dev_socket_id(port), NULL);
@@ -42,7 +74,7 @@ static inline int init_port(uint8_t port, struct rte_mempool *mbuf_pool) {
       return retval;
   }
 
-  /* Allocate and set up 1 RX queue per Ethernet port. */
+  /* Allocate and set up RX queues, one per worker. */
   for (q = 0; q < rx_rings; q++) {
     retval = rte_eth_rx_queue_setup(
         port, q, RX_RING_SIZE, rte_eth_dev_socket_id(port), NULL, mbuf_pool);
@@ -83,7 +115,7 @@ static struct rte_mempool *init_mempool(unsigned mbuf_count) {
 }
 
 // void init_dpdk(const std::string &prog_name) {
-void init_dpdk(int rte_argc, const char **rte_argv) {
+void init_dpdk(int rte_argc, const char **rte_argv, uint16_t nb_queues) {
   unsigned nb_ports;
   uint8_t portid;
   struct rte_mempool *mbuf_pool;
@@ -100,27 +132,47 @@ void init_dpdk(int rte_argc, const char **rte_argv) {
   if (nb_ports < 1)
     rte_exit(EXIT_FAILURE, "Error: There are no available port");
 
-  mbuf_pool = init_mempool(NUM_MBUFS * nb_ports);
+  assert(nb_queues > 0);
+  nb_dpdk_queues = nb_queues;
+
+  mbuf_pool = init_mempool(NUM_MBUFS * nb_ports * nb_queues);
 
-  for (portid = 0; portid < nb_ports; portid++)
-    if (init_port(portid, mbuf_pool) != 0)
+  for (portid = 0; portid < nb_ports; portid++) {
+    uint16_t port_queues = nb_queues;
+    if (init_port(portid, mbuf_pool, &port_queues) != 0)
       rte_exit(EXIT_FAILURE, "Cannot init port %" PRIu8 "\n", portid);
+    if (port_queues < nb_dpdk_queues)
+      nb_dpdk_queues = port_queues;
+  }
+}
+
+uint16_t dpdk_num_queues() {
+  return nb_dpdk_queues;
 }
 
-uint16_t dpdk_send_pkt(struct rte_mbuf *bufs) {
-  int pid = 0, qid = 0; /*FIXME: Need to be fixed */
+uint16_t dpdk_send_pkt(uint16_t qid, struct rte_mbuf *bufs) {
+  int pid = 0; /*FIXME: single port only */
+  if (qid >= nb_dpdk_queues)
+    return 0;
   const uint16_t tx = rte_eth_tx_burst(pid, qid, &bufs, 1);
   return tx;
 }
 
-uint16_t dpdk_send_pkts(struct rte_mbuf **bufs, const uint16_t buf_size) {
-  int pid = 0, qid = 0; /*FIXME: Need to be fixed */
+uint16_t dpdk_send_pkts(uint16_t qid, struct rte_mbuf **bufs,
+                        const uint16_t buf_size) {
+  int pid = 0; /*FIXME: single port only */
+  if (qid >= nb_dpdk_queues)
+    return 0;
   const uint16_t tx = rte_eth_tx_burst(pid, qid, bufs, buf_size);
   return tx;
 }
 
-uint16_t dpdk_receive_pkts(struct rte_mbuf **bufs, const uint16_t batch_size) {
-  int pid = 0, qid = 0; /*FIXME: Need to be fixed */
+uint16_t dpdk_receive_pkts(uint16_t qid, struct rte_mbuf **bufs,
+                           const uint16_t batch_size) {
+  int pid = 0; /*FIXME: single port only */
+  /* Without RSS the workers beyond queue 0 get no packets */
+  if (qid >= nb_dpdk_queues)
+    return 0;
   const uint16_t rx = rte_eth_rx_burst(pid, qid, bufs, batch_size);
   return rx;
 }
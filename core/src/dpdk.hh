@@ -1,13 +1,24 @@
 #ifndef _DISTREF_DPDK_HH_
 #define _DISTREF_DPDK_HH_
 
+#include <cstdint>
 #include <string>
 
 #define MAX_RTE_ARGV 16
 
-void init_dpdk(const int rte_argc, const char **rte_argv);
-uint16_t dpdk_send_pkt(struct rte_mbuf *bufs);
-uint16_t dpdk_send_pkts(struct rte_mbuf **bufs, const uint16_t buf_size);
-uint16_t dpdk_receive_pkts(struct rte_mbuf **bufs, const uint16_t batch_size);
+#define MAX_DPDK_QUEUES 16
+
+/* nb_queues RX/TX queue pairs per port; RSS is enabled when nb_queues > 1.
+ * Falls back to a single queue on ports without RSS (see dpdk_num_queues) */
+void init_dpdk(const int rte_argc, const char **rte_argv,
+               uint16_t nb_queues = 1);
+uint16_t dpdk_num_queues();
+
+/* qid selects the RX/TX queue pair owned by the calling worker */
+uint16_t dpdk_send_pkt(uint16_t qid, struct rte_mbuf *bufs);
+uint16_t dpdk_send_pkts(uint16_t qid, struct rte_mbuf **bufs,
+                        const uint16_t buf_size);
+uint16_t dpdk_receive_pkts(uint16_t qid, struct rte_mbuf **bufs,
+                           const uint16_t batch_size);
 
 #endif /* _DISTREF_DPDK_HH_ */
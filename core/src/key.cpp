@@ -7,6 +7,7 @@ LBPolicy *SticKey::policy = 0;
 
 KeyTypeID num_key_class = 0;
 key_unserializer __global_key_unserializer[MAX_KEYS] = {0};
+KeyOps __global_key_ops[_MAX_DMAPS] = {};
 std::unordered_map<std::string, int8_t> __global_keymap
     __attribute__((init_priority(150)));
 
@@ -29,3 +30,15 @@ KeyTypeID __get_keytypeid(const char *name) {
 
   return iter->second;
 }
+
+void __register_key_ops(int map_id, KeyOps ops) {
+  assert(map_id < _MAX_DMAPS);
+  __global_key_ops[map_id] = ops;
+}
+
+KeyOps __get_key_ops(int map_id) {
+  if (map_id >= _MAX_DMAPS || __global_key_ops[map_id].hash == nullptr)
+    return KEY_OPS_GENERIC;
+
+  return __global_key_ops[map_id];
+}
@@ -51,6 +51,9 @@ class Key {
 
   std::size_t get_hash() const { return _hash(); };
 
+  // keys of the same placement hash are placed together (see SticKey)
+  virtual std::size_t _placement_hash() const { return _hash(); }
+
   bool operator<(const Key& other) const { return _lessthan(other); };
 
   bool operator==(const Key& other) const { return _equalto(other); };
@@ -63,6 +66,57 @@ class Key {
 void __register_key(const char*, key_unserializer);
 KeyTypeID __get_keytypeid(const char*);
 
+/* Hash and equality of the keys of one map
+ *
+ * The runtime maps are type-erased (Key*), so by default they go through the
+ * virtual interface, where _equalto() of most keys is a dynamic_cast. Maps
+ * instantiated by codegen with KEY_OPS(K) compare keys with K::equal_to()
+ * and K::_hash() directly instead; the virtual interface remains for the
+ * wire (serialize/unserialize). */
+typedef std::size_t (*key_hash_fn)(const Key*);
+typedef bool (*key_equal_fn)(const Key*, const Key*);
+
+struct KeyOps {
+  key_hash_fn hash;
+  key_equal_fn equal;
+  key_hash_fn placement;  // see KeySpace::get_placement_hash()
+};
+
+inline std::size_t __generic_key_hash(const Key* k) { return k->get_hash(); }
+
+inline std::size_t __generic_key_placement(const Key* k) {
+  return k->_placement_hash();
+}
+
+inline bool __generic_key_equal(const Key* k1, const Key* k2) {
+  return *k1 == *k2;
+}
+
+// every key of the map must be a K, which has a non-virtual equal_to(const K&)
+template <class K>
+struct TypedKeyOps {
+  static std::size_t hash(const Key* k) {
+    return static_cast<const K*>(k)->K::_hash();
+  }
+
+  static bool equal(const Key* k1, const Key* k2) {
+    return static_cast<const K*>(k1)->equal_to(*static_cast<const K*>(k2));
+  }
+
+  static std::size_t placement(const Key* k) {
+    return static_cast<const K*>(k)->K::_placement_hash();
+  }
+};
+
+#define KEY_OPS_GENERIC \
+  (KeyOps{__generic_key_hash, __generic_key_equal, __generic_key_placement})
+#define KEY_OPS(K)                                     \
+  (KeyOps{TypedKeyOps<K>::hash, TypedKeyOps<K>::equal, \
+          TypedKeyOps<K>::placement})
+
+void __register_key_ops(int map_id, KeyOps ops);
+KeyOps __get_key_ops(int map_id);
+
 #define REGISTER_KEY(name, unserializer)                                  \
   void __keyinitfn_##name(void);                                          \
   void __attribute__((constructor(200), used)) __keyinitfn_##name(void) { \
@@ -82,6 +136,8 @@ class SticKey : public Key {
  public:
   static void set_LBPolicy(LBPolicy* _policy) { policy = _policy; }
   virtual uint32_t get_locality_hash() const = 0;
+
+  std::size_t _placement_hash() const { return get_locality_hash(); }
 };
 
 namespace std {
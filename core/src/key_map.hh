@@ -0,0 +1,210 @@
+#ifndef _DISTREF_KEY_MAP_HH_
+#define _DISTREF_KEY_MAP_HH_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "key.hh"
+
+#define KEY_MAP_MIN_CAPACITY 16
+#define KEY_MAP_TOMBSTONE (reinterpret_cast<const Key *>(uintptr_t(1)))
+
+/*
+ * Open-addressing hash map from Key* to V for the per-map lookup tables of
+ * the object/stub managers (a drop-in for the std::unordered_map subset they
+ * use).
+ *
+ * Entries live in one array with the key hash computed once at insertion, so
+ * a probe walks contiguous slots and compares keys only when the full hash
+ * matches. Keys are hashed and compared with the KeyOps of the map (see
+ * __get_key_ops()), which avoid the virtual Key interface if the map has
+ * typed ones. Linear probing with
+ * tombstones; erase() never moves other entries, so iterators stay valid
+ * across erase() (not across insertion, which may rehash).
+ *
+ * NOTE:
+ * - Like the maps it replaces, it does not own the keys: callers clone keys
+ *   on insertion and delete them after erase(). Keys are never moved, as
+ *   references keep pointers to them.
+ */
+template <typename V>
+class KeyMap {
+ public:
+  struct Slot {
+    const Key *first;  // nullptr: empty, KEY_MAP_TOMBSTONE: erased
+    V second;
+    std::size_t hash;
+  };
+
+  class iterator {
+   private:
+    Slot *cur;
+    Slot *last;
+
+    void skip() {
+      while (cur != last &&
+             (cur->first == nullptr || cur->first == KEY_MAP_TOMBSTONE))
+        cur++;
+    }
+
+   public:
+    iterator() : cur(nullptr), last(nullptr) {}
+    iterator(Slot *cur, Slot *last) : cur(cur), last(last) { skip(); }
+
+    Slot &operator*() const { return *cur; }
+    Slot *operator->() const { return cur; }
+
+    iterator &operator++() {
+      cur++;
+      skip();
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator ret = *this;
+      ++(*this);
+      return ret;
+    }
+
+    bool operator==(const iterator &other) const { return cur == other.cur; }
+    bool operator!=(const iterator &other) const { return cur != other.cur; }
+
+    friend class KeyMap;
+  };
+
+ private:
+  KeyOps ops = KEY_OPS_GENERIC;
+  std::vector<Slot> slots;
+  std::size_t mask = 0;   // capacity - 1
+  std::size_t shift = 0;  // 64 - log2(capacity)
+  std::size_t cnt = 0;    // live entries
+  std::size_t used = 0;   // live entries and tombstones
+
+  // Key::_hash() of many keys is weak (e.g., a sum of fields)
+  std::size_t index_of(std::size_t hash) const {
+    return (hash * 0x9e3779b97f4a7c15ULL) >> shift;
+  }
+
+  Slot *lookup(const Key *key, std::size_t hash) {
+    if (slots.empty())
+      return nullptr;
+
+    for (std::size_t i = index_of(hash);; i = (i + 1) & mask) {
+      Slot *s = &slots[i];
+      if (s->first == nullptr)
+        return nullptr;
+      if (s->first != KEY_MAP_TOMBSTONE && s->hash == hash &&
+          ops.equal(s->first, key))
+        return s;
+    }
+  }
+
+  void rehash(std::size_t capacity) {
+    std::vector<Slot> old;
+    old.swap(slots);
+
+    slots.assign(capacity, Slot{nullptr, V(), 0});
+    mask = capacity - 1;
+    shift = 64;
+    for (std::size_t c = capacity; c > 1; c >>= 1)
+      shift--;
+    used = cnt;
+
+    for (auto &s : old) {
+      if (s.first == nullptr || s.first == KEY_MAP_TOMBSTONE)
+        continue;
+
+      std::size_t i = index_of(s.hash);
+      while (slots[i].first != nullptr)
+        i = (i + 1) & mask;
+      slots[i] = s;
+    }
+  }
+
+  // keeps (live + tombstones) <= 3/4 of the capacity
+  void reserve_slot() {
+    std::size_t capacity = slots.size();
+    if ((used + 1) * 4 <= capacity * 3)
+      return;
+
+    std::size_t new_capacity = KEY_MAP_MIN_CAPACITY;
+    while ((cnt + 1) * 2 > new_capacity)
+      new_capacity <<= 1;
+
+    // only tombstones to drop if the size does not grow
+    rehash(std::max(new_capacity, capacity));
+  }
+
+ public:
+  KeyMap() {}
+  explicit KeyMap(KeyOps ops) : ops(ops) {}
+  KeyMap(const KeyMap &) = delete;
+  KeyMap &operator=(const KeyMap &) = delete;
+
+  iterator begin() {
+    return iterator(slots.data(), slots.data() + slots.size());
+  }
+  iterator end() {
+    return iterator(slots.data() + slots.size(), slots.data() + slots.size());
+  }
+
+  // entries are kept, as typed ops hash the same as the generic ones
+  void set_key_ops(KeyOps key_ops) { ops = key_ops; }
+
+  std::size_t size() const { return cnt; }
+  bool empty() const { return cnt == 0; }
+
+  void reserve(std::size_t n) {
+    std::size_t capacity = KEY_MAP_MIN_CAPACITY;
+    while (n * 4 > capacity * 3)
+      capacity <<= 1;
+    if (capacity > slots.size())
+      rehash(capacity);
+  }
+
+  iterator find(const Key *key) {
+    Slot *s = lookup(key, ops.hash(key));
+    if (!s)
+      return end();
+    return iterator(s, slots.data() + slots.size());
+  }
+
+  // inserts key (not a copy of it) if there is no equal key yet
+  V &operator[](const Key *key) {
+    std::size_t hash = ops.hash(key);
+    Slot *s = lookup(key, hash);
+    if (s)
+      return s->second;
+
+    reserve_slot();
+
+    std::size_t i = index_of(hash);
+    while (slots[i].first != nullptr && slots[i].first != KEY_MAP_TOMBSTONE)
+      i = (i + 1) & mask;
+
+    if (slots[i].first == nullptr)
+      used++;
+    cnt++;
+
+    slots[i].first = key;
+    slots[i].second = V();
+    slots[i].hash = hash;
+    return slots[i].second;
+  }
+
+  // returns the iterator to the next entry
+  iterator erase(iterator it) {
+    it.cur->first = KEY_MAP_TOMBSTONE;
+    it.cur->second = V();
+    cnt--;
+    return ++it;
+  }
+
+  void clear() {
+    slots.clear();
+    mask = shift = cnt = used = 0;
+  }
+};
+
+#endif /* _DISTREF_KEY_MAP_HH_ */
@@ -2,10 +2,16 @@
 #define __DISTREF_KEY_SPACE_HH_
 
 #include "key.hh"
+#include "key_map.hh"
 #include "type.hh"
+#include <algorithm>
 #include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #define MAX_VERSION 10
+#define CHASH_VNODES 128  // points per worker on the consistent hashing ring
 
 // XXX: should be updated with enum LocType 's6ctl/controller.py'
 enum LocalityType {
@@ -15,6 +21,7 @@ enum LocalityType {
   _LC_HASHING,
   _LC_CHASHING,
   _LC_BALANCED,
+  _LC_LOADAWARE, /* _LC_BALANCED with the overrides of the version */
 };
 
 struct Rule {
@@ -31,16 +38,93 @@ class KeySpace {
         _LC_BALANCED */
   Rule rules[MAX_VERSION][_MAX_DMAPS];
 
+  // _LC_CHASHING: (point, worker) sorted by point, built from node_cnt.
+  // Adding (removing) the last worker moves only ~1/node_cnt of the keys.
+  std::vector<std::pair<uint32_t, WorkerID>> ring[MAX_VERSION];
+
+  // _LC_LOADAWARE: placement hash -> worker, set by the controller to move
+  // hot keys off overloaded workers without changing the base hash
+  std::unordered_map<std::size_t, WorkerID> overrides[MAX_VERSION];
+
+  // per-key managers over the rules, for keys whose management moved to the
+  // worker that uses them (see SWObjectManager::move_home()). Known only by
+  // the two workers; the manager by the rule forwards requests to the home.
+  KeyMap<WorkerID> homes[MAX_VERSION][_MAX_DMAPS];
+
+  static uint64_t mix_hash(uint64_t x) {
+    // splitmix64 finalizer; key hashes are often weak in the lower bits
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+
+  void build_ring(int v) {
+    ring[v].clear();
+    ring[v].reserve(node_cnt[v] * CHASH_VNODES);
+
+    for (WorkerID w = 0; w < node_cnt[v]; w++) {
+      for (uint64_t i = 0; i < CHASH_VNODES; i++) {
+        uint32_t point = mix_hash(((uint64_t)w << 32) | i) >> 32;
+        ring[v].push_back(std::make_pair(point, w));
+      }
+    }
+
+    // ties are broken by worker id, so that every worker builds the same ring
+    std::sort(ring[v].begin(), ring[v].end());
+  }
+
+  WorkerID lookup_ring(int v, const Key *key) {
+    assert(!ring[v].empty());
+
+    uint32_t point = mix_hash(key->get_hash()) >> 32;
+    auto iter = std::lower_bound(
+        ring[v].begin(), ring[v].end(), point,
+        [](const std::pair<uint32_t, WorkerID> &e, uint32_t p) {
+          return e.first < p;
+        });
+    if (iter == ring[v].end())
+      iter = ring[v].begin();
+    return iter->second;
+  }
+
+  // the maps are registered before any worker (and its key space) starts
+  void init_homes() {
+    for (int v = 0; v < MAX_VERSION; v++) {
+      for (int i = 0; i < _MAX_DMAPS; i++)
+        homes[v][i].set_key_ops(__get_key_ops(i));
+    }
+  }
+
+  // a home stays while the manager by the rule of the key is the same and
+  // the worker is still there; otherwise the key goes by the rule again
+  void carry_homes(int v, int next_v) {
+    for (int i = 0; i < _MAX_DMAPS; i++) {
+      for (auto &entry : homes[v][i]) {
+        if (entry.second >= node_cnt[next_v] ||
+            get_rule_manager_of(v, i, entry.first) !=
+                get_rule_manager_of(next_v, i, entry.first))
+          continue;
+
+        homes[next_v][i][entry.first->clone()] = entry.second;
+      }
+    }
+  }
+
  public:
   KeySpace() {
     version = -1;
     for (int i = 0; i < MAX_VERSION; i++)
       active[i] = false;
+    init_homes();
   }
 
   KeySpace(LocalityType loc_type, int param) {
     for (int i = 0; i < MAX_VERSION; i++)
       active[i] = false;
+    init_homes();
 
     version = 0;
     active[version] = true;
@@ -51,6 +135,11 @@ class KeySpace {
     }
   }
 
+  ~KeySpace() {
+    for (int i = 0; i < MAX_VERSION; i++)
+      clear_homes(i);
+  }
+
   int get_version() { return version; }
 
   int get_prev_version() { return (version + MAX_VERSION - 1) % MAX_VERSION; }
@@ -69,6 +158,8 @@ class KeySpace {
       rules[next_version][i].loc_type = _LC_NONE;
       rules[next_version][i].param = 0;
     }
+    overrides[next_version].clear();
+    clear_homes(next_version);
     return next_version;
   }
 
@@ -77,13 +168,73 @@ class KeySpace {
     if (active[next_version] != true) {
       return -1;
     }
+    if (version >= 0)
+      carry_homes(version, next_version);
     version = next_version;
     return version;
   }
 
-  void discard_version(int version) { active[version] = false; }
+  void discard_version(int version) {
+    active[version] = false;
+    clear_homes(version);
+  }
+
+  void set_node_cnt(int v, int node_cnt) {
+    this->node_cnt[v] = node_cnt;
+    build_ring(v);
+  }
+
+  void set_override(int v, std::size_t placement_hash, WorkerID wid) {
+    overrides[v][placement_hash] = wid;
+  }
 
-  void set_node_cnt(int v, int node_cnt) { this->node_cnt[v] = node_cnt; }
+  // of the current version; the manager by the rule clears it
+  void set_home(int map_id, const Key *key, WorkerID wid) {
+    auto &home = homes[version][map_id];
+    auto iter = home.find(key);
+
+    if (wid == get_rule_manager_of(version, map_id, key)) {
+      if (iter != home.end()) {
+        const Key *hkey = iter->first;
+        home.erase(iter);
+        delete hkey;
+      }
+      return;
+    }
+
+    if (iter != home.end())
+      iter->second = wid;
+    else
+      home[key->clone()] = wid;
+  }
+
+  // -1 if the key is where the rule places it
+  WorkerID get_home_of(int v, int map_id, const Key *key) {
+    auto &home = homes[v][map_id];
+    if (home.empty())
+      return -1;
+
+    auto iter = home.find(key);
+    return iter != home.end() ? iter->second : -1;
+  }
+
+  WorkerID get_home_of(int map_id, const Key *key) {
+    return get_home_of(version, map_id, key);
+  }
+
+  void clear_homes(int v) {
+    for (int i = 0; i < _MAX_DMAPS; i++) {
+      for (auto &entry : homes[v][i])
+        delete entry.first;
+      homes[v][i].clear();
+    }
+  }
+
+  // keys of the same hash are placed together by _LC_BALANCED/_LC_LOADAWARE;
+  // the locality hash of a SticKey, without a cast through the KeyOps
+  static std::size_t get_placement_hash(int map_id, const Key *key) {
+    return __get_key_ops(map_id).placement(key);
+  }
 
   void set_rule(int v, LocalityType loc_type, int param) {
     if (v == -1 || !active[v]) {
@@ -125,6 +276,20 @@ class KeySpace {
   }
 
   WorkerID get_manager_of(int version, int map_id, const Key *key) {
+    WorkerID home = -1;
+    if (version >= 0 && map_id < _MAX_DMAPS)
+      home = get_home_of(version, map_id, key);
+    if (home >= 0)
+      return home;
+
+    return get_rule_manager_of(version, map_id, key);
+  }
+
+  WorkerID get_rule_manager_of(int map_id, const Key *key) {
+    return get_rule_manager_of(version, map_id, key);
+  }
+
+  WorkerID get_rule_manager_of(int version, int map_id, const Key *key) {
     if (version == -1 || !active[version]) {
       DEBUG_ERR("No active version " << version << " cur_version "
                                      << this->version);
@@ -133,8 +298,6 @@ class KeySpace {
       return -1;
     }
 
-    const SticKey *skey = nullptr;
-
     if (map_id >= _MAX_DMAPS) {
       DEBUG_ERR("No known map id with " << map_id);
       assert(0);
@@ -149,15 +312,19 @@ class KeySpace {
       case _LC_HASHING:
         return key->get_hash() % node_cnt[version];
       case _LC_CHASHING:
-        DEBUG_ERR("No support for consistent hashing yet");
-        assert(0);
-        return key->get_hash() % node_cnt[version];
+        return lookup_ring(version, key);
       case _LC_BALANCED:
-        skey = KEY_CAST(SticKey, *key);
-        if (skey)
-          return skey->get_locality_hash() % node_cnt[version];
-        else
-          return key->get_hash() % node_cnt[version];
+        return get_placement_hash(map_id, key) % node_cnt[version];
+      case _LC_LOADAWARE: {
+        std::size_t hash = get_placement_hash(map_id, key);
+        if (!overrides[version].empty()) {
+          auto iter = overrides[version].find(hash);
+          if (iter != overrides[version].end() &&
+              iter->second < node_cnt[version])
+            return iter->second;
+        }
+        return hash % node_cnt[version];
+      }
       default:
         DEBUG_ERR("No known locality policy for map_id " << map_id << " ");
         assert(0);
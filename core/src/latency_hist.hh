@@ -0,0 +1,100 @@
+#ifndef _DISTREF_LATENCY_HIST_HH_
+#define _DISTREF_LATENCY_HIST_HH_
+
+#include <cstdint>
+#include <cstring>
+
+#define LAT_HIST_SUB_BITS 5   // 32 buckets per power of two, ~3% error
+#define LAT_HIST_MAX_BITS 42  // larger values are counted in the last bucket
+
+/*
+ * HDR-style latency histogram
+ *
+ * Values (e.g., tsc cycles) below 2^LAT_HIST_SUB_BITS have a bucket each;
+ * each larger power of two is split into 2^LAT_HIST_SUB_BITS buckets, so the
+ * relative error is bounded over the whole range with a fixed array. No
+ * allocation, recording is a few instructions.
+ *
+ * NOTE:
+ * - Not thread-safe; one histogram per scheduler (lcore).
+ */
+class LatencyHist {
+ public:
+  static const int SUB_CNT = 1 << LAT_HIST_SUB_BITS;
+  static const int BUCKET_CNT =
+      (LAT_HIST_MAX_BITS - LAT_HIST_SUB_BITS + 1) * SUB_CNT;
+
+ private:
+  uint64_t buckets[BUCKET_CNT];
+  uint64_t cnt;
+  uint64_t max_val;
+
+  static int bucket_of(uint64_t v) {
+    if (v < SUB_CNT)
+      return v;
+
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= LAT_HIST_MAX_BITS)
+      return BUCKET_CNT - 1;
+
+    int shift = msb - LAT_HIST_SUB_BITS;
+    return ((shift + 1) << LAT_HIST_SUB_BITS) + ((v >> shift) & (SUB_CNT - 1));
+  }
+
+  // the largest value counted in bucket i
+  static uint64_t highest_of(int i) {
+    if (i < SUB_CNT)
+      return i;
+
+    int shift = (i >> LAT_HIST_SUB_BITS) - 1;
+    uint64_t lowest = (uint64_t)(SUB_CNT + (i & (SUB_CNT - 1))) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+  }
+
+ public:
+  LatencyHist() { reset(); }
+
+  void reset() {
+    memset(buckets, 0, sizeof(buckets));
+    cnt = 0;
+    max_val = 0;
+  }
+
+  void record(uint64_t v) {
+    buckets[bucket_of(v)]++;
+    cnt++;
+    if (max_val < v)
+      max_val = v;
+  }
+
+  void merge(const LatencyHist &other) {
+    for (int i = 0; i < BUCKET_CNT; i++)
+      buckets[i] += other.buckets[i];
+    cnt += other.cnt;
+    if (max_val < other.max_val)
+      max_val = other.max_val;
+  }
+
+  uint64_t count() const { return cnt; }
+  uint64_t max() const { return max_val; }
+
+  // value at or below which pct % of the records are, 0 if none
+  uint64_t percentile(double pct) const {
+    if (cnt == 0)
+      return 0;
+
+    uint64_t rank = cnt * pct / 100;
+    if (rank == 0)
+      rank = 1;
+
+    uint64_t t_total = 0;
+    for (int i = 0; i < BUCKET_CNT; i++) {
+      t_total += buckets[i];
+      if (t_total >= rank)
+        return highest_of(i) < max_val ? highest_of(i) : max_val;
+    }
+    return max_val;
+  }
+};
+
+#endif /* _DISTREF_LATENCY_HIST_HH_ */
@@ -0,0 +1,372 @@
+#include "mem_pool.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <rte_malloc.h>
+#include <rte_memory.h>
+
+#include "log.hh"
+
+MemPool::MemPool(size_t capacity, bool hugepage, int socket_id)
+    : hugepage(hugepage), socket_id(socket_id) {
+  memset(class_of, 0, sizeof(class_of));
+
+  int ret = (socket_id >= 0) ? reserve_dpdk_range(capacity)
+                             : reserve_range(capacity);
+  if (ret < 0) {
+    DEBUG_INFO("Fallback to use system malloc");
+    use_system_malloc = true;
+    return;
+  }
+
+  // the largest class first, as the fit of every size, then the others
+  // (16, 32, 48, 2^k and 1.5 * 2^k)
+  push_class(MEM_SLAB_MAX_OBJ);
+  add_size_class(16);
+  add_size_class(32);
+  add_size_class(48);
+  for (size_t size = 64; size < MEM_SLAB_MAX_OBJ; size <<= 1) {
+    add_size_class(size);
+    if (size + size / 2 < MEM_SLAB_MAX_OBJ)
+      add_size_class(size + size / 2);
+  }
+
+  if (socket_id >= 0)
+    DEBUG_INFO("Memory pool of " << (capacity >> 20) << " MB on socket "
+                                 << socket_id << " (dpdk)");
+  else
+    DEBUG_INFO("Memory pool of " << (capacity >> 20) << " MB"
+                                 << (hugepage ? " on hugepages" : ""));
+}
+
+MemPool::~MemPool() {
+  if (reserved) {
+    munmap(reserved, reserved_size);
+    return;
+  }
+
+  for (size_t i = 0; i < slab_class.size(); i++) {
+    if (slab_class[i] != MEM_NO_CLASS)
+      rte_free(base + i * MEM_SLAB_SIZE);
+  }
+}
+
+int MemPool::reserve_range(size_t capacity) {
+  size_t slabs = (capacity + MEM_SLAB_SIZE - 1) / MEM_SLAB_SIZE;
+
+  // one extra slab to align the start
+  reserved_size = (slabs + 1) * MEM_SLAB_SIZE;
+  void *p = mmap(nullptr, reserved_size, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    DEBUG_ERR("Fail to reserve object memory: " << strerror(errno));
+    reserved_size = 0;
+    return -1;
+  }
+
+  reserved = static_cast<char *>(p);
+  base = reinterpret_cast<char *>(
+      (reinterpret_cast<uintptr_t>(reserved) + MEM_SLAB_SIZE - 1) &
+      ~(MEM_SLAB_SIZE - 1));
+  max_slabs = slabs;
+  slab_class.assign(slabs, MEM_NO_CLASS);
+  return 0;
+}
+
+// the range is the one of the dpdk memory segments
+int MemPool::reserve_dpdk_range(size_t capacity) {
+  const struct rte_memseg *ms = rte_eal_get_physmem_layout();
+  uintptr_t lo = UINTPTR_MAX;
+  uintptr_t hi = 0;
+
+  for (int i = 0; ms && i < RTE_MAX_MEMSEG && ms[i].addr != nullptr; i++) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ms[i].addr);
+    lo = std::min(lo, addr);
+    hi = std::max(hi, addr + ms[i].len);
+  }
+
+  if (hi == 0) {
+    DEBUG_ERR("No dpdk memory for objects");
+    return -1;
+  }
+
+  base = reinterpret_cast<char *>(lo & ~(MEM_SLAB_SIZE - 1));
+  max_slabs = (capacity + MEM_SLAB_SIZE - 1) / MEM_SLAB_SIZE;
+  slab_class.assign((hi - (uintptr_t)base + MEM_SLAB_SIZE - 1) / MEM_SLAB_SIZE,
+                    MEM_NO_CLASS);
+  return 0;
+}
+
+size_t MemPool::get_memory_size(int socket_id) {
+  if (socket_id < 0)
+    return (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+
+  const struct rte_memseg *ms = rte_eal_get_physmem_layout();
+  size_t size = 0;
+
+  for (int i = 0; ms && i < RTE_MAX_MEMSEG && ms[i].addr != nullptr; i++) {
+    if (ms[i].socket_id == socket_id)
+      size += ms[i].len;
+  }
+  return size;
+}
+
+int MemPool::push_class(size_t size) {
+  size = (size + MEM_ALIGN - 1) & ~(size_t)(MEM_ALIGN - 1);
+  for (size_t c = 0; c < classes.size(); c++) {
+    if (classes[c].size == size)
+      return c;
+  }
+
+  if (classes.size() >= MEM_MAX_CLASSES) {
+    DEBUG_ERR("Too many size classes for " << size);
+    return -1;
+  }
+
+  classes.push_back(SizeClass{size, nullptr, nullptr, nullptr, 0, 0, 0});
+  return classes.size() - 1;
+}
+
+int MemPool::add_size_class(size_t size) {
+  if (use_system_malloc || size == 0 || size > MEM_SLAB_MAX_OBJ)
+    return 0;
+
+  int cidx = push_class(size);
+  if (cidx < 0)
+    return -1;
+
+  // the new class is the smallest fit of the sizes up to its own
+  size_t csize = classes[cidx].size;
+  for (size_t i = 0; i <= csize / MEM_ALIGN; i++) {
+    if (classes[class_of[i]].size > csize)
+      class_of[i] = cidx;
+  }
+  return 0;
+}
+
+char *MemPool::alloc_slab() {
+  if (socket_id >= 0) {
+    void *p = rte_malloc_socket("s6_objects", MEM_SLAB_SIZE, MEM_SLAB_SIZE,
+                                socket_id);
+    if (!p)
+      DEBUG_ERR("Fail to allocate objects from dpdk memory");
+    return static_cast<char *>(p);
+  }
+
+  char *slab = base + slab_cnt * MEM_SLAB_SIZE;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+  void *p = MAP_FAILED;
+
+  // populated here, on the node of this thread
+  if (hugepage) {
+    p = mmap(slab, MEM_SLAB_SIZE, PROT_READ | PROT_WRITE,
+             flags | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (p == MAP_FAILED) {
+      DEBUG_WARN("No hugepages for objects, use normal pages: "
+                 << strerror(errno));
+      hugepage = false;
+    }
+  }
+
+  // pages are backed on first touch, by the worker
+  if (p == MAP_FAILED)
+    p = mmap(slab, MEM_SLAB_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (p == MAP_FAILED) {
+    DEBUG_ERR("Fail to back object memory: " << strerror(errno));
+    return nullptr;
+  }
+
+  if (geteuid() == 0) {
+    if (mlock(slab, MEM_SLAB_SIZE) < 0)
+      DEBUG_WARN("Fail to lock object memory");
+  }
+
+  return slab;
+}
+
+int MemPool::map_slab(int cidx) {
+  if (slab_cnt >= max_slabs)
+    return -1;
+
+  // what we got is the capacity then
+  char *slab = alloc_slab();
+  if (!slab) {
+    max_slabs = slab_cnt;
+    return -1;
+  }
+
+  size_t idx = (slab - base) / MEM_SLAB_SIZE;
+  assert(idx < slab_class.size() && slab_class[idx] == MEM_NO_CLASS);
+  slab_class[idx] = cidx;
+  slab_cnt++;
+
+  SizeClass &c = classes[cidx];
+  c.cur = slab;
+  c.end = slab + MEM_SLAB_SIZE;
+  c.slab_cnt++;
+  return 0;
+}
+
+// out of slabs: a chunk of the class freed by the evictors, if any
+MemPool::FreeChunk *MemPool::reclaim(int cidx) {
+  SizeClass &c = classes[cidx];
+  size_t low = get_capacity() / 100 * MEM_LOW_WATERMARK;
+  size_t used = get_used_bytes();
+
+  evict(std::max(used > low ? used - low : 0, MEM_SLAB_SIZE));
+
+  FreeChunk *p = c.free_list;
+  if (p)
+    c.free_list = p->next;
+  return p;
+}
+
+void *MemPool::heap_malloc(size_t size) {
+  void *m = ::malloc(size);
+  if (m) {
+    heap_cnt++;
+    heap_bytes += malloc_usable_size(m);
+  }
+  return m;
+}
+
+void *MemPool::malloc(size_t size) {
+  if (use_system_malloc)
+    return ::malloc(size);
+
+  if (size > MEM_SLAB_MAX_OBJ)
+    return heap_malloc(size);
+
+  int cidx = class_of[(size + MEM_ALIGN - 1) / MEM_ALIGN];
+  SizeClass &c = classes[cidx];
+  FreeChunk *p = c.free_list;
+
+  if (p) {
+    c.free_list = p->next;
+  } else if ((size_t)(c.end - c.cur) >= c.size || map_slab(cidx) == 0) {
+    p = reinterpret_cast<FreeChunk *>(c.cur);
+    c.cur += c.size;
+  } else if (!(p = reclaim(cidx))) {
+    if (overflow_cnt++ == 0)
+      DEBUG_WARN("Object memory is full, use malloc");
+    return heap_malloc(size);
+  }
+
+  used_bytes += c.size;
+  if (++c.used > c.peak)
+    c.peak = c.used;
+  return p;
+}
+
+void MemPool::free(void *m) {
+  if (!m)
+    return;
+
+  if (use_system_malloc)
+    return ::free(m);
+
+  uint8_t cidx = class_of_chunk(m);
+  if (cidx == MEM_NO_CLASS) {
+    heap_cnt--;
+    heap_bytes -= malloc_usable_size(m);
+    return ::free(m);
+  }
+
+  SizeClass &c = classes[cidx];
+
+  assert(((uintptr_t)m - (uintptr_t)base) % MEM_SLAB_SIZE % c.size == 0);
+
+  FreeChunk *p = static_cast<FreeChunk *>(m);
+  p->next = c.free_list;
+  c.free_list = p;
+  c.used--;
+  used_bytes -= c.size;
+}
+
+size_t MemPool::chunk_size_of(const void *m) const {
+  if (!m)
+    return 0;
+
+  uint8_t cidx = use_system_malloc ? MEM_NO_CLASS : class_of_chunk(m);
+  if (cidx == MEM_NO_CLASS)
+    return malloc_usable_size(const_cast<void *>(m));
+
+  return classes[cidx].size;
+}
+
+size_t MemPool::evict(size_t bytes) {
+  // evictors free, and a free never evicts, but just in case
+  if (evicting)
+    return 0;
+
+  evicting = true;
+  size_t freed = 0;
+  for (auto &e : evictors) {
+    if (freed >= bytes)
+      break;
+    freed += e.fn(e.arg, bytes - freed);
+  }
+  evicting = false;
+
+  evicted_bytes += freed;
+  return freed;
+}
+
+// down to the occupancy (%), if above
+size_t MemPool::evict_to(int occupancy) {
+  size_t target = get_capacity() / 100 * occupancy;
+  size_t used = get_used_bytes();
+  return used > target ? evict(used - target) : 0;
+}
+
+int MemPool::get_occupancy() const {
+  size_t capacity = get_capacity();
+  if (capacity == 0)
+    return 0;
+  return get_used_bytes() / (capacity / 100);
+}
+
+bool MemPool::update_pressure() {
+  int occupancy = get_occupancy();
+  bool pressure = under_pressure ? occupancy >= MEM_LOW_WATERMARK
+                                 : occupancy >= MEM_HIGH_WATERMARK;
+  if (pressure == under_pressure)
+    return false;
+
+  under_pressure = pressure;
+  return true;
+}
+
+void MemPool::print_stats(const char *name) const {
+  if (use_system_malloc)
+    return;
+
+  const char *backing = "";
+  if (socket_id >= 0)
+    backing = ", dpdk";
+  else if (hugepage)
+    backing = ", hugepages";
+
+  DEBUG_INFO("[" << name << " objects] slabs " << slab_cnt << " ("
+                 << (get_slab_bytes() >> 20) << " MB" << backing << ") used "
+                 << (get_used_bytes() >> 10) << " KB, heap " << heap_cnt
+                 << " (overflows " << overflow_cnt << "), evicted "
+                 << (evicted_bytes >> 10) << " KB");
+
+  for (auto &c : classes) {
+    if (c.slab_cnt == 0)
+      continue;
+
+    double occupancy = 100.0 * c.used * c.size / (c.slab_cnt * MEM_SLAB_SIZE);
+    DEBUG_INFO("  class " << c.size << "B: used " << c.used << " peak "
+                          << c.peak << " slabs " << c.slab_cnt << " ("
+                          << occupancy << "% occupied)");
+  }
+}
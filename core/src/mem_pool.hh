@@ -1,129 +1,151 @@
 #ifndef _DISTREF_MEM_ALLOC_HH_
 #define _DISTREF_MEM_ALLOC_HH_
 
-#include <assert.h>
-#include <iostream>
-#include <string.h>
-#include <sys/mman.h>
-
-#include "log.hh"
-
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define MEM_SLAB_SIZE (2UL * 1024 * 1024)       // a (huge)page-aligned slab
+#define MEM_SLAB_MAX_OBJ (MEM_SLAB_SIZE / 8)  // larger ones use malloc
+#define MEM_ALIGN 16
+#define MEM_MAX_CLASSES 255
+#define MEM_NO_CLASS 255  // a slab not of the pool
+#define MEM_HIGH_WATERMARK 90  // % of capacity, under pressure from here
+#define MEM_LOW_WATERMARK 75   // % of capacity, until below this
+
+// frees cache-only objects of about bytes, returns the bytes freed
+typedef size_t (*mem_evict_func)(void *arg, size_t bytes);
+
+/*
+ * Slab allocator for objects
+ *
+ * Objects are carved from MEM_SLAB_SIZE slabs of a single size class, so an
+ * object takes the smallest class that fits (not the largest object size).
+ * Generic classes are spaced by ~1.5x; add_size_class() adds exact ones,
+ * e.g., the size of each map (__global_dobj_size), so that the objects of a
+ * map waste less than MEM_ALIGN bytes each. Free objects of a class are
+ * kept in a list and reused; slabs are not returned.
+ *
+ * Slabs come from one of:
+ * - A range reserved at start (capacity bytes), backed one slab at a time.
+ *   With hugepage, slabs are backed by 2MB hugepages (falling back to normal
+ *   pages if none are available). Pages are touched first by the allocating
+ *   thread, so slabs are local to the NUMA node of the worker lcore.
+ * - With a socket_id, the DPDK heap of that socket (rte_malloc_socket()),
+ *   i.e., the hugepages DPDK has already mapped; capacity bounds the slabs.
+ * Either way, the class of a chunk is looked up by the index of its slab in
+ * the range, and hugepages save TLB misses on large flow tables.
+ *
+ * The free lists of the pool act as the per-lcore cache of the heap: the
+ * schedulers of one process each have their own pool, and only a slab
+ * refill (every MEM_SLAB_SIZE bytes) takes the lock of the shared heap.
+ *
+ * Out of slabs, the evictors (add_evictor()) free cache-only objects down
+ * to the low watermark, and then chunks come from malloc, so malloc() fails
+ * only if the process is out of memory. The owner is expected to watch the
+ * occupancy (update_pressure()) and shed new state well before that.
+ *
+ * NOTE:
+ * - Not thread-safe; one pool per worker.
+ */
 class MemPool {
  private:
-  typedef struct tag_mem_chunk {
-    int mc_free_chunks;
-    struct tag_mem_chunk *mc_next;
-  } mem_chunk;
-
-  bool use_system_malloc = false;
-
-  int total_chunks;
-  int free_chunks;
-  size_t chunk_size;
-
-  void *start_ptr = nullptr;
-  mem_chunk *free_ptr = nullptr;
-
- public:
-  MemPool() {
-    use_system_malloc = true;
-
-    total_chunks = 0;
-    free_chunks = 0;
-    chunk_size = 0;
-
-    start_ptr = nullptr;
-    free_ptr = nullptr;
-
-    DEBUG_INFO("Fallback to use system malloc");
-  }
-
-  MemPool(size_t _chunk_size, int _chunk_count) {
-    if (_chunk_size < sizeof(mem_chunk)) {
-      std::cerr << "Chunk size should be larger than " << sizeof(mem_chunk)
-                << std::endl;
-      return;
-    }
-
-    if (_chunk_size % 4 != 0) {
-      _chunk_size = _chunk_size / 4 * 4 + 4;
-    }
+  struct FreeChunk {
+    FreeChunk *next;
+  };
 
-    this->total_chunks = _chunk_count;
-    this->free_chunks = _chunk_count;
-    this->chunk_size = _chunk_size;
+  struct SizeClass {
+    size_t size;
+    FreeChunk *free_list;
+    char *cur;  // unused part of the last slab
+    char *end;
 
-    uint64_t total_size = this->chunk_size * this->total_chunks;
+    size_t slab_cnt;
+    size_t used;
+    size_t peak;
+  };
 
-    int ret = posix_memalign((void **)&start_ptr, getpagesize(), total_size);
-    if (ret != 0) {
-      std::cerr << "Fail to allocate" << std::endl;
-      return;
-    }
-
-    if (geteuid() == 0) {
-      if (mlock(start_ptr, total_size) < 0)
-        std::cerr << "Fail to locking memory" << std::endl;
-    }
-
-    free_ptr = (mem_chunk *)start_ptr;
-    free_ptr->mc_free_chunks = free_chunks;
-    free_ptr->mc_next = nullptr;
-
-    DEBUG_INFO("Memory pool for chunk size "
-               << this->chunk_size << " chunk count " << this->total_chunks);
-  }
-
-  ~MemPool() {
-    if (start_ptr)
-      ::free(start_ptr);
+  bool use_system_malloc = false;
+  bool hugepage;
+  int socket_id;  // -1 for process memory
+
+  char *reserved = nullptr;  // as mapped
+  size_t reserved_size = 0;
+  char *base = nullptr;  // slab aligned
+  size_t slab_cnt = 0;
+  size_t max_slabs = 0;
+
+  std::vector<SizeClass> classes;
+  std::vector<uint8_t> slab_class;  // of each slab in the range
+  uint8_t class_of[MEM_SLAB_MAX_OBJ / MEM_ALIGN + 1];
+
+  // chunks from malloc: larger than a slab object, or past the capacity
+  size_t heap_cnt = 0;
+  size_t heap_bytes = 0;
+  size_t overflow_cnt = 0;  // past the capacity, so far
+
+  size_t used_bytes = 0;  // of the slabs
+  bool under_pressure = false;
+
+  struct Evictor {
+    mem_evict_func fn;
+    void *arg;
+  };
+  std::vector<Evictor> evictors;
+  bool evicting = false;
+  size_t evicted_bytes = 0;
+
+  int reserve_range(size_t capacity);
+  int reserve_dpdk_range(size_t capacity);
+  int push_class(size_t size);
+  char *alloc_slab();
+  int map_slab(int cidx);
+  FreeChunk *reclaim(int cidx);
+  void *heap_malloc(size_t size);
+
+  // MEM_NO_CLASS if m is not from a slab
+  uint8_t class_of_chunk(const void *m) const {
+    size_t idx = (uintptr_t)m - (uintptr_t)base;
+    idx /= MEM_SLAB_SIZE;  // huge if below base
+    return idx < slab_class.size() ? slab_class[idx] : MEM_NO_CLASS;
   }
 
-  void *malloc(size_t size) {
-    if (use_system_malloc)
-      return ::malloc(size);
-
-    if (size > chunk_size) {
-      std::cerr << "requested size " << size << " should be smaller than "
-                << chunk_size << std::endl;
-    }
-
-    mem_chunk *p = free_ptr;
-
-    if (free_chunks == 0)
-      return nullptr;
+ public:
+  // socket_id >= 0: slabs from the DPDK heap of the socket
+  explicit MemPool(size_t capacity, bool hugepage = false, int socket_id = -1);
+  ~MemPool();
+  MemPool(const MemPool &) = delete;
+  MemPool &operator=(const MemPool &) = delete;
 
-    assert(free_chunks > 0 && p->mc_free_chunks <= free_chunks);
+  // returns -1 if there are too many classes
+  int add_size_class(size_t size);
 
-    p->mc_free_chunks--;
-    free_chunks--;
+  void *malloc(size_t size);
+  void free(void *m);
 
-    if (p->mc_free_chunks) {
-      free_ptr = (mem_chunk *)((u_char *)p + chunk_size);
-      free_ptr->mc_free_chunks = p->mc_free_chunks;
-      free_ptr->mc_next = p->mc_next;
-    } else {
-      free_ptr = p->mc_next;
-    }
+  // bytes usable at m, at least the size it was allocated with
+  size_t chunk_size_of(const void *m) const;
 
-    return p;
+  // fn(arg, bytes) must not allocate from the pool
+  void add_evictor(mem_evict_func fn, void *arg) {
+    evictors.push_back(Evictor{fn, arg});
   }
+  size_t evict(size_t bytes);
+  size_t evict_to(int occupancy);
 
-  void free(void *m) {
-    if (use_system_malloc)
-      return ::free(m);
+  // of the dpdk memory of the socket (socket_id >= 0), or of the host
+  static size_t get_memory_size(int socket_id);
 
-    mem_chunk *p = (mem_chunk *)m;
+  size_t get_capacity() const { return max_slabs * MEM_SLAB_SIZE; }
+  size_t get_slab_bytes() const { return slab_cnt * MEM_SLAB_SIZE; }
+  size_t get_used_bytes() const { return used_bytes + heap_bytes; }
+  size_t get_overflow_cnt() const { return overflow_cnt; }
+  int get_occupancy() const;  // % of capacity
 
-    assert(((u_char *)p - (u_char *)start_ptr) % chunk_size == 0);
+  // true if it changed; on from the high watermark, off below the low one
+  bool update_pressure();
+  bool is_under_pressure() const { return under_pressure; }
 
-    p->mc_free_chunks = 1;
-    p->mc_next = free_ptr;
-
-    free_ptr = p;
-    free_chunks++;
-
-    return;
-  }
+  void print_stats(const char *name) const;
 };
 #endif
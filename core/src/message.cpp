@@ -2,19 +2,22 @@
 #include "controlbus.hh"
 #include "key.hh"
 #include "log.hh"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
 
 void fill_mw_rpc_request(RPCRequest *rpc, int r_idx, int map_id,
                          uint32_t key_size, const Key *key, uint32_t flag,
-                         uint32_t method_id, void *args, uint32_t args_size) {
+                         uint32_t method_id, void *args, uint32_t args_size,
+                         uint32_t ret_size) {
   rpc->r_idx = r_idx;
   rpc->map_id = map_id;
   rpc->flag = flag;
   rpc->method_id = method_id;
   rpc->key_size = key_size;
   rpc->args_size = args_size;
+  rpc->ret_size = ret_size;
 
   memcpy(rpc->buf, key->get_bytes(), rpc->key_size);
   memcpy(rpc->buf + key_size, args, rpc->args_size);
@@ -22,6 +25,118 @@ void fill_mw_rpc_request(RPCRequest *rpc, int r_idx, int map_id,
   return;
 }
 
+uint32_t fill_object_ownership_request(RWLeaseRequest *req, int rule_version,
+                                       int map_id, const Key *key,
+                                       bool force_to_create) {
+  uint32_t key_size = key->get_key_size();
+
+  req->rule_version = rule_version;
+  req->map_id = map_id;
+  req->key_size = key_size;
+  req->force_to_create = force_to_create;
+  memcpy(req->buf, key->get_bytes(), key_size);
+
+  return sizeof(RWLeaseRequest) + key_size;
+}
+
+static bool word_differs(const uint8_t *obj, const uint8_t *base,
+                         uint32_t offset, uint32_t len) {
+  uint64_t a = 0;
+  uint64_t b = 0;
+
+  memcpy(&a, obj + offset, len);
+  if (base)
+    memcpy(&b, base + offset, len);
+  return a != b;
+}
+
+// false if the run does not fit in limit bytes of delta
+static bool put_run(uint8_t *delta, uint32_t *total, uint32_t limit,
+                    const uint8_t *obj, uint32_t start, uint32_t end) {
+  uint32_t size = sizeof(DeltaRun) + end - start;
+  if (*total + size > limit)
+    return false;
+
+  DeltaRun *run = (DeltaRun *)(void *)(delta + *total);
+  run->offset = start;
+  run->len = end - start;
+  memcpy(run->buf, obj + start, end - start);
+  *total += size;
+  return true;
+}
+
+// compared a word at a time, in a single pass
+static int encode_delta(uint8_t *delta, const void *_obj, const void *_base,
+                        uint32_t obj_size, uint32_t limit) {
+  const uint32_t word = sizeof(uint64_t);
+  const uint8_t *obj = (const uint8_t *)_obj;
+  const uint8_t *base = (const uint8_t *)_base;
+  uint32_t total = 0;
+  uint32_t start = 0;
+  uint32_t end = 0;  // of the open run, if start < end
+
+  if (!obj || obj_size < DELTA_MIN_OBJ_SIZE)
+    return -1;
+
+  for (uint32_t offset = 0; offset < obj_size; offset += word) {
+    uint32_t len = std::min(word, obj_size - offset);
+    if (!word_differs(obj, base, offset, len))
+      continue;
+
+    // a gap up to a run header costs no more to send along than a new run
+    if (start < end && offset - end <= sizeof(DeltaRun)) {
+      end = offset + len;
+      continue;
+    }
+
+    if (start < end && !put_run(delta, &total, limit, obj, start, end))
+      return -1;
+    start = offset;
+    end = offset + len;
+  }
+
+  if (start < end && !put_run(delta, &total, limit, obj, start, end))
+    return -1;
+  return total;
+}
+
+// the delta of obj against base at buf, or obj itself if the delta would be
+// larger; buf has room for obj_size bytes
+static int put_object(uint8_t *buf, const void *obj, const void *base,
+                      uint32_t obj_size) {
+  int delta_size = encode_delta(buf, obj, base, obj_size, obj_size);
+  if (delta_size < 0 && obj_size)
+    memcpy(buf, obj, obj_size);
+  return delta_size;
+}
+
+void apply_delta(void *obj, const uint8_t *delta, uint32_t delta_size) {
+  uint32_t offset = 0;
+  while (offset < delta_size) {
+    const DeltaRun *run = (const DeltaRun *)(const void *)(delta + offset);
+    memcpy((uint8_t *)obj + run->offset, run->buf, run->len);
+    offset += sizeof(DeltaRun) + run->len;
+  }
+}
+
+uint32_t fill_object_ownership_response(RWLeaseResponse *res, int map_id,
+                                        const Key *key, int version,
+                                        void *obj, uint32_t obj_size) {
+  uint32_t key_size = key->get_key_size();
+
+  res->map_id = map_id;
+  res->key_size = key_size;
+  res->version = version;
+  res->obj_size = obj_size;
+
+  if (key_size)
+    memcpy(res->buf, key->get_bytes(), key_size);
+
+  res->delta_size = put_object(res->buf + key_size, obj, nullptr, obj_size);
+  return sizeof(RWLeaseResponse) + key_size +
+         (res->delta_size >= 0 ? res->delta_size : obj_size);
+}
+
 MessageBuffer *create_ping(ControlBus *cbus, WorkerID from, WorkerID to,
                            uint32_t sip, uint16_t sp) {
   int msg_size = sizeof(Message) + sizeof(MsgPing);
@@ -60,7 +175,7 @@ MessageBuffer *create_mw_rpc_request(ControlBus *cbus, WorkerID from,
                                      WorkerID to, int r_idx, int map_id,
                                      const Key *key, uint32_t flag,
                                      uint32_t method_id, void *args,
-                                     uint32_t args_size) {
+                                     uint32_t args_size, uint32_t ret_size) {
   uint32_t key_size = key->get_key_size();
   int msg_size = sizeof(Message) + sizeof(RPCRequest) + key_size + args_size;
 
@@ -71,7 +186,7 @@ MessageBuffer *create_mw_rpc_request(ControlBus *cbus, WorkerID from,
   m->to_id = to;
 
   fill_mw_rpc_request((RPCRequest *)(void *)m->buf, r_idx, map_id, key_size,
-                      key, flag, method_id, args, args_size);
+                      key, flag, method_id, args, args_size, ret_size);
 
   return mb;
 }
@@ -140,12 +255,8 @@ MessageBuffer *create_object_ownership_request(ControlBus *cbus, WorkerID from,
   m->from_id = from;
   m->to_id = to;
 
-  RWLeaseRequest *req = (RWLeaseRequest *)(void *)m->buf;
-  req->rule_version = rule_version;
-  req->map_id = map_id;
-  req->key_size = key_size;
-  req->force_to_create = force_to_create;
-  memcpy(req->buf, key->get_bytes(), key_size);
+  fill_object_ownership_request((RWLeaseRequest *)(void *)m->buf,
+                                rule_version, map_id, key, force_to_create);
 
   return mb;
 }
@@ -164,17 +275,11 @@ MessageBuffer *create_object_ownership_response(ControlBus *cbus, WorkerID from,
   m->from_id = from;
   m->to_id = to;
 
-  RWLeaseResponse *res = (RWLeaseResponse *)(void *)m->buf;
-  res->map_id = map_id;
-  res->key_size = key_size;
-  res->version = version;
-  res->obj_size = obj_size;
-
-  if (key_size)
-    memcpy(res->buf, key->get_bytes(), key_size);
+  uint32_t size = fill_object_ownership_response(
+      (RWLeaseResponse *)(void *)m->buf, map_id, key, version, obj, obj_size);
 
-  if (obj_size)
-    memcpy(res->buf + key_size, obj, obj_size);
+  // sent without what the delta saved
+  mb->body_size = sizeof(Message) + size;
 
   return mb;
 }
@@ -205,7 +310,7 @@ MessageBuffer *create_object_ownership_expire_request(ControlBus *cbus,
 
 MessageBuffer *create_object_ownership_expire_response(
     ControlBus *cbus, WorkerID from, WorkerID to, int map_id, const Key *key,
-    int version, void *obj, uint32_t obj_size) {
+    int version, void *obj, uint32_t obj_size, const void *base) {
   uint32_t key_size = key->get_key_size();
   int msg_size =
       sizeof(Message) + sizeof(RWLeaseExpireResponse) + key_size + obj_size;
@@ -223,7 +328,16 @@ MessageBuffer *create_object_ownership_expire_response(
   req->obj_size = obj_size;
 
   memcpy(req->buf, key->get_bytes(), key_size);
-  memcpy(req->buf + key_size, obj, obj_size);
+  if (base) {
+    req->delta_size = put_object(req->buf + key_size, obj, base, obj_size);
+  } else {
+    req->delta_size = -1;
+    memcpy(req->buf + key_size, obj, obj_size);
+  }
+
+  // sent without what the delta saved
+  if (req->delta_size >= 0)
+    mb->body_size -= obj_size - req->delta_size;
 
   return mb;
 }
@@ -350,3 +464,100 @@ MessageBuffer *create_rwobj_cleanup_meta_request(ControlBus *cbus,
 
   return mb;
 }
+
+MessageBuffer *create_ro_cache_request(ControlBus *cbus, WorkerID from,
+                                       WorkerID to, int map_id,
+                                       const Key *key) {
+  uint32_t key_size = key->get_key_size();
+  int msg_size = sizeof(Message) + sizeof(ROCacheRequest) + key_size;
+
+  MessageBuffer *mb = cbus->allocate_message(msg_size);
+  Message *m = (Message *)mb->get_message_body();
+  m->mtype = MSG_RO_CACHE_REQUEST;
+  m->from_id = from;
+  m->to_id = to;
+
+  ROCacheRequest *req = (ROCacheRequest *)(void *)m->buf;
+  req->map_id = map_id;
+  req->key_size = key_size;
+
+  memcpy(req->buf, key->get_bytes(), key_size);
+
+  return mb;
+}
+
+MessageBuffer *create_ro_cache_response(ControlBus *cbus, WorkerID from,
+                                        WorkerID to, int map_id,
+                                        const Key *key, int version, void *obj,
+                                        uint32_t obj_size) {
+  uint32_t key_size = key->get_key_size();
+  int msg_size =
+      sizeof(Message) + sizeof(ROCacheResponse) + key_size + obj_size;
+
+  MessageBuffer *mb = cbus->allocate_message(msg_size);
+  Message *m = (Message *)mb->get_message_body();
+  m->mtype = MSG_RO_CACHE_RESPONSE;
+  m->from_id = from;
+  m->to_id = to;
+
+  ROCacheResponse *res = (ROCacheResponse *)(void *)m->buf;
+  res->map_id = map_id;
+  res->key_size = key_size;
+  res->version = version;
+  res->obj_size = obj_size;
+
+  memcpy(res->buf, key->get_bytes(), key_size);
+
+  if (obj_size)
+    memcpy(res->buf + key_size, obj, obj_size);
+
+  return mb;
+}
+
+MessageBuffer *create_ro_cache_invalidate(ControlBus *cbus, WorkerID from,
+                                          WorkerID to, int map_id,
+                                          const Key *key, int version) {
+  uint32_t key_size = key->get_key_size();
+  int msg_size = sizeof(Message) + sizeof(ROCacheInvalidate) + key_size;
+
+  MessageBuffer *mb = cbus->allocate_message(msg_size);
+  Message *m = (Message *)mb->get_message_body();
+  m->mtype = MSG_RO_CACHE_INVALIDATE;
+  m->from_id = from;
+  m->to_id = to;
+
+  ROCacheInvalidate *req = (ROCacheInvalidate *)(void *)m->buf;
+  req->map_id = map_id;
+  req->key_size = key_size;
+  req->version = version;
+
+  memcpy(req->buf, key->get_bytes(), key_size);
+
+  return mb;
+}
+
+MessageBuffer *create_home_transfer(ControlBus *cbus, WorkerID from,
+                                    WorkerID to, int map_id, const Key *key,
+                                    int version, void *obj, uint32_t obj_size) {
+  uint32_t key_size = key->get_key_size();
+  int msg_size = sizeof(Message) + sizeof(HomeTransfer) + key_size + obj_size;
+
+  MessageBuffer *mb = cbus->allocate_message(msg_size);
+  Message *m = (Message *)mb->get_message_body();
+  m->mtype = MSG_HOME_TRANSFER;
+  m->from_id = from;
+  m->to_id = to;
+
+  HomeTransfer *req = (HomeTransfer *)(void *)m->buf;
+  req->map_id = map_id;
+  req->key_size = key_size;
+  req->version = version;
+  req->obj_size = obj_size;
+
+  memcpy(req->buf, key->get_bytes(), key_size);
+
+  if (obj_size)
+    memcpy(req->buf + key_size, obj, obj_size);
+
+  return mb;
+}
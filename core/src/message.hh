@@ -10,6 +10,8 @@ class ControlBus;
 class MessageBuffer;
 class Key;
 
+#define DELTA_MIN_OBJ_SIZE 512  // smaller objects are always sent whole
+
 enum MessageType : uint16_t {
   MSG_PING,
   MSG_PONG,
@@ -20,6 +22,8 @@ enum MessageType : uint16_t {
   MSG_MW_AGGR_REQUEST,
   MSG_RWLEASE_REQUEST,
   MSG_RWLEASE_RESPONSE,
+  MSG_RWLEASE_REQUEST_MULTI,
+  MSG_RWLEASE_RESPONSE_MULTI,
   MSG_RWLEASE_EXPIRE_REQUEST,
   MSG_RWLEASE_EXPIRE_RESPONSE,
   MSG_KEY_REQUEST,
@@ -27,6 +31,10 @@ enum MessageType : uint16_t {
   MSG_RW_DEL_REQUEST,
   MSG_RW_DEL_RESPONSE,
   MSG_RW_CLEANUP_META_REQUEST,
+  MSG_RO_CACHE_REQUEST,
+  MSG_RO_CACHE_RESPONSE,
+  MSG_RO_CACHE_INVALIDATE,
+  MSG_HOME_TRANSFER,
   MSG_MW_SKELETON_STREAM,
 };
 
@@ -56,6 +64,7 @@ struct RPCRequest {
   uint8_t method_id;
   uint8_t key_size;
   uint16_t args_size;
+  uint16_t ret_size;  // 0 if the caller does not wait for a return
 
   // key_offset: (void*) buf
   // args_offset: (void*) bug + key_size
@@ -86,6 +95,9 @@ struct RPCRequestMultiAsym {
   uint8_t rpc_request[0];
 };
 
+// in RPCResponse::flag, without a return: the manager could not run the rpc
+#define _FLAG_RPC_ERROR (1 << 7)
+
 struct RPCResponse {
   int r_idx;
   int map_id;
@@ -128,13 +140,21 @@ struct RWLeaseResponse {
   uint32_t key_size;
   int version;
   uint32_t obj_size;
+  int delta_size;  // -1 if buf has the object, else its delta against zeros
 
   // key_offset: (void*) buf
   // obj_offset: (void*) buf + key_size
-  // buf_size = key_size + obj_size;
+  // buf_size = key_size + (delta_size < 0 ? obj_size : delta_size);
   uint8_t buf[0];
 };
 
+/* RW lease batching: RWLeaseRequests or RWLeaseResponses to a worker */
+/* for different map_id, key */
+struct RWLeaseMulti {
+  int count;  // number of RWLeaseRequest (or RWLeaseResponse)
+  uint8_t rwlease[0];
+};
+
 struct RWLeaseExpireRequest {
   int map_id;
   int key_size;
@@ -150,10 +170,23 @@ struct RWLeaseExpireResponse {
   int key_size;
   int version;
   uint32_t obj_size;
+  int delta_size;  // -1 if buf has the object, else its delta against the
+                   // object as leased (the manager still has it)
 
   // key_offset: (void*) buf
   // obj_offset: (void*) buf + key_size
-  // buf_size = key_size + obj_size;
+  // buf_size = key_size + (delta_size < 0 ? obj_size : delta_size);
+  uint8_t buf[0];
+};
+
+/*
+ * Delta of an object: the runs of bytes that differ from a base object the
+ * receiver has, one after another. Large objects often change in a few
+ * fields only (or are mostly zeros, against a zero base).
+ */
+struct DeltaRun {
+  uint32_t offset;
+  uint32_t len;
   uint8_t buf[0];
 };
 
@@ -211,6 +244,49 @@ struct RWCleanupMetaRequest {
   uint8_t buf[0];
 };
 
+struct ROCacheRequest {
+  int map_id;
+  uint32_t key_size;
+
+  // key_offset: (void*) buf
+  // buf_size = key_size;
+  uint8_t buf[0];
+};
+
+struct ROCacheResponse {
+  int map_id;
+  uint32_t key_size;
+  int version;  // -1 if there is no object to cache
+  uint32_t obj_size;
+
+  // key_offset: (void*) buf
+  // obj_offset: (void*) buf + key_size
+  // buf_size = key_size + obj_size;
+  uint8_t buf[0];
+};
+
+struct ROCacheInvalidate {
+  int map_id;
+  uint32_t key_size;
+  int version;
+
+  // key_offset: (void*) buf
+  // buf_size = key_size;
+  uint8_t buf[0];
+};
+
+struct HomeTransfer {
+  int map_id;
+  uint32_t key_size;
+  int version;  // -1 if the home goes back without an object
+  uint32_t obj_size;
+
+  // key_offset: (void*) buf
+  // obj_offset: (void*) buf + key_size
+  // buf_size = key_size + obj_size;
+  uint8_t buf[0];
+};
+
 struct SkeletonStream {
   int map_id;
   uint32_t obj_count;
@@ -224,7 +300,19 @@ struct SkeletonStream {
 
 void fill_mw_rpc_request(RPCRequest *rpc, int r_idx, int map_id,
                          uint32_t key_size, const Key *key, uint32_t flag,
-                         uint32_t method_id, void *args, uint32_t args_size);
+                         uint32_t method_id, void *args, uint32_t args_size,
+                         uint32_t ret_size);
+
+// return the bytes filled
+uint32_t fill_object_ownership_request(RWLeaseRequest *req, int rule_version,
+                                       int map_id, const Key *key,
+                                       bool force_to_create);
+// with a delta against zeros if it is smaller than the object
+uint32_t fill_object_ownership_response(RWLeaseResponse *res, int map_id,
+                                        const Key *key, int version,
+                                        void *obj, uint32_t obj_size);
+// patches the base at obj
+void apply_delta(void *obj, const uint8_t *delta, uint32_t delta_size);
 
 MessageBuffer *create_ping(ControlBus *cbus, WorkerID from, WorkerID to,
                            uint32_t sip, uint16_t sp);
@@ -236,7 +324,7 @@ MessageBuffer *create_mw_rpc_request(ControlBus *cbus, WorkerID from,
                                      WorkerID to, int r_idx, int map_id,
                                      const Key *key, uint32_t flag,
                                      uint32_t method_id, void *args,
-                                     uint32_t args_size);
+                                     uint32_t args_size, uint32_t ret_size);
 
 MessageBuffer *create_mw_rpc_response(ControlBus *cbus, WorkerID from,
                                       WorkerID to, int r_idx, int map_id,
@@ -264,9 +352,10 @@ MessageBuffer *create_object_ownership_expire_request(ControlBus *cbus,
                                                       const Key *key,
                                                       int version);
 
+// base: the object as leased, if kept, for a delta
 MessageBuffer *create_object_ownership_expire_response(
     ControlBus *cbus, WorkerID from, WorkerID to, int map_id, const Key *key,
-    int version, void *obj, uint32_t obj_size);
+    int version, void *obj, uint32_t obj_size, const void *base);
 
 MessageBuffer *create_key_ownership_request(ControlBus *cbus, WorkerID from,
                                             WorkerID to, int rule_version,
@@ -291,4 +380,21 @@ MessageBuffer *create_rwobj_cleanup_meta_request(ControlBus *cbus,
                                                  int map_id, const Key *key,
                                                  int version);
 
+MessageBuffer *create_ro_cache_request(ControlBus *cbus, WorkerID from,
+                                       WorkerID to, int map_id,
+                                       const Key *key);
+
+MessageBuffer *create_ro_cache_response(ControlBus *cbus, WorkerID from,
+                                        WorkerID to, int map_id,
+                                        const Key *key, int version, void *obj,
+                                        uint32_t obj_size);
+
+MessageBuffer *create_ro_cache_invalidate(ControlBus *cbus, WorkerID from,
+                                          WorkerID to, int map_id,
+                                          const Key *key, int version);
+
+MessageBuffer *create_home_transfer(ControlBus *cbus, WorkerID from,
+                                    WorkerID to, int map_id, const Key *key,
+                                    int version, void *obj, uint32_t obj_size);
+
 #endif /* _DISTREF_MESSAGE_H */
@@ -26,8 +26,10 @@ class MwMap {
   int map_id;
 
  public:
-  MwMap(const char *name) {
+  // codegen passes KEY_OPS(X) if X has equal_to()
+  MwMap(const char *name, KeyOps key_ops = KEY_OPS_GENERIC) {
     this->map_id = __register_map(Y::GetObjectType(), sizeof(Y), name);
+    __register_key_ops(map_id, key_ops);
     __register_mwstub_creator(map_id, MwStub<Y>::CreateMwStub);
     __register_mwskeleton_creator(map_id, Skeleton<Y>::CreateSkeleton);
   }
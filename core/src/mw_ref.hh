@@ -30,6 +30,7 @@ class MwRef {
     /* we don't know whether the reference is const or not */
     map_id = -1;
     key = nullptr;
+    key_inline = false;
     is_const = true;
     is_registered = false;
     ref_p = nullptr;
@@ -42,6 +43,7 @@ class MwRef {
 
     map_id = -1;
     key = nullptr;
+    key_inline = false;
     is_const = true;
     is_registered = false;
     ref_p = nullptr;
@@ -49,10 +51,10 @@ class MwRef {
 
   // Create a reference for 'new object'
   MwRef(int mid, const Key* k, RefState& state)
-      : map_id(mid), key(k->clone()), is_const(false) {
-    // XXX clonning every key might be inefficient :(
-    DEBUG_REF("default constructor " << this << "[" << map_id << ":" << key
-                                     << "]"
+      : map_id(mid), key(nullptr), key_inline(false), is_const(false) {
+    set_key(k);
+    DEBUG_REF("default constructor " << this << "[" << map_id << ":"
+                                     << getKey() << "]"
                                      << " is const " << is_const);
 
     ref_p = HOOK->create_object(this, state);
@@ -63,10 +65,11 @@ class MwRef {
   }
 
   // Create a reference for 'object', if the object doesn't exist, create it
-  MwRef(int mid, const Key* k) : map_id(mid), key(k->clone()), is_const(false) {
-    // XXX clonning every key might be inefficient :(
-    DEBUG_REF("default constructor " << this << "[" << map_id << ":" << key
-                                     << "]"
+  MwRef(int mid, const Key* k)
+      : map_id(mid), key(nullptr), key_inline(false), is_const(false) {
+    set_key(k);
+    DEBUG_REF("default constructor " << this << "[" << map_id << ":"
+                                     << getKey() << "]"
                                      << " is_const " << is_const);
 
     ref_p = HOOK->get_object(this);
@@ -78,10 +81,10 @@ class MwRef {
 
   // lookup a reference for 'existing objects'
   MwRef(int mid, const Key* k, bool _is_const)
-      : map_id(mid), key(k->clone()), is_const(_is_const) {
-    // XXX clonning every key might be inefficient :(
-    DEBUG_REF("default constructor " << this << "[" << map_id << ":" << key
-                                     << "]"
+      : map_id(mid), key(nullptr), key_inline(false), is_const(_is_const) {
+    set_key(k);
+    DEBUG_REF("default constructor " << this << "[" << map_id << ":"
+                                     << getKey() << "]"
                                      << " is_const " << is_const);
 
     ref_p = HOOK->lookup_object(this);
@@ -92,20 +95,19 @@ class MwRef {
   }
 
   MwRef(const MwRef& r) {
-    DEBUG_REF("copy constructor " << this << "[" << r.map_id << ":" << r.key
-                                  << "]"
+    DEBUG_REF("copy constructor " << this << "[" << r.map_id << ":"
+                                  << r.getKey() << "]"
                                   << " is_const " << r.is_const);
 
     map_id = r.map_id;
-    if (r.key)
-      key = r.key->clone();
-    else
-      key = nullptr;
+    key = nullptr;
+    key_inline = false;
+    set_key(r.getKey());
 
     is_const = r.is_const;
     is_registered = false;
 
-    if (key) {
+    if (getKey()) {
       ref_p = HOOK->lookup_object(this);
       if (ref_p)
         is_registered = true;
@@ -119,8 +121,7 @@ class MwRef {
     if (is_registered)
       HOOK->release_ref(this);
 
-    if (key != nullptr)
-      delete key;
+    clear_key();
   }
 
   /* remove objects */
@@ -130,23 +131,24 @@ class MwRef {
     HOOK->delete_object(this);
     is_registered = false;
 
-    if (key != nullptr)
-      delete key;
-    key = nullptr;
+    clear_key();
 
     ref_p = nullptr;
   }
 
   const MwRef& operator=(const MwRef& r) const {
     DEBUG_REF("assignment operator: copy requested to "
-              << this << "[" << r.map_id << ":" << r.key << "]"
+              << this << "[" << r.map_id << ":" << r.getKey() << "]"
               << " is_const " << r.is_const);
 
+    if (&r == this)
+      return *this;
+
     map_id = r.map_id;
     is_const = r.is_const;
 
-    if (r.key != nullptr) {
-      key = r.key->clone();
+    if (r.getKey() != nullptr) {
+      set_key(r.getKey());
       ref_p = HOOK->lookup_object(this);
     } else
       ref_p = r.ref_p;
@@ -195,7 +197,9 @@ class MwRef {
 
   bool isConst() const { return is_const; }
 
-  Key* getKey() const { return key; }
+  Key* getKey() const {
+    return key_inline ? reinterpret_cast<Key*>(key_buf) : key;
+  }
 
   int getMapId() const { return map_id; }
 
@@ -204,19 +208,19 @@ class MwRef {
   int getVersion() const { return -1; }
 
   int get_serial_size() const {
-    return sizeof(MwStubSerial) + key->get_key_size();
+    return sizeof(MwStubSerial) + getKey()->get_key_size();
   }
 
   /* How to handle MwRef when serialize/deserialize */
   struct MwStubSerial* serialize() const {
-    size_t buf_size = sizeof(MwStubSerial) + key->get_key_size();
+    size_t buf_size = sizeof(MwStubSerial) + getKey()->get_key_size();
     void* buf = malloc(buf_size);
 
     struct MwStubSerial* dr_buf = (struct MwStubSerial*)buf;
     dr_buf->size = buf_size;
     dr_buf->map_id = map_id;
     dr_buf->is_const = is_const;
-    dr_buf->key_archive = key->serialize();
+    dr_buf->key_archive = getKey()->serialize();
 
     return dr_buf;
   }
@@ -235,7 +239,7 @@ class MwRef {
     if (lhs.map_id == -1 || rhs.map_id == -1)
       return lhs.ref_p == rhs.ref_p;
 
-    return (lhs.map_id == rhs.map_id) && (*lhs.key == *rhs.key) &&
+    return (lhs.map_id == rhs.map_id) && (*lhs.getKey() == *rhs.getKey()) &&
            (lhs.ref_p == rhs.ref_p);
   };
 
@@ -246,9 +250,29 @@ class MwRef {
  private:
   thread_local static ReferenceInterceptor* HOOK;
 
+  // copies k into key_buf (no allocation), or onto the heap if it is too big
+  void set_key(const Key* k) const {
+    clear_key();
+    if (k == nullptr)
+      return;
+
+    if (k->clone(sizeof(key_buf), key_buf) != nullptr)
+      key_inline = true;
+    else
+      key = k->clone();
+  }
+
+  void clear_key() const {
+    if (!key_inline && key != nullptr)
+      delete key;
+    key = nullptr;
+    key_inline = false;
+  }
+
   /* object identifier (map_id, key) tuple */
   mutable int map_id;
-  mutable Key* key;
+  mutable Key* key;  // only if the key does not fit in key_buf
+  mutable bool key_inline;
 
   /* reference characteristics */
   mutable bool is_registered;
@@ -256,6 +280,9 @@ class MwRef {
 
   /* reference for SW/MW-Objects */
   mutable MwStub<X>* ref_p;
+
+  /* inline copy of the key; a plain memcpy, never destructed */
+  alignas(8) mutable uint8_t key_buf[REF_KEY_BUF_SIZE];
 };
 
 template <class X>
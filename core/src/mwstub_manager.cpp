@@ -23,7 +23,11 @@ struct CacheReturn {
   bool need_update;
   uint32_t size;
   uint64_t last_update_tsc;
-  void *data;
+  void *data;  // in the pool
+
+  int map_id;
+  VKey vkey;  // in cache_ret_map
+  TAILQ_ENTRY(CacheReturn) lru_elem;
 };
 
 class PRADSStat;
@@ -56,7 +60,14 @@ MwStubManager::MwStubManager(uint32_t node_id, Worker *worker,
 
   init_hz();
 
+  for (int map_id = 0; map_id < ADTCnt; map_id++) {
+    mwstub_map_arr[map_id].set_key_ops(__get_key_ops(map_id));
+    mw_skeleton_map_arr[map_id].set_key_ops(__get_key_ops(map_id));
+  }
+
   TAILQ_INIT(&aggr_list);
+  TAILQ_INIT(&cache_lru);
+  mp->add_evictor(evict_cache_returns, this);
 #if 0
 	// for dynamic scaling
 	for (int i = 0; i < _DADTCnt; i++) {
@@ -149,24 +160,34 @@ void MwStubManager::set_cache_return(int map_id, const Key *key, int method_id,
   auto it = cache_ret_map[map_id].find(VKey(key, method_id));
   if (it == cache_ret_map[map_id].end()) {
     cache = new CacheReturn();
+    cache->size = 0;
+    cache->data = nullptr;
+    cache->map_id = map_id;
+    cache->vkey = VKey(key->clone(), method_id);
+    cache_ret_map[map_id][cache->vkey] = cache;
+  } else {
+    cache = it->second;
+    // not to be evicted by the malloc below
+    TAILQ_REMOVE(&cache_lru, cache, lru_elem);
+  }
+
+  if (!cache->data || cache->size != arg_size) {
+    mp->free(cache->data);
     cache->size = arg_size;
-    cache->data = malloc(arg_size);
+    cache->data = mp->malloc(arg_size);
+  }
+
+  if (cache->data) {
     memcpy(cache->data, data, arg_size);
-    cache_ret_map[map_id][VKey(key->clone(), method_id)] = cache;
+    cache->need_update = false;
+    cache->last_update_tsc = get_cur_rdtsc();
+    TAILQ_INSERT_TAIL(&cache_lru, cache, lru_elem);
   } else {
-    cache = it->second;
-    if (cache->size == arg_size) {
-      memcpy(cache->data, data, arg_size);
-    } else {
-      cache->size = arg_size;
-      free(cache->data);
-      cache->data = malloc(arg_size);
-      memcpy(cache->data, data, arg_size);
-    }
+    // the waiters request it again
+    DEBUG_ERR("Fail to malloc");
+    delete_cache_return(cache);
   }
 
-  cache->need_update = false;
-  cache->last_update_tsc = get_cur_rdtsc();
   scheduler->notify_to_wake_up(map_id, key, method_id);
 }
 
@@ -178,12 +199,39 @@ CacheReturn *MwStubManager::get_cache_return(int map_id, const Key *key,
     if (get_cur_rdtsc() - cache->last_update_tsc > CACHE_TIMEOUT_HZ) {
       cache->need_update = true;
     }
-    return it->second;
+
+    TAILQ_REMOVE(&cache_lru, cache, lru_elem);
+    TAILQ_INSERT_TAIL(&cache_lru, cache, lru_elem);
+    return cache;
   }
 
   return nullptr;
 }
 
+// not in cache_lru
+void MwStubManager::delete_cache_return(CacheReturn *cache) {
+  cache_ret_map[cache->map_id].erase(cache->vkey);
+  delete cache->vkey.first;
+  mp->free(cache->data);
+  delete cache;
+}
+
+// stale rpc results are cache-only, least recently used first
+size_t MwStubManager::evict_cache_returns(void *arg, size_t bytes) {
+  MwStubManager *m = static_cast<MwStubManager *>(arg);
+  size_t freed = 0;
+
+  while (freed < bytes && !TAILQ_EMPTY(&m->cache_lru)) {
+    CacheReturn *cache = TAILQ_FIRST(&m->cache_lru);
+    TAILQ_REMOVE(&m->cache_lru, cache, lru_elem);
+
+    freed += m->mp->chunk_size_of(cache->data);
+    m->delete_cache_return(cache);
+  }
+
+  return freed;
+}
+
 MWSkeleton *MwStubManager::get_mw_skeleton(int map_id, const Key *key) {
   MWSkeletonMap &mw_skeleton_map = mw_skeleton_map_arr[map_id];
   MWSkeleton *skeleton = nullptr;
@@ -193,7 +241,7 @@ MWSkeleton *MwStubManager::get_mw_skeleton(int map_id, const Key *key) {
     void *obj = mp->malloc(__global_dobj_size[map_id]);
     if (!obj) {
       DEBUG_ERR("Fail to malloc");
-      assert(0);
+      errno = -ENOMEM;
       return nullptr;
     }
 
@@ -211,24 +259,30 @@ MWSkeleton *MwStubManager::get_mw_skeleton(int map_id, const Key *key) {
   return skeleton;
 }
 
-// called locally or remotely
-void MwStubManager::execute_rpc(int map_id, const Key *key, uint32_t flag,
-                                uint32_t method_id, void *args, void **ret,
-                                uint32_t *ret_size) {
+// called locally or remotely; returns -1 without the skeleton (no memory)
+int MwStubManager::execute_rpc(int map_id, const Key *key, uint32_t flag,
+                               uint32_t method_id, void *args, void **ret,
+                               uint32_t *ret_size) {
   MWSkeleton *skeleton = get_mw_skeleton(map_id, key);
-  assert(skeleton);
+  if (!skeleton) {
+    *ret_size = 0;
+    return -1;
+  }
+
   skeleton->exec(method_id, args, ret, ret_size);
-  return;
+  access_tracker.record(map_id, key);
+  return 0;
 }
 
 inline bool MwStubManager::send_rpc_message(WorkerID to, int map_id,
                                             const Key *key, uint32_t flag,
                                             uint32_t method_id, void *args,
-                                            uint32_t args_size) {
+                                            uint32_t args_size,
+                                            uint32_t ret_size) {
   int cur_routine_idx = scheduler->get_cur_routine_idx();
   MessageBuffer *m =
       create_mw_rpc_request(cbus, node_id, to, cur_routine_idx, map_id, key,
-                            flag, method_id, args, args_size);
+                            flag, method_id, args, args_size, ret_size);
 
   worker->send_message(to, m);
   return true;
@@ -244,13 +298,19 @@ inline void MwStubManager::request_stale_rpc(WorkerID to, int map_id,
   CacheReturn *cache = get_cache_return(map_id, key, method_id);
   while (!cache) {
     // XXX: multiple rpc messages during cached item is not exist
-    send_rpc_message(to, map_id, key, flag, method_id, nullptr, 0);
+    send_rpc_message(to, map_id, key, flag, method_id, nullptr, 0, ret_size);
     scheduler->yield_block(map_id, key, method_id);
     cache = get_cache_return(map_id, key, method_id);
   }
 
-  if (cache->need_update)
-    send_rpc_message(to, map_id, key, flag, method_id, nullptr, 0);
+  // an empty return: the manager could not run the rpc, ask again next time
+  if (cache->need_update || !cache->size)
+    send_rpc_message(to, map_id, key, flag, method_id, nullptr, 0, ret_size);
+
+  if (!cache->size) {
+    memset(ret, 0, ret_size);
+    return;
+  }
 
   assert(ret_size == cache->size);
   memcpy(ret, cache->data, cache->size);
@@ -291,8 +351,12 @@ RPCRequest *MwStubManager::get_rpc_behind_message(WorkerID to, int msg_size) {
     if (rpc_multi->count == 0)
       assert(0);
 
-    mb->body_size = rpc_buf->offset - sizeof(MessageBuffer);
-    worker->send_message(to, mb);
+    // send() takes the ownership of the message, while rpc_buf is reused
+    size_t body_size =
+        rpc_buf->offset - sizeof(MessageBuffer) - mb->body_offset;
+    MessageBuffer *out = cbus->allocate_message(body_size);
+    memcpy(out->buf + out->body_offset, mb->buf + mb->body_offset, body_size);
+    worker->send_message(to, out);
 
     // DEBUG_ERR("Send RPC " << mb->body_size);
     init_mw_rpc_request_multi_asim(cbus, rpc_buf, node_id, to);
@@ -324,11 +388,11 @@ inline void MwStubManager::request_behind_rpc(WorkerID to, int map_id,
     assert(m);
 
     fill_mw_rpc_request(m, d_idx, map_id, key_size, key, flag, method_id, args,
-                        args_size);
+                        args_size, 0);
   } else if (mode == RPC_ZIPPING) {
     assert(0);
   } else {
-    send_rpc_message(to, map_id, key, flag, method_id, args, args_size);
+    send_rpc_message(to, map_id, key, flag, method_id, args, args_size, 0);
   }
 }
 
@@ -340,8 +404,8 @@ inline void MwStubManager::request_strict_rpc(WorkerID to, int map_id,
   uint32_t _ret_size = 0;
   void *_ret = nullptr;
 
-  bool sent =
-      send_rpc_message(to, map_id, key, flag, method_id, args, args_size);
+  bool sent = send_rpc_message(to, map_id, key, flag, method_id, args,
+                               args_size, ret_size);
   if (!sent)
     return;
 
@@ -359,8 +423,13 @@ inline void MwStubManager::request_strict_rpc(WorkerID to, int map_id,
 
   StrictReturn *strict = it->second;
 
-  assert(ret_size = strict->size);
-  memcpy(ret, strict->data, strict->size);
+  // an empty return: the manager could not run the rpc
+  if (!strict->size) {
+    memset(ret, 0, ret_size);
+  } else {
+    assert(ret_size == strict->size);
+    memcpy(ret, strict->data, strict->size);
+  }
 
   strict_ret_map.erase(it);
   free(strict->data);
@@ -420,7 +489,12 @@ void MwStubManager::request_rpc(int map_id, const Key *key, uint32_t flag,
     uint8_t _ret[ret_size];
     void *_ret_p = (void *)_ret;
 
-    execute_rpc(map_id, key, flag, method_id, args, &_ret_p, &_ret_size);
+    // a zeroed return if the skeleton cannot be created
+    if (execute_rpc(map_id, key, flag, method_id, args, &_ret_p,
+                    &_ret_size) < 0) {
+      memset(ret, 0, ret_size);
+      return;
+    }
     assert(ret_size == _ret_size);
     if (ret_size) {
       memcpy(ret, _ret, ret_size);
@@ -4,7 +4,9 @@
 #include <sys/queue.h>
 #include <unordered_map>
 
+#include "access_tracker.hh"
 #include "key.hh"
+#include "key_map.hh"
 #include "worker_config.hh"
 
 class MwStubBase;
@@ -39,12 +41,8 @@ struct RPCBuf {
   uint8_t buf[RPC_MSG_BUF_SIZE];
 };
 
-typedef std::unordered_map<const Key *, MwStubBase *, _dr_key_hash,
-                           _dr_key_equal_to>
-    MwStubMap;
-typedef std::unordered_map<const Key *, MWSkeleton *, _dr_key_hash,
-                           _dr_key_equal_to>
-    MWSkeletonMap;
+typedef KeyMap<MwStubBase *> MwStubMap;
+typedef KeyMap<MWSkeleton *> MWSkeletonMap;
 
 struct MapIterator {
   bool is_valid = false;
@@ -70,6 +68,7 @@ class MwStubManager {
   MapIterator skeleton_iterator[_MAX_DMAPS][MAX_ITERATOR_CNT];
 
   TAILQ_HEAD(aggr_head, MWSkeleton) aggr_list;
+  TAILQ_HEAD(cache_lru_head, CacheReturn) cache_lru;  // stale rpc results
 
 #if 0
 	bool skeleton_export_reserve[_MAX_DMAPS];
@@ -90,6 +89,8 @@ class MwStubManager {
   ;
   MemPool *mp = nullptr;
 
+  AccessTracker access_tracker;  // rpcs to the skeletons I manage
+
   struct {
     bool dmz_to_scaling_on = false;
     bool dmz_to_quiescent_on = false;
@@ -100,9 +101,11 @@ class MwStubManager {
 
   inline bool send_rpc_message(WorkerID to, int map_id, const Key *key,
                                uint32_t flag, uint32_t method_id, void *args,
-                               uint32_t args_size);
+                               uint32_t args_size, uint32_t ret_size);
 
   CacheReturn *get_cache_return(int map_id, const Key *key, int method_id);
+  void delete_cache_return(CacheReturn *cache);
+  static size_t evict_cache_returns(void *arg, size_t bytes);
   RPCRequest *get_rpc_behind_message(WorkerID to, int msg_size);
 
   // might blocking until satisfying wake-up condition
@@ -128,6 +131,8 @@ class MwStubManager {
 
   void set_keyspace(KeySpace *key_space) { this->key_space = key_space; }
 
+  AccessTracker *get_access_tracker() { return &access_tracker; }
+
   void set_dmz_to_scaling_on() { this->scaling.dmz_to_scaling_on = true; }
 
   void set_dmz_to_scaling_off() { this->scaling.dmz_to_scaling_on = false; }
@@ -147,9 +152,9 @@ class MwStubManager {
   MwStubBase *lookup(int map_id, const Key *key);
   void release(int map_id, const Key *key);
 
-  void execute_rpc(int map_id, const Key *key, uint32_t flag,
-                   uint32_t method_id, void *args, void **ret,
-                   uint32_t *ret_size);
+  int execute_rpc(int map_id, const Key *key, uint32_t flag,
+                  uint32_t method_id, void *args, void **ret,
+                  uint32_t *ret_size);
   void request_rpc(int map_id, const Key *key, uint32_t flag,
                    uint32_t method_id, void *args, uint32_t args_size,
                    void *ret, uint32_t ret_size);
@@ -235,6 +235,19 @@ class ReferenceInterceptor {
     swstub_manager->delete_object(map_id, key, version);
   }
 
+  template <class X>
+  void set_idle_timeout(const SwRef<X> *ref, uint64_t ttl_us) {
+    if (!ref || ref->isConst())
+      return;
+
+    swstub_manager->set_idle_timeout(ref->getMapId(), ref->getKey(),
+                                     ref->getVersion(), ttl_us);
+  }
+
+  void prefetch_object(int map_id, const Key *key, bool is_const) {
+    swstub_manager->prefetch(map_id, key, is_const);
+  }
+
   int create_iterator(int map_id) {
     return mwstub_manager->create_local_iterator(map_id);
   }
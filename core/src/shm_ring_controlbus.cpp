@@ -0,0 +1,498 @@
+#include "shm_ring_controlbus.hh"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include "log.hh"
+
+#define SHM_CBUS_MAGIC 0x53364342  // "S6CB"
+#define SHM_ALIGN (2 * 1024 * 1024)
+#define SHM_WAIT_US (5 * 1000 * 1000)
+
+static const uint32_t chunk_size[SHM_NUM_CLASSES] = {512, 4096, 65536};
+static const uint32_t chunk_cnt[SHM_NUM_CLASSES] = {512, 128, 8};
+
+/* Shared part, at the beginning of the region */
+struct ShmRegionHeader {
+  std::atomic<uint32_t> magic;
+  uint64_t size;
+  std::atomic<uint64_t> addrs[SHM_MAX_SLOTS];  // 0 for an unused slot
+  std::atomic<uint32_t> active[SHM_MAX_SLOTS];
+  std::atomic<uint32_t> generation;  // bumped whenever a slot is taken
+};
+
+/* Precedes every MessageBuffer allocated in an arena */
+struct ShmChunkHeader {
+  uint32_t owner;
+  uint32_t cls;
+  uint32_t in_use;  // allocated and not back yet; only the owner writes it
+  uint32_t pad;
+};
+
+/* Process-local view of the region */
+struct ShmRegion {
+  uint8_t *base;
+  uint64_t size;
+  ShmRegionHeader *hdr;
+  ShmMsgRing *msg_rings;  // [from * SHM_MAX_SLOTS + to]
+  ShmRetRing *ret_rings;  // [from * SHM_MAX_SLOTS + owner]
+  uint8_t *arenas;
+  uint64_t arena_size;  // per slot
+
+  ShmMsgRing *msg_ring(int from, int to) {
+    return &msg_rings[from * SHM_MAX_SLOTS + to];
+  }
+  ShmRetRing *ret_ring(int from, int owner) {
+    return &ret_rings[from * SHM_MAX_SLOTS + owner];
+  }
+  uint64_t chunk_offset(int slot, int cls, uint32_t idx) {
+    uint64_t off = (arenas - base) + slot * arena_size;
+    for (int i = 0; i < cls; i++)
+      off += (uint64_t)chunk_size[i] * chunk_cnt[i];
+    return off + (uint64_t)idx * chunk_size[cls];
+  }
+};
+
+static uint64_t align_up(uint64_t v, uint64_t align) {
+  return (v + align - 1) / align * align;
+}
+
+static uint64_t addr_key(const WorkerAddress &addr) {
+  return (1ULL << 63) | ((uint64_t)addr.get_ip_addr() << 16) |
+         addr.get_port();
+}
+
+static void layout_region(ShmRegion *r, uint8_t *base) {
+  uint64_t msg_off = align_up(sizeof(ShmRegionHeader), CACHE_LINE_SIZE);
+  uint64_t ret_off =
+      msg_off + sizeof(ShmMsgRing) * SHM_MAX_SLOTS * SHM_MAX_SLOTS;
+  uint64_t arena_off =
+      align_up(ret_off + sizeof(ShmRetRing) * SHM_MAX_SLOTS * SHM_MAX_SLOTS,
+               CACHE_LINE_SIZE);
+
+  r->arena_size = 0;
+  for (int i = 0; i < SHM_NUM_CLASSES; i++)
+    r->arena_size += (uint64_t)chunk_size[i] * chunk_cnt[i];
+
+  r->size = align_up(arena_off + r->arena_size * SHM_MAX_SLOTS, SHM_ALIGN);
+
+  r->base = base;
+  if (!base)
+    return;  // only the size is needed
+
+  r->hdr = reinterpret_cast<ShmRegionHeader *>(base);
+  r->msg_rings = reinterpret_cast<ShmMsgRing *>(base + msg_off);
+  r->ret_rings = reinterpret_cast<ShmRetRing *>(base + ret_off);
+  r->arenas = base + arena_off;
+}
+
+static const char *region_path() {
+  struct statfs fs;
+  if (statfs("/dev/hugepages", &fs) == 0 && fs.f_type == HUGETLBFS_MAGIC)
+    return SHM_CBUS_PATH_HUGEPAGE;
+
+  return SHM_CBUS_PATH_SHM;
+}
+
+/* The first process creates and initializes the file, the others wait */
+static ShmRegion *map_region() {
+  static std::mutex mutex;
+  static ShmRegion *region = nullptr;
+  static bool failed = false;
+
+  std::lock_guard<std::mutex> lck(mutex);
+  if (region || failed)
+    return region;
+
+  ShmRegion r;
+  layout_region(&r, nullptr);
+
+  const char *path = region_path();
+  bool creator = true;
+  int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0666);
+  if (fd < 0 && errno == EEXIST) {
+    creator = false;
+    fd = open(path, O_RDWR);
+  }
+  if (fd < 0) {
+    DEBUG_ERR("Fail to open " << path << ": " << strerror(errno));
+    failed = true;
+    return nullptr;
+  }
+
+  if (creator) {
+    if (ftruncate(fd, r.size) < 0) {
+      DEBUG_ERR("Fail to resize " << path << ": " << strerror(errno));
+      close(fd);
+      unlink(path);
+      failed = true;
+      return nullptr;
+    }
+  } else {
+    struct stat st;
+    int waited = 0;
+    while (fstat(fd, &st) == 0 && (uint64_t)st.st_size < r.size &&
+           waited < SHM_WAIT_US) {
+      usleep(1000);
+      waited += 1000;
+    }
+    if ((uint64_t)st.st_size != r.size) {
+      DEBUG_ERR(path << " has a different layout; remove it and restart");
+      close(fd);
+      failed = true;
+      return nullptr;
+    }
+  }
+
+  void *base = mmap(nullptr, r.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    DEBUG_ERR("Fail to map " << path << ": " << strerror(errno));
+    failed = true;
+    return nullptr;
+  }
+
+  layout_region(&r, static_cast<uint8_t *>(base));
+
+  if (creator) {
+    r.hdr->size = r.size;
+    for (int i = 0; i < SHM_MAX_SLOTS; i++) {
+      r.hdr->addrs[i].store(0, std::memory_order_relaxed);
+      r.hdr->active[i].store(0, std::memory_order_relaxed);
+    }
+    r.hdr->generation.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < SHM_MAX_SLOTS * SHM_MAX_SLOTS; i++) {
+      r.msg_rings[i].init();
+      r.ret_rings[i].init();
+    }
+    r.hdr->magic.store(SHM_CBUS_MAGIC, std::memory_order_release);
+  } else {
+    int waited = 0;
+    while (r.hdr->magic.load(std::memory_order_acquire) != SHM_CBUS_MAGIC &&
+           waited < SHM_WAIT_US) {
+      usleep(1000);
+      waited += 1000;
+    }
+    if (r.hdr->magic.load(std::memory_order_acquire) != SHM_CBUS_MAGIC) {
+      DEBUG_ERR(path << " is not initialized; remove it and restart");
+      munmap(base, r.size);
+      failed = true;
+      return nullptr;
+    }
+  }
+
+  DEBUG_WRK("Shared control bus region " << path << " (" << r.size
+                                         << " bytes) is mapped");
+
+  region = new ShmRegion(r);
+  return region;
+}
+
+ShmRingControlBus::ShmRingControlBus() {
+  tcp = new TCPControlBus();
+}
+
+ShmRingControlBus::~ShmRingControlBus() {
+  delete tcp;
+}
+
+MessageBuffer *ShmRingControlBus::allocate_message(
+    const std::size_t messageSize) const {
+  std::size_t need =
+      sizeof(ShmChunkHeader) + sizeof(MessageBuffer) + messageSize;
+
+  if (my_slot < 0)
+    return tcp->allocate_message(messageSize);
+
+  for (int cls = 0; cls < SHM_NUM_CLASSES; cls++) {
+    if (chunk_size[cls] < need)
+      continue;
+
+    if (free_chunks[cls].empty())
+      reclaim_chunks();
+    if (free_chunks[cls].empty())
+      continue;  // try a larger chunk
+
+    uint64_t off = free_chunks[cls].back();
+    free_chunks[cls].pop_back();
+
+    ShmChunkHeader *chdr =
+        reinterpret_cast<ShmChunkHeader *>(region->base + off);
+    chdr->owner = my_slot;
+    chdr->cls = cls;
+    chdr->in_use = 1;
+
+    MessageBuffer *ret = reinterpret_cast<MessageBuffer *>(chdr + 1);
+    ret->body_offset = 0;
+    ret->body_size = messageSize;
+    return ret;
+  }
+
+  // too large or arena exhausted
+  return tcp->allocate_message(messageSize);
+}
+
+MessageBuffer *ShmRingControlBus::init_message(uint8_t *buf,
+                                               std::size_t buf_size) const {
+  // never sent as is (only allocate_message()ed buffers are), so tcp format
+  return tcp->init_message(buf, buf_size);
+}
+
+bool ShmRingControlBus::is_shm_message(const MessageBuffer *m) const {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(m);
+  return region && p >= region->arenas && p < region->base + region->size;
+}
+
+void ShmRingControlBus::free_message(MessageBuffer *m) const {
+  if (!is_shm_message(m)) {
+    tcp->free_message(m);
+    return;
+  }
+
+  ShmChunkHeader *chdr = reinterpret_cast<ShmChunkHeader *>(m) - 1;
+  uint64_t off = reinterpret_cast<uint8_t *>(chdr) - region->base;
+
+  if ((int)chdr->owner == my_slot) {
+    chdr->in_use = 0;
+    free_chunks[chdr->cls].push_back(off);
+    return;
+  }
+
+  // never full: the owner has less chunks than the ring has entries
+  bool ret = region->ret_ring(my_slot, chdr->owner)->push(off);
+  assert(ret);
+  (void)ret;
+}
+
+/* Chunks freed by the receivers come back through the return rings */
+void ShmRingControlBus::reclaim_chunks() const {
+  for (int from = 0; from < SHM_MAX_SLOTS; from++) {
+    ShmRetRing *ring = region->ret_ring(from, my_slot);
+    uint64_t off;
+
+    while (ring->pop(&off)) {
+      ShmChunkHeader *chdr =
+          reinterpret_cast<ShmChunkHeader *>(region->base + off);
+      chdr->in_use = 0;
+      free_chunks[chdr->cls].push_back(off);
+    }
+  }
+}
+
+/*
+ * XXX messages in flight to a previous owner of the slot are given back
+ * unread, i.e., lost.
+ *
+ * Chunks of the slot that a previous owner sent are still in use: in the
+ * rings of the peers, or held by them. They are not free until they come
+ * back through the return rings, so the free list is rebuilt only from the
+ * chunks marked free, and the others are reclaimed when they come back.
+ */
+void ShmRingControlBus::reset_slot(int slot) {
+  for (int from = 0; from < SHM_MAX_SLOTS; from++) {
+    ShmMsgRing *ring = region->msg_ring(from, slot);
+    uint64_t off;
+
+    while (ring->pop(&off)) {
+      ShmChunkHeader *chdr =
+          reinterpret_cast<ShmChunkHeader *>(region->base + off);
+      if ((int)chdr->owner != slot)
+        region->ret_ring(slot, chdr->owner)->push(off);
+      else
+        chdr->in_use = 0;
+    }
+
+    while (region->ret_ring(from, slot)->pop(&off))
+      reinterpret_cast<ShmChunkHeader *>(region->base + off)->in_use = 0;
+  }
+
+  for (int cls = 0; cls < SHM_NUM_CLASSES; cls++) {
+    free_chunks[cls].clear();
+    for (uint32_t i = 0; i < chunk_cnt[cls]; i++) {
+      uint64_t off = region->chunk_offset(slot, cls, i);
+      if (!reinterpret_cast<ShmChunkHeader *>(region->base + off)->in_use)
+        free_chunks[cls].push_back(off);
+    }
+  }
+}
+
+Connector *ShmRingControlBus::register_address(const WorkerAddress &addr) {
+  if (tcp_sock) {
+    DEBUG_DEV("shm control bus is already registered");
+    return nullptr;
+  }
+
+  // remote peers reach us over tcp anyway
+  tcp_sock = tcp->register_address(addr);
+  if (!tcp_sock)
+    return nullptr;
+
+  region = map_region();
+  if (!region) {
+    DEBUG_WARN("Shared memory is not available, fall back to tcp");
+    return allocate_connector(addr);
+  }
+
+  uint64_t key = addr_key(addr);
+  int slot = -1;
+
+  // reuse the slot if the address was registered before (e.g., restart)
+  for (int i = 0; i < SHM_MAX_SLOTS && slot < 0; i++)
+    if (region->hdr->addrs[i].load(std::memory_order_acquire) == key)
+      slot = i;
+
+  for (int i = 0; i < SHM_MAX_SLOTS && slot < 0; i++) {
+    uint64_t empty = 0;
+    if (region->hdr->addrs[i].compare_exchange_strong(empty, key))
+      slot = i;
+  }
+
+  if (slot < 0) {
+    DEBUG_WARN("No shared memory slot for " << addr << ", fall back to tcp");
+    return allocate_connector(addr);
+  }
+
+  reset_slot(slot);
+  my_slot = slot;
+  region->hdr->active[slot].store(1, std::memory_order_release);
+  region->hdr->generation.fetch_add(1, std::memory_order_release);
+
+  DEBUG_WRK("Shared memory slot " << slot << " for " << addr);
+
+  return allocate_connector(addr);
+}
+
+int ShmRingControlBus::lookup_slot(const WorkerAddress &addr) {
+  auto iter = peer_slots.find(addr);
+  if (iter != peer_slots.end() && iter->second >= 0)
+    return iter->second;
+
+  // peers not found before are looked up again once a slot is taken
+  uint32_t gen = region->hdr->generation.load(std::memory_order_acquire);
+  if (iter != peer_slots.end() && gen == peer_slots_gen)
+    return -1;
+
+  if (gen != peer_slots_gen) {
+    for (auto it = peer_slots.begin(); it != peer_slots.end();) {
+      if (it->second < 0)
+        it = peer_slots.erase(it);
+      else
+        ++it;
+    }
+    peer_slots_gen = gen;
+  }
+
+  // a peer not found here goes over tcp, which works for local peers as well
+  uint64_t key = addr_key(addr);
+  int slot = -1;
+  for (int i = 0; i < SHM_MAX_SLOTS; i++) {
+    if (region->hdr->addrs[i].load(std::memory_order_acquire) == key) {
+      slot = i;
+      break;
+    }
+  }
+
+  peer_slots[addr] = slot;
+  return slot;
+}
+
+bool ShmRingControlBus::send_tcp(MessageBuffer *message,
+                                 const WorkerAddress &to) {
+  std::size_t body_size = message->body_size;
+
+  if (!is_shm_message(message)) {
+    if (!tcp_sock->send(message, to))
+      return false;
+
+    stats.send_bytes += body_size;
+    return true;
+  }
+
+  MessageBuffer *copy = tcp->allocate_message(body_size);
+  memcpy(copy->buf + copy->body_offset, message->get_message_body(), body_size);
+
+  if (!tcp_sock->send(copy, to)) {
+    tcp->free_message(copy);
+    return false;
+  }
+
+  free_message(message);
+  stats.send_bytes += body_size;
+  return true;
+}
+
+bool ShmRingControlBus::send(MessageBuffer *message, const WorkerAddress &from,
+                             const WorkerAddress &to) {
+  if (!message)
+    return false;
+
+  int to_slot = (my_slot >= 0) ? lookup_slot(to) : -1;
+  if (to_slot < 0 || !is_shm_message(message))
+    return send_tcp(message, to);
+
+  // the peer has left (or is restarting); tcp tells whether it is gone
+  if (!region->hdr->active[to_slot].load(std::memory_order_acquire))
+    return send_tcp(message, to);
+
+  // the receiver may free the message as soon as it is pushed
+  std::size_t body_size = message->body_size;
+  uint64_t off = reinterpret_cast<uint8_t *>(message) - region->base -
+                 sizeof(ShmChunkHeader);
+
+  if (!region->msg_ring(my_slot, to_slot)->push(off))
+    return false;
+
+  stats.send_bytes += body_size;
+  return true;
+}
+
+MessageBuffer *ShmRingControlBus::receive(const WorkerAddress &me) {
+  if (my_slot >= 0) {
+    for (int i = 0; i < SHM_MAX_SLOTS; i++) {
+      int from = (next_poll + i) % SHM_MAX_SLOTS;
+      uint64_t off;
+
+      if (region->msg_ring(from, my_slot)->pop(&off)) {
+        next_poll = (from + 1) % SHM_MAX_SLOTS;
+
+        MessageBuffer *ret = reinterpret_cast<MessageBuffer *>(
+            region->base + off + sizeof(ShmChunkHeader));
+        stats.recv_bytes += ret->body_size;
+        return ret;
+      }
+    }
+  }
+
+  if (!tcp_sock)
+    return nullptr;
+
+  MessageBuffer *ret = tcp_sock->receive();
+  if (ret)
+    stats.recv_bytes += ret->body_size;
+  return ret;
+}
+
+void ShmRingControlBus::unregister_address(const WorkerAddress &addr) {
+  if (my_slot >= 0) {
+    region->hdr->active[my_slot].store(0, std::memory_order_release);
+    reset_slot(my_slot);
+    my_slot = -1;
+  }
+
+  peer_slots.clear();
+
+  if (tcp_sock) {
+    delete tcp_sock;
+    tcp_sock = nullptr;
+  }
+}
@@ -0,0 +1,87 @@
+#ifndef _DISTREF_SHM_RING_CONTROL_BUS_HH_
+#define _DISTREF_SHM_RING_CONTROL_BUS_HH_
+
+#include <unordered_map>
+#include <vector>
+
+#include "controlbus.hh"
+#include "spsc_ring.hh"
+#include "tcp_controlbus.hh"
+#include "worker_address.hh"
+#include "worker_config.hh"
+
+#define SHM_CBUS_PATH_HUGEPAGE "/dev/hugepages/s6_cbus"
+#define SHM_CBUS_PATH_SHM "/dev/shm/s6_cbus"
+
+#define SHM_MAX_SLOTS MAX_WORKER_CNT
+#define SHM_MSG_RING_SIZE 256
+#define SHM_RET_RING_SIZE 1024  // > chunks per slot, so it never overflows
+#define SHM_NUM_CLASSES 3
+
+// rings carry offsets from the region base, as every process maps it elsewhere
+typedef SpscRing<uint64_t, SHM_MSG_RING_SIZE> ShmMsgRing;
+typedef SpscRing<uint64_t, SHM_RET_RING_SIZE> ShmRetRing;
+
+struct ShmRegion;
+
+/*
+ * Control bus between worker processes of the same host
+ *
+ * All processes map one file of a hugetlbfs (or /dev/shm if hugepages are not
+ * mounted). Every registered address gets a slot with
+ *  - a private arena of message chunks, allocated only by the slot owner,
+ *  - message rings [from][to] carrying the offset of a chunk, and
+ *  - return rings [from][owner] that give a freed chunk back to its owner.
+ * Message bodies are never copied; the receiver reads the chunk in place and
+ * free_message() returns it to the sender.
+ *
+ * Peers that are not in the slot table (i.e., on other hosts), and messages
+ * that do not fit in a chunk, go through an embedded TCPControlBus, which also
+ * listens on the registered address.
+ *
+ * NOTE:
+ * - One instance per worker; the instance must be used by a single thread.
+ * - Remove the file when the layout changes (e.g., after MAX_WORKER_CNT does).
+ */
+class ShmRingControlBus : public ControlBus {
+ private:
+  TCPControlBus *tcp;
+  Connector *tcp_sock = nullptr;
+
+  ShmRegion *region = nullptr;
+  int my_slot = -1;
+  int next_poll = 0;  // round-robin over the sender rings
+
+  // chunks of my arena that are free, per size class (only I allocate them)
+  mutable std::vector<uint64_t> free_chunks[SHM_NUM_CLASSES];
+
+  // resolved peer slots, so that the shared table is scanned once per peer
+  // (and for a peer without a slot, once per slot table change)
+  std::unordered_map<WorkerAddress, int> peer_slots;
+  uint32_t peer_slots_gen = 0;
+
+  int lookup_slot(const WorkerAddress &addr);
+  void reset_slot(int slot);
+  void reclaim_chunks() const;
+  bool is_shm_message(const MessageBuffer *m) const;
+  bool send_tcp(MessageBuffer *message, const WorkerAddress &to);
+
+ public:
+  ShmRingControlBus();
+  virtual ~ShmRingControlBus();
+
+ public:
+  virtual Connector *register_address(const WorkerAddress &addr);
+  virtual MessageBuffer *allocate_message(const std::size_t messageSize) const;
+  virtual MessageBuffer *init_message(uint8_t *buf, std::size_t buf_size) const;
+  virtual void free_message(MessageBuffer *message) const;
+
+ private:
+  virtual bool send(MessageBuffer *message, const WorkerAddress &from,
+                    const WorkerAddress &to);
+  virtual MessageBuffer *receive(const WorkerAddress &me);
+
+  virtual void unregister_address(const WorkerAddress &worker);
+};
+
+#endif /* _DISTREF_SHM_RING_CONTROL_BUS_HH_ */
@@ -0,0 +1,217 @@
+#include "spsc_controlbus.hh"
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <mutex>
+
+#include "log.hh"
+
+/* Process-wide slot table and ring matrix shared by all instances */
+static struct SpscMatrix {
+  std::mutex mutex;  // serializes registrations only
+  std::atomic<int> slot_cnt;
+  WorkerAddress addrs[MAX_SPSC_SLOTS];
+  std::atomic<bool> active[MAX_SPSC_SLOTS];
+  MessageRing *rings;  // [from * MAX_SPSC_SLOTS + to]
+
+  SpscMatrix() : slot_cnt(0), rings(nullptr) {
+    for (int i = 0; i < MAX_SPSC_SLOTS; i++)
+      active[i] = false;
+  }
+
+  MessageRing *get_ring(int from, int to) {
+    return &rings[from * MAX_SPSC_SLOTS + to];
+  }
+} matrix;
+
+static int alloc_rings() {
+  void *p;
+  size_t size = sizeof(MessageRing) * MAX_SPSC_SLOTS * MAX_SPSC_SLOTS;
+  if (posix_memalign(&p, CACHE_LINE_SIZE, size) != 0)
+    return -1;
+
+  matrix.rings = static_cast<MessageRing *>(p);
+  for (int i = 0; i < MAX_SPSC_SLOTS * MAX_SPSC_SLOTS; i++)
+    matrix.rings[i].init();
+
+  return 0;
+}
+
+SpscControlBus::SpscControlBus() {
+  tcp = new TCPControlBus();
+}
+
+SpscControlBus::~SpscControlBus() {
+  delete tcp;
+}
+
+MessageBuffer *SpscControlBus::allocate_message(
+    const std::size_t messageSize) const {
+  return tcp->allocate_message(messageSize);
+}
+
+MessageBuffer *SpscControlBus::init_message(uint8_t *buf,
+                                            std::size_t buf_size) const {
+  return tcp->init_message(buf, buf_size);
+}
+
+// from a ring, a message is one allocate_message()ed by the sender
+void SpscControlBus::free_message(MessageBuffer *message) const {
+  tcp->free_message(message);
+}
+
+Connector *SpscControlBus::register_address(const WorkerAddress &addr) {
+  if (tcp_sock) {
+    DEBUG_DEV("spsc control bus is already registered");
+    return nullptr;
+  }
+
+  // peers of other processes reach us over tcp
+  tcp_sock = tcp->register_address(addr);
+  if (!tcp_sock)
+    return nullptr;
+
+  std::lock_guard<std::mutex> g_lck(matrix.mutex);
+
+  if (!matrix.rings && alloc_rings() < 0) {
+    DEBUG_WARN("Fail to allocate spsc rings, fall back to tcp");
+    return allocate_connector(addr);
+  }
+
+  int slot_cnt = matrix.slot_cnt.load(std::memory_order_relaxed);
+  int slot;
+  for (slot = 0; slot < slot_cnt; slot++)
+    if (matrix.addrs[slot] == addr)
+      break;
+
+  if (slot < slot_cnt && matrix.active[slot]) {
+    DEBUG_ERR("address " << addr << " is already in use");
+    delete tcp_sock;
+    tcp_sock = nullptr;
+    return nullptr;
+  }
+
+  if (slot == slot_cnt) {
+    if (slot_cnt == MAX_SPSC_SLOTS) {
+      DEBUG_WARN("No spsc slot for " << addr << ", fall back to tcp");
+      return allocate_connector(addr);
+    }
+    matrix.addrs[slot] = addr;
+    matrix.slot_cnt.store(slot_cnt + 1, std::memory_order_release);
+  }
+
+  matrix.active[slot].store(true, std::memory_order_release);
+  my_slot = slot;
+
+  DEBUG_WRK("Spsc slot " << slot << " for " << addr);
+
+  return allocate_connector(addr);
+}
+
+int SpscControlBus::lookup_slot(const WorkerAddress &addr) {
+  int slot_cnt = matrix.slot_cnt.load(std::memory_order_acquire);
+
+  // a peer not found is looked up again once a slot is added
+  auto iter = peer_slots.find(addr);
+  if (iter != peer_slots.end() &&
+      (iter->second >= 0 || slot_cnt == peer_slots_cnt))
+    return iter->second;
+
+  if (slot_cnt != peer_slots_cnt) {
+    for (auto it = peer_slots.begin(); it != peer_slots.end();) {
+      if (it->second < 0)
+        it = peer_slots.erase(it);
+      else
+        ++it;
+    }
+    peer_slots_cnt = slot_cnt;
+  }
+
+  for (int slot = 0; slot < slot_cnt; slot++) {
+    if (matrix.addrs[slot] == addr) {
+      peer_slots[addr] = slot;
+      return slot;
+    }
+  }
+
+  peer_slots[addr] = -1;  // not registered (yet), or of another process
+  return -1;
+}
+
+bool SpscControlBus::send(MessageBuffer *message, const WorkerAddress &from,
+                          const WorkerAddress &to) {
+  if (!message)
+    return false;
+
+  assert(my_slot < 0 || matrix.addrs[my_slot] == from);
+
+  // not in this process, or left it
+  int to_slot = (my_slot >= 0) ? lookup_slot(to) : -1;
+  if (to_slot < 0 || !matrix.active[to_slot].load(std::memory_order_acquire)) {
+    std::size_t body_size = message->body_size;
+    if (!tcp_sock->send(message, to))
+      return false;
+
+    stats.send_bytes += body_size;
+    return true;
+  }
+
+  // the receiver may free the message as soon as it is pushed
+  std::size_t body_size = message->body_size;
+  if (!matrix.get_ring(my_slot, to_slot)->push(message))
+    return false;
+
+  stats.send_bytes += body_size;
+  return true;
+}
+
+MessageBuffer *SpscControlBus::receive(const WorkerAddress &me) {
+  if (my_slot >= 0) {
+    int slot_cnt = matrix.slot_cnt.load(std::memory_order_acquire);
+    if (next_poll >= slot_cnt)
+      next_poll = 0;
+
+    for (int i = 0; i < slot_cnt; i++) {
+      int from = (next_poll + i) % slot_cnt;
+      MessageBuffer *ret;
+
+      if (matrix.get_ring(from, my_slot)->pop(&ret)) {
+        next_poll = (from + 1) % slot_cnt;
+        stats.recv_bytes += ret->body_size;
+        return ret;
+      }
+    }
+  }
+
+  if (!tcp_sock)
+    return nullptr;
+
+  MessageBuffer *ret = tcp_sock->receive();
+  if (ret)
+    stats.recv_bytes += ret->body_size;
+  return ret;
+}
+
+// XXX messages sent to this address before it is unregistered are dropped
+void SpscControlBus::unregister_address(const WorkerAddress &addr) {
+  if (my_slot >= 0) {
+    matrix.active[my_slot].store(false, std::memory_order_release);
+
+    int slot_cnt = matrix.slot_cnt.load(std::memory_order_acquire);
+    for (int from = 0; from < slot_cnt; from++) {
+      MessageBuffer *m;
+      while (matrix.get_ring(from, my_slot)->pop(&m))
+        free_message(m);
+    }
+
+    my_slot = -1;
+  }
+
+  peer_slots.clear();
+
+  if (tcp_sock) {
+    delete tcp_sock;
+    tcp_sock = nullptr;
+  }
+}
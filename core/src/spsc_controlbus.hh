@@ -0,0 +1,67 @@
+#ifndef _DISTREF_SPSC_CONTROL_BUS_HH_
+#define _DISTREF_SPSC_CONTROL_BUS_HH_
+
+#include <unordered_map>
+
+#include "controlbus.hh"
+#include "spsc_ring.hh"
+#include "tcp_controlbus.hh"
+#include "worker_address.hh"
+#include "worker_config.hh"
+
+#define SPSC_RING_SIZE 1024
+#define MAX_SPSC_SLOTS MAX_WORKER_CNT
+
+typedef SpscRing<MessageBuffer *, SPSC_RING_SIZE> MessageRing;
+
+/*
+ * Control bus between workers of the same process (e.g., one worker per lcore)
+ *
+ * Every registered address gets a slot of a process-wide matrix of rings;
+ * ring [from][to] has exactly one producer and one consumer, so send() and
+ * receive() take no lock. Messages are passed by pointer: send() takes the
+ * ownership and the receiver frees the message.
+ *
+ * Peers without a slot (i.e., in other processes or on other hosts) are
+ * reached through an embedded TCPControlBus, which also listens on the
+ * registered address. Messages are allocated in its format, so that either
+ * way takes them as they are.
+ *
+ * NOTE:
+ * - One instance per worker; the instance must be used by a single thread.
+ * - Slots are never recycled, an address registered again gets its old slot.
+ */
+class SpscControlBus : public ControlBus {
+ private:
+  TCPControlBus *tcp;
+  Connector *tcp_sock = nullptr;
+
+  int my_slot = -1;
+  int next_poll = 0;  // round-robin over the sender rings
+
+  // resolved peer slots, so that the shared table is scanned once per peer
+  // (and for a peer without a slot, once per slot added)
+  std::unordered_map<WorkerAddress, int> peer_slots;
+  int peer_slots_cnt = 0;
+
+  int lookup_slot(const WorkerAddress &addr);
+
+ public:
+  SpscControlBus();
+  virtual ~SpscControlBus();
+
+ public:
+  virtual Connector *register_address(const WorkerAddress &addr);
+  virtual MessageBuffer *allocate_message(const std::size_t messageSize) const;
+  virtual MessageBuffer *init_message(uint8_t *buf, std::size_t buf_size) const;
+  virtual void free_message(MessageBuffer *message) const;
+
+ private:
+  virtual bool send(MessageBuffer *message, const WorkerAddress &from,
+                    const WorkerAddress &to);
+  virtual MessageBuffer *receive(const WorkerAddress &me);
+
+  virtual void unregister_address(const WorkerAddress &worker);
+};
+
+#endif /* _DISTREF_SPSC_CONTROL_BUS_HH_ */
@@ -0,0 +1,76 @@
+#ifndef _DISTREF_SPSC_RING_HH_
+#define _DISTREF_SPSC_RING_HH_
+
+#include <atomic>
+#include <cstdint>
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Bounded single-producer single-consumer ring.
+ *
+ * head is only written by the consumer and tail only by the producer, each
+ * on its own cache line together with the side's cached copy of the other
+ * index, so that a push/pop touches the shared line only when the cached
+ * index says the ring looks full/empty.
+ *
+ * It has no pointers inside and std::atomic<uint32_t> is lock-free, so a ring
+ * can also be placed in memory shared between processes (call init() once).
+ */
+template <typename T, uint32_t SIZE>
+struct SpscRing {
+  static_assert((SIZE & (SIZE - 1)) == 0, "ring size must be a power of 2");
+
+  // consumer side
+  alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> head;
+  uint32_t cached_tail;
+
+  // producer side
+  alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> tail;
+  uint32_t cached_head;
+
+  alignas(CACHE_LINE_SIZE) T slots[SIZE];
+
+  void init() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    cached_tail = 0;
+    cached_head = 0;
+  }
+
+  // producer only
+  bool push(const T &v) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - cached_head == SIZE) {
+      cached_head = head.load(std::memory_order_acquire);
+      if (t - cached_head == SIZE)
+        return false;
+    }
+
+    slots[t & (SIZE - 1)] = v;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer only
+  bool pop(T *v) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h == cached_tail) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (h == cached_tail)
+        return false;
+    }
+
+    *v = slots[h & (SIZE - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // approximate unless called by one of the two sides
+  uint32_t size() const {
+    return tail.load(std::memory_order_acquire) -
+           head.load(std::memory_order_acquire);
+  }
+};
+
+#endif /* _DISTREF_SPSC_RING_HH_ */
@@ -8,6 +8,7 @@ const char *__global_dobj_name[_MAX_DMAPS];
 swstub_creator __global_swstub_creator[_MAX_DMAPS] = {0};
 mwstub_creator __global_mwstub_creator[_MAX_DMAPS] = {0};
 mwskeleton_creator __global_mwskeleton_creator[_MAX_DMAPS] = {0};
+sw_expire_func __global_sw_expire_func[_MAX_DMAPS] = {0};
 
 int __register_map(DObjType objtype, size_t size, const char *name) {
   int map_id = num_dmap++;
@@ -29,3 +30,7 @@ void __register_mwstub_creator(int map_id, mwstub_creator fn) {
 void __register_mwskeleton_creator(int map_id, mwskeleton_creator fn) {
   __global_mwskeleton_creator[map_id] = fn;
 };
+
+void __register_sw_expire_func(int map_id, sw_expire_func fn) {
+  __global_sw_expire_func[map_id] = fn;
+};
@@ -19,6 +19,7 @@ typedef MwStubBase *(*mwstub_creator)(int map_id, const Key *,
                                       MwStubManager *mng);
 typedef MWSkeleton *(*mwskeleton_creator)(int map_id, const Key *, void *obj,
                                           bool init);
+typedef void (*sw_expire_func)(const Key *, const SWObject *obj);
 
 extern int num_dmap;
 extern DObjType __global_dobj_type[_MAX_DMAPS];
@@ -27,6 +28,7 @@ extern const char *__global_dobj_name[_MAX_DMAPS];
 extern swstub_creator __global_swstub_creator[_MAX_DMAPS];
 extern mwstub_creator __global_mwstub_creator[_MAX_DMAPS];
 extern mwskeleton_creator __global_mwskeleton_creator[_MAX_DMAPS];
+extern sw_expire_func __global_sw_expire_func[_MAX_DMAPS];
 
 class StubFactory {
  private:
@@ -102,5 +104,6 @@ int __register_map(DObjType objtype, size_t size, const char *name);
 void __register_swstub_creator(int map_id, swstub_creator fn);
 void __register_mwstub_creator(int map_id, mwstub_creator fn);
 void __register_mwskeleton_creator(int map_id, mwskeleton_creator fn);
+void __register_sw_expire_func(int map_id, sw_expire_func fn);
 
 #endif
@@ -21,8 +21,10 @@ class SwMap {
   int map_id;
 
  public:
-  SwMap(const char *name) {
+  // codegen passes KEY_OPS(X) if X has equal_to()
+  SwMap(const char *name, KeyOps key_ops = KEY_OPS_GENERIC) {
     this->map_id = __register_map(Y::GetObjectType(), sizeof(Y), name);
+    __register_key_ops(map_id, key_ops);
     __register_swstub_creator(map_id, SwStub<Y>::CreateSwStub);
   }
 
@@ -43,12 +45,32 @@ class SwMap {
     return SwRef<Y>(map_id, key, state);
   }
 
+  // the object is removed after ttl_us without another create() with ttl
+  // (an idle timeout), unless a reference is held at that time
+  SwRef<Y> create(X* key, RefState& state, uint64_t ttl_us) {
+    SwRef<Y> ref(map_id, key, state);
+    if (ref.get())
+      HOOK->set_idle_timeout(&ref, ttl_us);
+    return ref;
+  }
+
+  // called with the object before it is removed by the idle timeout, on the
+  // worker that has it; it must not take references, since it cannot block
+  void set_expire_func(sw_expire_func fn) {
+    __register_sw_expire_func(map_id, fn);
+  }
+
   SwRef<Y> get(X* key) { return SwRef<Y>(map_id, key); }
 
   SwRef<Y> lookup(X* key) { return SwRef<Y>(map_id, key, false); }
 
   const SwRef<Y> lookup_const(X* key) { return SwRef<Y>(map_id, key, true); }
 
+  // from a key_extract_func: requests the object for a later create() or
+  // get() (prefetch_const(): lookup_const()) of the key, without blocking
+  void prefetch(X* key) { HOOK->prefetch_object(map_id, key, false); }
+  void prefetch_const(X* key) { HOOK->prefetch_object(map_id, key, true); }
+
   void remove(SwRef<Y>& r) { r.delete_object(); }
 };
 
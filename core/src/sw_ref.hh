@@ -30,6 +30,7 @@ class SwRef {
     /* we don't know whether the reference is const or not */
     map_id = -1;
     key = nullptr;
+    key_inline = false;
     is_const = true;
     is_registered = false;
     ref_p = nullptr;
@@ -42,6 +43,7 @@ class SwRef {
 
     map_id = -1;
     key = nullptr;
+    key_inline = false;
 
     if (object == nullptr) {
       is_const = true;
@@ -58,10 +60,10 @@ class SwRef {
 
   // Create a reference for 'new object'
   SwRef(int mid, const Key* k, RefState& state)
-      : map_id(mid), key(k->clone()), is_const(false) {
-    // XXX clonning every key might be inefficient :(
-    DEBUG_REF("default constructor " << this << "[" << map_id << ":" << key
-                                     << "]"
+      : map_id(mid), key(nullptr), key_inline(false), is_const(false) {
+    set_key(k);
+    DEBUG_REF("default constructor " << this << "[" << map_id << ":"
+                                     << getKey() << "]"
                                      << " is_const " << is_const);
 
     ref_p = HOOK->create_object(this, state);
@@ -72,10 +74,11 @@ class SwRef {
   }
 
   // Create a reference for 'object', if the object doesn't exist, create it
-  SwRef(int mid, const Key* k) : map_id(mid), key(k->clone()), is_const(false) {
-    // XXX clonning every key might be inefficient :(
-    DEBUG_REF("default constructor " << this << "[" << map_id << ":" << key
-                                     << "]"
+  SwRef(int mid, const Key* k)
+      : map_id(mid), key(nullptr), key_inline(false), is_const(false) {
+    set_key(k);
+    DEBUG_REF("default constructor " << this << "[" << map_id << ":"
+                                     << getKey() << "]"
                                      << " is_const " << is_const);
 
     ref_p = HOOK->get_object(this);
@@ -87,10 +90,10 @@ class SwRef {
 
   // lookup a reference for 'existing objects'
   SwRef(int mid, const Key* k, bool _is_const)
-      : map_id(mid), key(k->clone()), is_const(_is_const) {
-    // XXX clonning every key might be inefficient :(
-    DEBUG_REF("default constructor " << this << "[" << map_id << ":" << key
-                                     << "]"
+      : map_id(mid), key(nullptr), key_inline(false), is_const(_is_const) {
+    set_key(k);
+    DEBUG_REF("default constructor " << this << "[" << map_id << ":"
+                                     << getKey() << "]"
                                      << " is_const " << is_const);
 
     ref_p = HOOK->lookup_object(this);
@@ -101,20 +104,19 @@ class SwRef {
   }
 
   SwRef(const SwRef& r) {
-    DEBUG_REF("copy constructor " << this << "[" << r.map_id << ":" << r.key
-                                  << "]"
+    DEBUG_REF("copy constructor " << this << "[" << r.map_id << ":"
+                                  << r.getKey() << "]"
                                   << " is_const " << r.is_const);
 
     map_id = r.map_id;
-    if (r.key)
-      key = r.key->clone();
-    else
-      key = nullptr;
+    key = nullptr;
+    key_inline = false;
+    set_key(r.getKey());
 
     is_const = r.is_const;
     is_registered = false;
 
-    if (key) {
+    if (getKey()) {
       ref_p = HOOK->lookup_object(this);
       if (ref_p)
         is_registered = true;
@@ -128,8 +130,7 @@ class SwRef {
     if (is_registered)
       HOOK->release_ref(this);
 
-    if (key != nullptr)
-      delete key;
+    clear_key();
   }
 
   /* remove objects */
@@ -139,23 +140,24 @@ class SwRef {
     HOOK->delete_object(this);
     is_registered = false;
 
-    if (key != nullptr)
-      delete key;
-    key = nullptr;
+    clear_key();
 
     ref_p = nullptr;
   }
 
   const SwRef& operator=(const SwRef& r) const {
     DEBUG_REF("assignment operator: copy requested to "
-              << this << "[" << r.map_id << ":" << r.key << "]"
+              << this << "[" << r.map_id << ":" << r.getKey() << "]"
               << " is_const " << r.is_const);
 
+    if (&r == this)
+      return *this;
+
     map_id = r.map_id;
     is_const = r.is_const;
 
-    if (r.key != nullptr) {
-      key = r.key->clone();
+    if (r.getKey() != nullptr) {
+      set_key(r.getKey());
       ref_p = HOOK->lookup_object(this);
     } else
       ref_p = r.ref_p;
@@ -204,7 +206,9 @@ class SwRef {
 
   bool isConst() const { return is_const; }
 
-  Key* getKey() const { return key; }
+  Key* getKey() const {
+    return key_inline ? reinterpret_cast<Key*>(key_buf) : key;
+  }
 
   int getMapId() const { return map_id; }
 
@@ -213,20 +217,20 @@ class SwRef {
   int getVersion() const { return ((SwStubBase*)ref_p)->_obj_version; }
 
   int get_serial_size() const {
-    return sizeof(SwStubSerial) + key->get_key_size();
+    return sizeof(SwStubSerial) + getKey()->get_key_size();
   }
 
   /* How to handle SwRef when serialize/deserialize */
 
   struct SwStubSerial* serialize() const {
-    size_t buf_size = sizeof(SwStubSerial) + key->get_key_size();
+    size_t buf_size = sizeof(SwStubSerial) + getKey()->get_key_size();
     void* buf = malloc(buf_size);
 
     struct SwStubSerial* dr_buf = (struct SwStubSerial*)buf;
     dr_buf->size = buf_size;
     dr_buf->map_id = map_id;
     dr_buf->is_const = is_const;
-    dr_buf->key_archive = key->serialize();
+    dr_buf->key_archive = getKey()->serialize();
 
     return dr_buf;
   }
@@ -245,7 +249,7 @@ class SwRef {
     if (lhs.map_id == -1 || rhs.map_id == -1)
       return lhs.ref_p == rhs.ref_p;
 
-    return (lhs.map_id == rhs.map_id) && (*lhs.key == *rhs.key) &&
+    return (lhs.map_id == rhs.map_id) && (*lhs.getKey() == *rhs.getKey()) &&
            (lhs.ref_p == rhs.ref_p);
   };
 
@@ -256,9 +260,29 @@ class SwRef {
  private:
   thread_local static ReferenceInterceptor* HOOK;
 
+  // copies k into key_buf (no allocation), or onto the heap if it is too big
+  void set_key(const Key* k) const {
+    clear_key();
+    if (k == nullptr)
+      return;
+
+    if (k->clone(sizeof(key_buf), key_buf) != nullptr)
+      key_inline = true;
+    else
+      key = k->clone();
+  }
+
+  void clear_key() const {
+    if (!key_inline && key != nullptr)
+      delete key;
+    key = nullptr;
+    key_inline = false;
+  }
+
   /* object identifier (map_id, key) tuple */
   mutable int map_id;
-  mutable Key* key;
+  mutable Key* key;  // only if the key does not fit in key_buf
+  mutable bool key_inline;
 
   /* reference characteristics */
   mutable bool is_const;
@@ -266,6 +290,9 @@ class SwRef {
 
   /* reference for SW/MW-Objects */
   mutable SwStub<X>* ref_p;
+
+  /* inline copy of the key; a plain memcpy, never destructed */
+  alignas(8) mutable uint8_t key_buf[REF_KEY_BUF_SIZE];
 };
 
 template <class X>
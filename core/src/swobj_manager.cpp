@@ -1,6 +1,7 @@
 #include <cassert>
 #include <cerrno>
 #include <cstring>
+#include <new>
 
 #include "controlbus.hh"
 #include "d_reference.hh"
@@ -10,6 +11,8 @@
 #include "message.hh"
 #include "swobj_manager.hh"
 #include "swstub_manager.hh"
+#include "time.hh"
+#include "timer_wheel.hh"
 #include "worker.hh"
 
 struct ObjectInfo {
@@ -28,6 +31,13 @@ struct ObjectInfo {
   std::unordered_set<int> rw_metainfo_set;
   std::queue<int> rw_request_queue;
   std::unordered_set<int> rw_request_set;
+
+  // workers with a read-only replica of obj, invalidated when it changes
+  std::unordered_set<int> ro_holders;
+
+  // majority vote of the workers taking the rw lease, see move_home()
+  WorkerID rw_affinity = -1;
+  int rw_affinity_cnt = 0;
 };
 
 struct ObjReturn {
@@ -37,6 +47,31 @@ struct ObjReturn {
   void *data;
 };
 
+struct Prefetch {
+  SWObjectManager *manager;
+  int map_id;
+  bool is_const;
+  const Key *key;
+  Timer *timer;
+
+  // the manager asked for the lease back before it arrived
+  bool expire_requested;
+  int expire_version;
+};
+
+// ObjectInfo lives next to the objects, in the (hugepage) pool
+static ObjectInfo *new_object_info(MemPool *mp) {
+  void *m = mp->malloc(sizeof(ObjectInfo));
+  if (!m)
+    return nullptr;
+  return new (m) ObjectInfo();
+}
+
+static void free_object_info(MemPool *mp, ObjectInfo *obj_info) {
+  obj_info->~ObjectInfo();
+  mp->free(obj_info);
+}
+
 static void update_object_info(MemPool *mp, ObjectInfo *obj_info, int version,
                                void *obj, uint32_t obj_size) {
   // update object info from expired information
@@ -50,22 +85,22 @@ static void update_object_info(MemPool *mp, ObjectInfo *obj_info, int version,
     obj_info->obj_size = 0;
     obj_info->obj = nullptr;
   } else {
-    if (obj_info->obj_size == obj_size) {
-      if (obj_info->obj != obj) {
-        memcpy(obj_info->obj, obj, obj_size);
-      }
-    } else {
+    // reuses the chunk if the new size fits in it
+    if (mp->chunk_size_of(obj_info->obj) < obj_size) {
       if (obj_info->obj)
         mp->free(obj_info->obj);
       obj_info->obj = mp->malloc(obj_size);
       if (!obj_info->obj) {
-        DEBUG_ERR("Fail to malloc");
-        assert(0);
+        // out of memory: lost, so created again on the next access
+        DEBUG_ERR("Fail to malloc, drop the object");
+        obj_info->obj_size = 0;
         return;
       }
-      memcpy(obj_info->obj, obj, obj_size);
-      obj_info->obj_size = obj_size;
     }
+
+    if (obj_info->obj != obj)
+      memcpy(obj_info->obj, obj, obj_size);
+    obj_info->obj_size = obj_size;
   }
 }
 
@@ -88,7 +123,7 @@ static void activate_object_info(struct ObjectInfo *info) {
 }
 
 static void deactivate_object_info(MemPool *mp, struct ObjectInfo *info) {
-  if (info->obj && !info->is_local)
+  if (info->obj)
     mp->free(info->obj);
 
   info->is_activate = false;
@@ -99,9 +134,9 @@ static void deactivate_object_info(MemPool *mp, struct ObjectInfo *info) {
 }
 
 static void delete_all_obj_info(MemPool *mp, ObjectInfo *obj_info) {
-  if (obj_info->obj && !obj_info->is_local)
+  if (obj_info->obj)
     mp->free(obj_info->obj);
-  delete obj_info;
+  free_object_info(mp, obj_info);
 }
 
 static void cleanup_object_metainfo(struct ObjectInfo *info, int version) {
@@ -121,6 +156,17 @@ static void add_to_rw_waitlist(ObjectInfo *obj_info, WorkerID node_id) {
   return;
 }
 
+static void record_rw_grant(ObjectInfo *obj_info, WorkerID to) {
+  if (obj_info->rw_affinity == to) {
+    obj_info->rw_affinity_cnt++;
+  } else if (obj_info->rw_affinity_cnt > 0) {
+    obj_info->rw_affinity_cnt--;
+  } else {
+    obj_info->rw_affinity = to;
+    obj_info->rw_affinity_cnt = 1;
+  }
+}
+
 static int next_rw_waiter(ObjectInfo *obj_info) {
   if (!obj_info->rw_request_queue.empty()) {
     WorkerID node_id = obj_info->rw_request_queue.front();
@@ -135,6 +181,149 @@ static int next_rw_waiter(ObjectInfo *obj_info) {
   return -1;
 }
 
+SWObjectManager::SWObjectManager(uint32_t node_id, Worker *worker,
+                                 DroutineScheduler *sch, ControlBus *cbus,
+                                 KeySpace *key_space, MemPool *mp) {
+  this->node_id = node_id;
+
+  this->scheduler = sch;
+  this->key_space = key_space;
+
+  this->worker = worker;
+  this->cbus = cbus;
+  this->mp = mp;
+  mp->add_size_class(sizeof(ObjectInfo));
+
+  lease_batch_tsc = get_tsc_freq() * (SW_LEASE_BATCH_US / 1.0E+6);
+}
+
+void SWObjectManager::send_message(WorkerID to, MessageBuffer *m) {
+  if (lease_batch_cnt > 0) {
+    flush_lease_batch(&lease_req_batch[to], to);
+    flush_lease_batch(&lease_res_batch[to], to);
+  }
+
+  worker->send_message(to, m);
+}
+
+static RWLeaseMulti *get_lease_multi(LeaseBatch *batch) {
+  MessageBuffer *mb = (MessageBuffer *)(void *)batch->buf;
+  Message *m = (Message *)(mb->buf + mb->body_offset);
+  return (RWLeaseMulti *)(void *)m->buf;
+}
+
+// room for size bytes in the batch to a worker, or nullptr if a lease of
+// the size does not fit in a batch at all
+void *SWObjectManager::add_to_lease_batch(LeaseBatch *batch, WorkerID to,
+                                          uint16_t mtype, uint32_t size) {
+  if (batch->offset && batch->offset + size > SW_LEASE_BATCH_SIZE)
+    flush_lease_batch(batch, to);
+
+  if (batch->offset == 0) {
+    MessageBuffer *mb = cbus->init_message(batch->buf, SW_LEASE_BATCH_SIZE);
+    Message *m = (Message *)(mb->buf + mb->body_offset);
+    m->mtype = (MessageType)mtype;
+    m->from_id = node_id;
+    m->to_id = to;
+
+    batch->offset = sizeof(MessageBuffer) + mb->body_offset + sizeof(Message) +
+                    sizeof(RWLeaseMulti);
+    if (batch->offset + size > SW_LEASE_BATCH_SIZE) {
+      batch->offset = 0;
+      return nullptr;
+    }
+
+    get_lease_multi(batch)->count = 0;
+    batch->init_tsc = get_cur_rdtsc();
+    lease_batch_cnt++;
+  }
+
+  void *p = batch->buf + batch->offset;
+  get_lease_multi(batch)->count++;
+  batch->offset += size;
+
+  return p;
+}
+
+void SWObjectManager::flush_lease_batch(LeaseBatch *batch, WorkerID to) {
+  if (batch->offset == 0)
+    return;
+
+  // send() takes the ownership of the message, while the batch is reused
+  MessageBuffer *mb = (MessageBuffer *)(void *)batch->buf;
+  size_t body_size = batch->offset - sizeof(MessageBuffer) - mb->body_offset;
+  MessageBuffer *out = cbus->allocate_message(body_size);
+  memcpy(out->buf + out->body_offset, mb->buf + mb->body_offset, body_size);
+
+  batch->offset = 0;
+  lease_batch_cnt--;
+
+  worker->send_message(to, out);
+}
+
+void SWObjectManager::flush_lease_batches(bool force) {
+  if (lease_batch_cnt == 0)
+    return;
+
+  uint64_t now = get_cur_rdtsc();
+  for (WorkerID to = 0; to < MAX_WORKER_CNT && lease_batch_cnt > 0; to++) {
+    LeaseBatch *batches[] = {&lease_req_batch[to], &lease_res_batch[to]};
+    for (LeaseBatch *batch : batches) {
+      if (batch->offset && (force || now - batch->init_tsc >= lease_batch_tsc))
+        flush_lease_batch(batch, to);
+    }
+  }
+}
+
+void SWObjectManager::end_lease_batch() {
+  batch_responses = false;
+
+  for (WorkerID to = 0; to < MAX_WORKER_CNT && lease_batch_cnt > 0; to++)
+    flush_lease_batch(&lease_res_batch[to], to);
+}
+
+// the requests of new flows (e.g., after scaling out) go in batches
+void SWObjectManager::request_object_ownership(WorkerID to, int map_id,
+                                               const Key *key,
+                                               bool force_to_create) {
+  uint32_t size = sizeof(RWLeaseRequest) + key->get_key_size();
+  void *req = add_to_lease_batch(&lease_req_batch[to], to,
+                                 MSG_RWLEASE_REQUEST_MULTI, size);
+  if (req) {
+    fill_object_ownership_request((RWLeaseRequest *)req,
+                                  key_space->get_version(), map_id, key,
+                                  force_to_create);
+    return;
+  }
+
+  MessageBuffer *m = create_object_ownership_request(
+      cbus, node_id, to, key_space->get_version(), map_id, key,
+      force_to_create);
+  send_message(to, m);
+}
+
+// batched only while serving a batch of requests, see begin_lease_batch()
+void SWObjectManager::response_object_ownership(WorkerID to, int map_id,
+                                                const Key *key, int version,
+                                                void *obj, uint32_t obj_size) {
+  if (batch_responses) {
+    uint32_t size = sizeof(RWLeaseResponse) + key->get_key_size() + obj_size;
+    void *res = add_to_lease_batch(&lease_res_batch[to], to,
+                                   MSG_RWLEASE_RESPONSE_MULTI, size);
+    if (res) {
+      // the last in the batch; give back what the delta saved
+      lease_res_batch[to].offset -=
+          size - fill_object_ownership_response((RWLeaseResponse *)res, map_id,
+                                                key, version, obj, obj_size);
+      return;
+    }
+  }
+
+  MessageBuffer *m = create_object_ownership_response(
+      cbus, node_id, to, map_id, key, version, obj, obj_size);
+  send_message(to, m);
+}
+
 int SWObjectManager::force_scaling(int max_objects) {
   int count = 0;
 
@@ -145,7 +334,7 @@ int SWObjectManager::force_scaling(int max_objects) {
 
     ObjInfoMap *next_obj_map = tmp_obj_map_arr[map_id];
     if (next_obj_map == nullptr) {
-      tmp_obj_map_arr[map_id] = new ObjInfoMap();
+      tmp_obj_map_arr[map_id] = new ObjInfoMap(__get_key_ops(map_id));
       next_obj_map = tmp_obj_map_arr[map_id];
     }
 
@@ -176,7 +365,7 @@ int SWObjectManager::force_scaling(int max_objects) {
         MessageBuffer *m = create_key_ownership_response(
             cbus, node_id, new_id, key_space->get_version(), map_id, key,
             obj_info->version, obj_info->obj, obj_info->obj_size, waiters);
-        worker->send_message(new_id, m);
+        send_message(new_id, m);
 
         stats.own_objects_stale--;
         stats.own_objects--;
@@ -185,6 +374,7 @@ int SWObjectManager::force_scaling(int max_objects) {
         if (obj_info->obj != nullptr)
           stats.obj_export++;
 
+        invalidate_ro_holders(obj_info, map_id, key);
         delete_all_obj_info(mp, it->second);
         it = obj_map->erase(it);
       }
@@ -260,6 +450,21 @@ void SWObjectManager::teardown(bool force) {
       it = obj_map->erase(it);
     }
   }
+
+  for (int i = 0; i < ADT_cnt; i++) {
+    for (auto it = lease_base_map[i].begin(); it != lease_base_map[i].end();) {
+      delete it->first;
+      free_lease_base(it->second);
+      it = lease_base_map[i].erase(it);
+    }
+  }
+
+  for (int i = 0; i < ADT_cnt; i++) {
+    for (auto &prefetches : prefetch_map) {
+      while (!prefetches[i].empty())
+        delete_prefetch(prefetches[i].begin()->second);
+    }
+  }
 }
 
 ObjectInfo *SWObjectManager::get_object_info(int map_id, const Key *key) {
@@ -293,13 +498,13 @@ ObjectInfo *SWObjectManager::get_object_info(int map_id, const Key *key) {
 ObjectInfo *SWObjectManager::create_object_info(int map_id, const Key *key) {
   ObjInfoMap *obj_map = obj_map_arr[map_id];
   if (obj_map == nullptr) {
-    obj_map_arr[map_id] = new ObjInfoMap();
+    obj_map_arr[map_id] = new ObjInfoMap(__get_key_ops(map_id));
     obj_map = obj_map_arr[map_id];
     obj_map->reserve(24000);
   }
 
   // create if not exist
-  ObjectInfo *obj_info = new ObjectInfo();
+  ObjectInfo *obj_info = new_object_info(mp);
   if (!obj_info) {
     errno = -ENOMEM;
     return nullptr;
@@ -320,13 +525,13 @@ ObjectInfo *SWObjectManager::create_object_info_in_nextspace(int map_id,
                                                              const Key *key) {
   ObjInfoMap *obj_map = tmp_obj_map_arr[map_id];
   if (obj_map == nullptr) {
-    tmp_obj_map_arr[map_id] = new ObjInfoMap();
+    tmp_obj_map_arr[map_id] = new ObjInfoMap(__get_key_ops(map_id));
     obj_map = tmp_obj_map_arr[map_id];
     obj_map->reserve(24000);
   }
 
   // create if not exist
-  ObjectInfo *obj_info = new ObjectInfo();
+  ObjectInfo *obj_info = new_object_info(mp);
   if (!obj_info) {
     errno = -ENOMEM;
     return nullptr;
@@ -353,7 +558,7 @@ void SWObjectManager::move_object_info_to_nextspace(int map_id,
 
   ObjInfoMap *next_obj_map = tmp_obj_map_arr[map_id];
   if (next_obj_map == nullptr) {
-    tmp_obj_map_arr[map_id] = new ObjInfoMap();
+    tmp_obj_map_arr[map_id] = new ObjInfoMap(__get_key_ops(map_id));
     next_obj_map = tmp_obj_map_arr[map_id];
   }
 
@@ -407,6 +612,9 @@ void SWObjectManager::erase_object_info(int map_id, const Key *key) {
 
     const Key *it_key = it->first;
     obj_map->erase(it);
+
+    if (key_space->get_home_of(map_id, it_key) == node_id)
+      return_home(map_id, it_key);
     delete it_key;
 
     stats.own_objects_stale--;
@@ -415,23 +623,23 @@ void SWObjectManager::erase_object_info(int map_id, const Key *key) {
 
 void SWObjectManager::set_rwobj(int map_id, const Key *key, int version,
                                 uint32_t obj_size, void *data,
-                                WorkerID created_from) {
+                                WorkerID created_from, int delta_size) {
   auto it = object_ret_map[map_id].find(key);
   if (it == object_ret_map[map_id].end()) {
     ObjReturn *obj = new ObjReturn();
     obj->created_from = created_from;
     obj->version = version;
     obj->size = obj_size;
-    if (obj_size) {
-      obj->data = mp->malloc(obj_size);
-      if (!obj->data) {
-        DEBUG_ERR("Fail to malloc");
-        assert(0);
-        return;
-      }
+    obj->data = obj_size ? mp->malloc(obj_size) : nullptr;
+    if (obj->data && delta_size >= 0) {
+      memset(obj->data, 0, obj_size);
+      apply_delta(obj->data, (const uint8_t *)data, delta_size);
+    } else if (obj->data) {
       memcpy(obj->data, data, obj_size);
-    } else {
-      obj->data = nullptr;
+    } else if (obj_size) {
+      // out of memory: the waiter creates it again
+      DEBUG_ERR("Fail to malloc, drop the object");
+      obj->size = 0;
     }
     object_ret_map[map_id][key->clone()] = obj;
   } else {
@@ -440,6 +648,10 @@ void SWObjectManager::set_rwobj(int map_id, const Key *key, int version,
   }
 
   scheduler->notify_to_wake_up(map_id, key, SW_OBJ_BLOCK);
+
+  Prefetch *p = get_prefetch(map_id, key, false);
+  if (p && p->expire_requested)
+    return_prefetched(p);
 }
 
 void SWObjectManager::get_rwobj(int map_id, const Key *key, int &version,
@@ -471,8 +683,13 @@ void SWObjectManager::return_obj_binary_local(ObjectInfo *obj_info, int map_id,
 
     obj_info->is_owned = true;
     obj_info->cur_worker = node_id;
+    record_rw_grant(obj_info, node_id);
     version = obj_info->version;
+
+    // the reference frees it; a copy is committed back at expiry
     *obj = obj_info->obj;
+    obj_info->obj = nullptr;
+    obj_info->obj_size = 0;
 
     obj_info->is_local = true;
 
@@ -505,16 +722,15 @@ void SWObjectManager::return_obj_binary_remote(ObjectInfo *obj_info, int map_id,
 
     obj_info->is_owned = true;
     obj_info->cur_worker = to;
+    record_rw_grant(obj_info, to);
 
     stats.own_remote++;
 
     // Request swobj to remote SWObjectManager
     DEBUG_OBJ("return remote object " << *key << " to " << to);
 
-    MessageBuffer *m = create_object_ownership_response(
-        cbus, node_id, to, map_id, key, obj_info->version, obj_info->obj,
-        obj_info->obj_size);
-    worker->send_message(to, m);
+    response_object_ownership(to, map_id, key, obj_info->version,
+                              obj_info->obj, obj_info->obj_size);
 
     if (obj_info->obj != nullptr)
       stats.obj_export++;
@@ -539,6 +755,7 @@ void SWObjectManager::delete_object_binary(ObjectInfo *obj_info, int map_id,
                                            const Key *key, int version,
                                            bool cleanup) {
   stats.own_objects--;
+  invalidate_ro_holders(obj_info, map_id, key);
   deactivate_object_info(mp, obj_info);
 
   if (cleanup)
@@ -558,7 +775,7 @@ void SWObjectManager::delete_object_binary(ObjectInfo *obj_info, int map_id,
     MessageBuffer *m = create_key_ownership_response(
         cbus, node_id, obj_info->transfer_key_ownership_to,
         key_space->get_version(), map_id, key, -1, nullptr, 0, waiters);
-    worker->send_message(obj_info->transfer_key_ownership_to, m);
+    send_message(obj_info->transfer_key_ownership_to, m);
 
     erase_object_info(map_id, key);
     delete_all_obj_info(mp, obj_info);
@@ -585,6 +802,7 @@ void SWObjectManager::delete_object_binary(ObjectInfo *obj_info, int map_id,
   if (to == node_id) {
     obj_info->is_owned = true;
     obj_info->cur_worker = node_id;
+    record_rw_grant(obj_info, node_id);
 
     set_rwobj(map_id, key, obj_info->version, obj_info->obj_size, obj_info->obj,
               node_id);
@@ -605,7 +823,7 @@ void SWObjectManager::local_request_expire_rwref(WorkerID to, int map_id,
     MessageBuffer *m = create_object_ownership_expire_request(
         cbus, node_id, to, map_id, key, version);
 
-    worker->send_message(to, m);
+    send_message(to, m);
   }
   return;
 }
@@ -619,9 +837,12 @@ int SWObjectManager::local_create_object(int map_id, const Key *key,
   DEBUG_OBJ("local request for creating object for " << *key << " from "
                                                      << node_id);
 
+  bool prefetched = claim_prefetch(map_id, key, false);
   WorkerID to = key_space->get_manager_of(map_id, key);
 
-  if (to == -1 || to == node_id) {
+  if (!prefetched && (to == -1 || to == node_id)) {
+    access_tracker.record(map_id, key);
+
     ObjectInfo *obj_info = get_object_info(map_id, key);
     if (!obj_info) {
       if (scaling.on) {
@@ -643,10 +864,12 @@ int SWObjectManager::local_create_object(int map_id, const Key *key,
 
           MessageBuffer *m = create_key_ownership_request(
               cbus, node_id, prev, key_space->get_version(), map_id, key);
-          worker->send_message(prev, m);
+          send_message(prev, m);
         }
       } else {
         obj_info = create_object_info(map_id, key);
+        if (!obj_info)
+          return -1;
       }
     }
 
@@ -682,20 +905,24 @@ int SWObjectManager::local_create_object(int map_id, const Key *key,
   } else {
     state.in_local = false;
 
-    DEBUG_DEV("Request read/write-ability " << *key << "  remotely to " << to
-                                            << " from " << node_id);
-    MessageBuffer *m = create_object_ownership_request(
-        cbus, node_id, to, key_space->get_version(), map_id, key, true);
-    worker->send_message(to, m);
+    if (!prefetched) {
+      DEBUG_DEV("Request read/write-ability " << *key << "  remotely to " << to
+                                              << " from " << node_id);
+      request_object_ownership(to, map_id, key, true);
+    }
 
-    stats.borrow_local++;
     uint32_t obj_size;
     get_rwobj(map_id, key, version, obj_size, obj, created_from);
 
+    // the home of the key moved here along with it (see move_home())
     if (created_from == node_id) {
       ObjectInfo *obj_info = get_object_info(map_id, key);
       assert(obj_info);
       obj_info->is_local = true;
+      stats.own_local++;
+    } else {
+      stats.borrow_local++;
+      keep_lease_base(map_id, key, version, obj_size, *obj, created_from);
     }
 
     stats.local_objects++;
@@ -726,8 +953,11 @@ int SWObjectManager::local_lookup_object(int map_id, const Key *key,
     if (!obj_info->is_owned) {
       obj_info->is_owned = true;
       obj_info->cur_worker = node_id;
+      record_rw_grant(obj_info, node_id);
       version = obj_info->version;
       *obj = obj_info->obj;
+      obj_info->obj = nullptr;
+      obj_info->obj_size = 0;
       return 0;
     } else {
       DEBUG_ERR("Do not support remote lookup");
@@ -743,9 +973,7 @@ int SWObjectManager::local_lookup_object(int map_id, const Key *key,
   // Request swobj to remote SWObjectManager
   DEBUG_DEV("Request read/write-ability " << *key << "  remotely to " << to
                                           << " from " << node_id);
-  MessageBuffer *m = create_object_ownership_request(
-      cbus, node_id, to, key_space->get_version(), map_id, key, false);
-  worker->send_message(to, m);
+  request_object_ownership(to, map_id, key, false);
 
   uint32_t obj_size;
   get_rwobj(map_id, key, version, obj_size, obj, created_from);
@@ -757,6 +985,7 @@ int SWObjectManager::local_delete_object(int map_id, const Key *key,
                                          int version, bool cleanup,
                                          WorkerID created_from) {
   stats.local_objects--;
+  free_lease_base(take_lease_base(map_id, key, version));
 
   WorkerID to = key_space->get_manager_of(map_id, key);
   DEBUG_OBJ("local delete object request " << *key << " from " << node_id
@@ -797,7 +1026,7 @@ int SWObjectManager::local_delete_object(int map_id, const Key *key,
 
   MessageBuffer *m = create_rwobj_del_request(cbus, node_id, send, map_id, key,
                                               version, cleanup);
-  worker->send_message(send, m);
+  send_message(send, m);
   return 0;
 }
 
@@ -819,7 +1048,7 @@ int SWObjectManager::local_cleanup_meta(int map_id, const Key *key, int version,
         WorkerID next = key_space->get_manager_of(map_id, key);
         MessageBuffer *m = create_rwobj_cleanup_meta_request(
             cbus, node_id, next, map_id, key, version);
-        worker->send_message(next, m);
+        send_message(next, m);
       } else {
         DEBUG_ERR("No obj_info to cleanup_meta");
         return -EINVAL;
@@ -837,29 +1066,450 @@ int SWObjectManager::local_cleanup_meta(int map_id, const Key *key, int version,
 
     MessageBuffer *m = create_rwobj_cleanup_meta_request(cbus, node_id, to,
                                                          map_id, key, version);
-    worker->send_message(to, m);
+    send_message(to, m);
   }
   return -1;
 }
 
 int SWObjectManager::local_create_cache(int map_id, const Key *key,
-                                        int &version) {
-  assert(!scaling.on);
+                                        int &version, uint32_t &obj_size,
+                                        void **obj) {
+  if (claim_prefetch(map_id, key, true)) {
+    get_roobj(map_id, key, version, obj_size, obj);
+    return (version < 0 || !*obj) ? -1 : 0;
+  }
+
+  // no replicas while the keys move
+  if (scaling.on)
+    return -1;
 
   WorkerID to = key_space->get_manager_of(map_id, key);
   if (to == -1 || to == node_id) {
     ObjectInfo *obj_info = get_object_info(map_id, key);
-    if (!obj_info)
+    // nothing committed yet, e.g., the first owner still has it
+    if (!obj_info || !obj_info->is_activate || !obj_info->obj_size)
+      return -1;
+
+    *obj = mp->malloc(obj_info->obj_size);
+    if (!*obj) {
+      errno = -ENOMEM;
       return -1;
+    }
 
+    memcpy(*obj, obj_info->obj, obj_info->obj_size);
     version = obj_info->version;
+    obj_size = obj_info->obj_size;
+
+    obj_info->ro_holders.insert(node_id);
     return 0;
+  }
+
+  DEBUG_DEV("Request read-only replica " << *key << " remotely to " << to
+                                         << " from " << node_id);
+  MessageBuffer *m = create_ro_cache_request(cbus, node_id, to, map_id, key);
+  send_message(to, m);
+
+  get_roobj(map_id, key, version, obj_size, obj);
+  if (version < 0 || !*obj)
+    return -1;
+
+  return 0;
+}
+
+void SWObjectManager::remote_create_cache(int map_id, const Key *key,
+                                          WorkerID from_id) {
+  ObjectInfo *obj_info = get_object_info(map_id, key);
+  MessageBuffer *m;
+
+  // the home of the key moved (see move_home())
+  WorkerID home = key_space->get_home_of(map_id, key);
+  if (!obj_info && home >= 0 && home != node_id) {
+    m = create_ro_cache_request(cbus, from_id, home, map_id, key);
+    send_message(home, m);
+    return;
+  }
+
+  if (!obj_info || !obj_info->is_activate || !obj_info->obj_size) {
+    m = create_ro_cache_response(cbus, node_id, from_id, map_id, key, -1,
+                                 nullptr, 0);
   } else {
-    // FIXME: handling remote roref creation
-    DEBUG_ERR("Cannot get remote RO reference");
+    obj_info->ro_holders.insert(from_id);
+    m = create_ro_cache_response(cbus, node_id, from_id, map_id, key,
+                                 obj_info->version, obj_info->obj,
+                                 obj_info->obj_size);
   }
 
-  return -1;
+  send_message(from_id, m);
+}
+
+void SWObjectManager::remote_set_cache(int map_id, const Key *key, int version,
+                                       uint32_t obj_size, void *data) {
+  auto it = object_ro_ret_map[map_id].find(key);
+  if (it != object_ro_ret_map[map_id].end()) {
+    DEBUG_ERR("Duplicated ro obj update " << map_id << ":" << *key);
+    return;
+  }
+
+  ObjReturn *obj = new ObjReturn();
+  obj->created_from = -1;
+  obj->version = version;
+  obj->size = obj_size;
+  obj->data = (version >= 0 && obj_size) ? mp->malloc(obj_size) : nullptr;
+  if (obj->data)
+    memcpy(obj->data, data, obj_size);
+  object_ro_ret_map[map_id][key->clone()] = obj;
+
+  scheduler->notify_to_wake_up(map_id, key, SW_RO_OBJ_BLOCK);
+}
+
+void SWObjectManager::get_roobj(int map_id, const Key *key, int &version,
+                                uint32_t &obj_size, void **data) {
+  auto it = object_ro_ret_map[map_id].find(key);
+  while (it == object_ro_ret_map[map_id].end()) {
+    scheduler->yield_block(map_id, key, SW_RO_OBJ_BLOCK);
+    it = object_ro_ret_map[map_id].find(key);
+  }
+
+  ObjReturn *obj = it->second;
+  version = obj->version;
+  obj_size = obj->size;
+  *data = obj->data;
+
+  delete it->first;
+  delete it->second;
+  object_ro_ret_map[map_id].erase(it);
+}
+
+// the object as leased; only large ones, for which a delta pays off
+void SWObjectManager::keep_lease_base(int map_id, const Key *key, int version,
+                                      uint32_t obj_size, void *obj,
+                                      WorkerID created_from) {
+  free_lease_base(take_lease_base(map_id, key, -1));
+
+  if (!obj || obj_size < DELTA_MIN_OBJ_SIZE)
+    return;
+
+  void *data = mp->malloc(obj_size);
+  if (!data)
+    return;
+  memcpy(data, obj, obj_size);
+
+  ObjReturn *base = new ObjReturn();
+  base->created_from = created_from;
+  base->version = version;
+  base->size = obj_size;
+  base->data = data;
+  lease_base_map[map_id][key->clone()] = base;
+}
+
+ObjReturn *SWObjectManager::take_lease_base(int map_id, const Key *key,
+                                            int version) {
+  auto &bases = lease_base_map[map_id];
+  if (bases.empty())
+    return nullptr;
+
+  auto it = bases.find(key);
+  if (it == bases.end())
+    return nullptr;
+
+  ObjReturn *base = it->second;
+  delete it->first;
+  bases.erase(it);
+
+  if (version >= 0 && base->version != version) {
+    free_lease_base(base);
+    return nullptr;
+  }
+  return base;
+}
+
+void SWObjectManager::free_lease_base(ObjReturn *base) {
+  if (!base)
+    return;
+
+  mp->free(base->data);
+  delete base;
+}
+
+Prefetch *SWObjectManager::create_prefetch(int map_id, const Key *key,
+                                           bool is_const) {
+  Prefetch *p = new Prefetch();
+  p->manager = this;
+  p->map_id = map_id;
+  p->is_const = is_const;
+  p->key = key->clone();
+  p->timer = TimerWheel::GetTimerWheel()->schedule_after_us(
+      SW_PREFETCH_TIMEOUT_US, on_prefetch_timeout, p);
+  p->expire_requested = false;
+  p->expire_version = -1;
+
+  prefetch_map[is_const][map_id][p->key] = p;
+  return p;
+}
+
+void SWObjectManager::delete_prefetch(Prefetch *p) {
+  prefetch_map[p->is_const][p->map_id].erase(p->key);
+  if (p->timer)
+    TimerWheel::GetTimerWheel()->cancel(p->timer);
+
+  delete p->key;
+  delete p;
+}
+
+Prefetch *SWObjectManager::get_prefetch(int map_id, const Key *key,
+                                        bool is_const) {
+  auto &prefetches = prefetch_map[is_const][map_id];
+  if (prefetches.empty())
+    return nullptr;
+
+  auto it = prefetches.find(key);
+  if (it == prefetches.end())
+    return nullptr;
+
+  return it->second;
+}
+
+bool SWObjectManager::claim_prefetch(int map_id, const Key *key,
+                                     bool is_const) {
+  Prefetch *p = get_prefetch(map_id, key, is_const);
+  if (!p)
+    return false;
+
+  // the reference that claims it gives it back once released; its SwStubInfo
+  // is there, blocked on the object (see SwStubManager::create())
+  if (p->expire_requested)
+    swstub_manager->request_expire_local_rwref(map_id, key, p->expire_version);
+
+  delete_prefetch(p);
+  return true;
+}
+
+// the lease goes back unused, as if a reference had it and expired
+void SWObjectManager::return_prefetched(Prefetch *p) {
+  int map_id = p->map_id;
+  const Key *key = p->key;
+  int version;
+  uint32_t obj_size;
+  void *obj;
+
+  if (p->is_const) {
+    get_roobj(map_id, key, version, obj_size, &obj);
+  } else {
+    WorkerID created_from;
+    get_rwobj(map_id, key, version, obj_size, &obj, created_from);
+
+    stats.local_objects++;
+    if (created_from == node_id)
+      stats.own_local++;
+    else
+      stats.borrow_local++;
+
+    // created for it, but never written: the manager drops it
+    if (!obj)
+      local_delete_object(map_id, key, version, true, created_from);
+    else
+      local_notify_expire_rwref(map_id, key, version, obj_size, obj,
+                                created_from);
+  }
+
+  mp->free(obj);
+  delete_prefetch(p);
+}
+
+void SWObjectManager::on_prefetch_timeout(void *arg) {
+  Prefetch *p = static_cast<Prefetch *>(arg);
+  SWObjectManager *m = p->manager;
+  int map_id = p->map_id;
+
+  p->timer = nullptr;
+
+  auto &ret_map =
+      p->is_const ? m->object_ro_ret_map[map_id] : m->object_ret_map[map_id];
+  if (ret_map.find(p->key) == ret_map.end()) {
+    // still on the way
+    p->timer = TimerWheel::GetTimerWheel()->schedule_after_us(
+        SW_PREFETCH_TIMEOUT_US, on_prefetch_timeout, p);
+    return;
+  }
+
+  m->return_prefetched(p);
+}
+
+// the lease of a new flow is requested at rx time, so that the round trip
+// overlaps with processing the other packets of the burst
+void SWObjectManager::prefetch_object(int map_id, const Key *key) {
+  if (scaling.on || scaling.dmz_to_scaling_on || scaling.dmz_to_quiescent_on)
+    return;
+
+  WorkerID to = key_space->get_manager_of(map_id, key);
+  if (to == -1 || to == node_id)
+    return;
+
+  if (prefetch_map[0][map_id].count(key) || object_ret_map[map_id].count(key))
+    return;
+
+  DEBUG_DEV("Prefetch read/write-ability " << *key << " remotely to " << to
+                                           << " from " << node_id);
+  create_prefetch(map_id, key, false);
+  request_object_ownership(to, map_id, key, true);
+}
+
+void SWObjectManager::prefetch_cache(int map_id, const Key *key) {
+  if (scaling.on)
+    return;
+
+  WorkerID to = key_space->get_manager_of(map_id, key);
+  if (to == -1 || to == node_id)
+    return;
+
+  if (prefetch_map[1][map_id].count(key) ||
+      object_ro_ret_map[map_id].count(key))
+    return;
+
+  DEBUG_DEV("Prefetch read-only replica " << *key << " remotely to " << to
+                                          << " from " << node_id);
+  create_prefetch(map_id, key, true);
+  MessageBuffer *m = create_ro_cache_request(cbus, node_id, to, map_id, key);
+  send_message(to, m);
+}
+
+void SWObjectManager::drop_prefetched_cache(int map_id, const Key *key) {
+  auto &prefetches = prefetch_map[1][map_id];
+  if (prefetches.empty())
+    return;
+
+  auto it = prefetches.find(key);
+  if (it == prefetches.end())
+    return;
+
+  // one still on the way was sent after the invalidation
+  auto ret = object_ro_ret_map[map_id].find(key);
+  if (ret == object_ro_ret_map[map_id].end())
+    return;
+
+  ObjReturn *obj = ret->second;
+  const Key *ret_key = ret->first;
+  object_ro_ret_map[map_id].erase(ret);
+  mp->free(obj->data);
+  delete obj;
+  delete ret_key;
+
+  delete_prefetch(it->second);
+}
+
+// the manager asks only once (see return_obj_binary_remote())
+int SWObjectManager::expire_prefetched(int map_id, const Key *key,
+                                       int version) {
+  Prefetch *p = get_prefetch(map_id, key, false);
+  if (!p)
+    return -1;
+
+  DEBUG_DEV("expire prefetched lease " << *key << " ver." << version);
+
+  if (object_ret_map[map_id].count(key)) {
+    return_prefetched(p);
+  } else {
+    // back as soon as it arrives (see set_rwobj()), or once claimed
+    p->expire_requested = true;
+    p->expire_version = version;
+  }
+  return 0;
+}
+
+void SWObjectManager::invalidate_ro_holders(ObjectInfo *obj_info, int map_id,
+                                            const Key *key) {
+  for (WorkerID to : obj_info->ro_holders) {
+    if (to == node_id) {
+      swstub_manager->invalidate_cache(map_id, key);
+      continue;
+    }
+
+    MessageBuffer *m = create_ro_cache_invalidate(cbus, node_id, to, map_id,
+                                                  key, obj_info->version);
+    send_message(to, m);
+  }
+
+  obj_info->ro_holders.clear();
+}
+
+// only the manager by the rule moves a key, while no one holds it
+bool SWObjectManager::should_move_home(ObjectInfo *obj_info, int map_id,
+                                       const Key *key, WorkerID to) {
+  if (scaling.on || scaling.dmz_to_scaling_on || scaling.dmz_to_quiescent_on)
+    return false;
+
+  if (key_space->get_rule_manager_of(map_id, key) != node_id)
+    return false;
+
+  if (obj_info->rw_affinity != to ||
+      obj_info->rw_affinity_cnt < SW_HOME_MOVE_GRANTS)
+    return false;
+
+  return !obj_info->is_owned && obj_info->rw_request_queue.empty() &&
+         obj_info->rw_metainfo_set.size() == 1 &&
+         obj_info->transfer_key_ownership_to < 0 &&
+         obj_info->wait_key_ownership_from < 0;
+}
+
+// the object goes with the rw lease requested by to, which manages the key
+// from now on; requests that still come here are forwarded to it
+void SWObjectManager::move_home(ObjectInfo *obj_info, int map_id,
+                                const Key *key, WorkerID to) {
+  DEBUG_OBJ("Move home of " << *key << " from " << node_id << " to " << to);
+
+  invalidate_ro_holders(obj_info, map_id, key);
+
+  MessageBuffer *m =
+      create_home_transfer(cbus, node_id, to, map_id, key, obj_info->version,
+                           obj_info->obj, obj_info->obj_size);
+  send_message(to, m);
+
+  key_space->set_home(map_id, key, to);
+
+  stats.own_objects--;
+  erase_object_info(map_id, key);
+  delete_all_obj_info(mp, obj_info);
+}
+
+// the object is gone, the manager by the rule takes the key back
+void SWObjectManager::return_home(int map_id, const Key *key) {
+  WorkerID to = key_space->get_rule_manager_of(map_id, key);
+
+  DEBUG_OBJ("Return home of " << *key << " from " << node_id << " to " << to);
+
+  MessageBuffer *m =
+      create_home_transfer(cbus, node_id, to, map_id, key, -1, nullptr, 0);
+  send_message(to, m);
+
+  key_space->set_home(map_id, key, to);
+}
+
+void SWObjectManager::remote_accept_home(int map_id, const Key *key,
+                                         int version, uint32_t obj_size,
+                                         void *data, WorkerID from_id) {
+  if (version < 0) {
+    DEBUG_OBJ("Home of " << *key << " is back from " << from_id);
+    key_space->set_home(map_id, key, node_id);
+    return;
+  }
+
+  DEBUG_OBJ("Accept home of " << *key << " from " << from_id);
+  key_space->set_home(map_id, key, node_id);
+
+  ObjectInfo *obj_info = get_object_info(map_id, key);
+  if (!obj_info)
+    obj_info = create_object_info(map_id, key);
+
+  obj_info->version = version;
+  obj_info->is_activate = true;
+  obj_info->is_local = true;
+  obj_info->rw_metainfo_set.insert(version);
+  obj_info->is_owned = true;
+  obj_info->cur_worker = node_id;
+  record_rw_grant(obj_info, node_id);
+
+  // the local waiter takes the rw lease, as from the manager itself
+  set_rwobj(map_id, key, version, obj_size, data, node_id);
 }
 
 void SWObjectManager::remote_create_object(int map_id, const Key *key,
@@ -869,6 +1519,8 @@ void SWObjectManager::remote_create_object(int map_id, const Key *key,
 
   WorkerID to = key_space->get_manager_of(map_id, key);
   if (to == -1 || to == node_id) {
+    access_tracker.record(map_id, key);
+
     ObjectInfo *obj_info = get_object_info(map_id, key);
     if (!obj_info) {
       if (scaling.on) {
@@ -887,7 +1539,7 @@ void SWObjectManager::remote_create_object(int map_id, const Key *key,
 
           MessageBuffer *m = create_key_ownership_request(
               cbus, node_id, prev, key_space->get_version(), map_id, key);
-          worker->send_message(prev, m);
+          send_message(prev, m);
 
           return;
         }
@@ -900,6 +1552,11 @@ void SWObjectManager::remote_create_object(int map_id, const Key *key,
     if (!obj_info->is_activate)
       activate_object_info(obj_info);
 
+    if (should_move_home(obj_info, map_id, key, from_id)) {
+      move_home(obj_info, map_id, key, from_id);
+      return;
+    }
+
     return_obj_binary_remote(obj_info, map_id, key, from_id);
 
   } else {
@@ -921,7 +1578,7 @@ void SWObjectManager::remote_create_object(int map_id, const Key *key,
           // forward message
           MessageBuffer *m = create_object_ownership_request(
               cbus, from_id, to, key_space->get_version(), map_id, key, true);
-          worker->send_message(to, m);
+          send_message(to, m);
         }
       } else {
         WorkerID prev = key_space->get_prev_manager_of(map_id, key);
@@ -930,16 +1587,11 @@ void SWObjectManager::remote_create_object(int map_id, const Key *key,
         assert(0);
       }
 
-    } else if (scaling.on || scaling.dmz_to_quiescent_on) {
-      // forward message
+    } else {
+      // scaling, or the home of the key moved (see move_home())
       MessageBuffer *m = create_object_ownership_request(
           cbus, from_id, to, key_space->get_version(), map_id, key, true);
-      worker->send_message(to, m);
-    } else {
-      WorkerID prev = key_space->get_prev_manager_of(map_id, key);
-      WorkerID next = key_space->get_next_manager_of(map_id, key);
-      DEBUG_ERR("Key owner:" << prev << "->" << next);
-      assert(0);
+      send_message(to, m);
     }
   }
   return;
@@ -978,10 +1630,20 @@ void SWObjectManager::remote_return_key_ownership(int map_id, const Key *key,
 
     ObjectInfo *obj_info = get_object_info(map_id, key);
     if (!obj_info) {
+      // the home of the key moved before scaling (see move_home())
+      WorkerID home =
+          key_space->get_home_of(key_space->get_prev_version(), map_id, key);
+      if (home >= 0 && home != node_id) {
+        MessageBuffer *m = create_key_ownership_request(
+            cbus, from_id, home, key_space->get_version(), map_id, key);
+        send_message(home, m);
+        return;
+      }
+
       MessageBuffer *m = create_key_ownership_response(
           cbus, node_id, from_id, key_space->get_version(), map_id, key, -1,
           nullptr, 0, -1);
-      worker->send_message(from_id, m);
+      send_message(from_id, m);
 
       return;
     }
@@ -992,10 +1654,11 @@ void SWObjectManager::remote_return_key_ownership(int map_id, const Key *key,
       MessageBuffer *m = create_key_ownership_response(
           cbus, node_id, from_id, key_space->get_version(), map_id, key, -1,
           nullptr, 0, -1);
-      worker->send_message(from_id, m);
+      send_message(from_id, m);
 
       stats.own_objects--;
 
+      invalidate_ro_holders(obj_info, map_id, key);
       erase_object_info(map_id, key);
       delete_all_obj_info(mp, obj_info);
       return;
@@ -1018,7 +1681,7 @@ void SWObjectManager::remote_return_key_ownership(int map_id, const Key *key,
       MessageBuffer *m = create_key_ownership_response(
           cbus, node_id, from_id, key_space->get_version(), map_id, key, -1,
           nullptr, 0, -1);
-      worker->send_message(from_id, m);
+      send_message(from_id, m);
       return;
     }
 
@@ -1058,8 +1721,8 @@ int SWObjectManager::remote_delete_object(int map_id, const Key *key,
       to = key_space->get_next_manager_of(map_id, key);
 
   } else {
-    DEBUG_ERR("No obj_info to delete " << *key);
-    return -EINVAL;
+    // the home of the key moved (see move_home())
+    to = key_space->get_home_of(map_id, key);
   }
 
   if (to == -1 || to == node_id) {
@@ -1069,7 +1732,7 @@ int SWObjectManager::remote_delete_object(int map_id, const Key *key,
 
   MessageBuffer *m = create_rwobj_del_request(cbus, node_id, to, map_id, key,
                                               version, cleanup);
-  worker->send_message(to, m);
+  send_message(to, m);
 
   return 0;
 }
@@ -1081,15 +1744,21 @@ int SWObjectManager::remote_cleanup_meta(int map_id, const Key *key,
 
   ObjectInfo *obj_info = get_object_info(map_id, key);
   if (!obj_info) {
-    if (scaling.on) {
-      WorkerID next = key_space->get_manager_of(map_id, key);
-      MessageBuffer *m = create_rwobj_cleanup_meta_request(
-          cbus, node_id, next, map_id, key, version);
-      worker->send_message(next, m);
-    } else {
+    WorkerID next = -1;
+    if (scaling.on)
+      next = key_space->get_manager_of(map_id, key);
+    else
+      next = key_space->get_home_of(map_id, key);  // see move_home()
+
+    if (next == -1 || next == node_id) {
       DEBUG_ERR("No obj_info to delete");
       return -EINVAL;
     }
+
+    MessageBuffer *m = create_rwobj_cleanup_meta_request(cbus, node_id, next,
+                                                         map_id, key, version);
+    send_message(next, m);
+    return 0;
   }
 
   cleanup_object_metainfo(obj_info, version);
@@ -1121,6 +1790,7 @@ int SWObjectManager::local_notify_expire_rwref(int map_id, const Key *key,
     }
 
     update_object_info(mp, obj_info, version, obj, obj_size);
+    invalidate_ro_holders(obj_info, map_id, key);
 
     if (scaling.on && obj_info->transfer_key_ownership_to >= 0) {
       uint32_t waiters = -1;
@@ -1137,7 +1807,7 @@ int SWObjectManager::local_notify_expire_rwref(int map_id, const Key *key,
           cbus, node_id, obj_info->transfer_key_ownership_to,
           key_space->get_version(), map_id, key, obj_info->version,
           obj_info->obj, obj_info->obj_size, waiters);
-      worker->send_message(obj_info->transfer_key_ownership_to, m);
+      send_message(obj_info->transfer_key_ownership_to, m);
 
       if (obj_info->obj != nullptr)
         stats.obj_export++;
@@ -1157,6 +1827,7 @@ int SWObjectManager::local_notify_expire_rwref(int map_id, const Key *key,
     if (to == node_id) {
       obj_info->is_owned = true;
       obj_info->cur_worker = node_id;
+      record_rw_grant(obj_info, node_id);
 
       set_rwobj(map_id, key, obj_info->version, obj_info->obj_size,
                 obj_info->obj, node_id);
@@ -1167,9 +1838,12 @@ int SWObjectManager::local_notify_expire_rwref(int map_id, const Key *key,
   } else {
     stats.borrow_local--;
 
+    ObjReturn *base = take_lease_base(map_id, key, version);
     MessageBuffer *m = create_object_ownership_expire_response(
-        cbus, node_id, created_from, map_id, key, version, obj, obj_size);
-    worker->send_message(to, m);
+        cbus, node_id, created_from, map_id, key, version, obj, obj_size,
+        (base && base->size == obj_size) ? base->data : nullptr);
+    send_message(to, m);
+    free_lease_base(base);
 
     if (obj != nullptr)
       stats.obj_export++;
@@ -1180,7 +1854,8 @@ int SWObjectManager::local_notify_expire_rwref(int map_id, const Key *key,
 void SWObjectManager::remote_set_object_ownership(int map_id, const Key *key,
                                                   int version,
                                                   uint32_t obj_size, void *data,
-                                                  WorkerID created_from) {
+                                                  WorkerID created_from,
+                                                  int delta_size) {
   if (scaling.on || scaling.dmz_to_quiescent_on) {
     ObjectInfo *obj_info = get_object_info(map_id, key);
     if (obj_info && obj_info->wait_key_ownership_from >= 0) {
@@ -1193,13 +1868,14 @@ void SWObjectManager::remote_set_object_ownership(int map_id, const Key *key,
   if (data != nullptr)
     stats.obj_import++;
 
-  set_rwobj(map_id, key, version, obj_size, data, created_from);
+  set_rwobj(map_id, key, version, obj_size, data, created_from, delta_size);
 }
 
 int SWObjectManager::remote_notify_expire_rwref(int map_id, const Key *key,
                                                 int version, uint32_t obj_size,
                                                 void *obj,
-                                                WorkerID created_from) {
+                                                WorkerID created_from,
+                                                int delta_size) {
   ObjectInfo *obj_info = get_object_info(map_id, key);
   if (!obj_info) {
     DEBUG_ERR("No obj_info to delete " << *key);
@@ -1209,7 +1885,21 @@ int SWObjectManager::remote_notify_expire_rwref(int map_id, const Key *key,
   if (obj != nullptr)
     stats.obj_import++;
 
+  // a delta against the object as leased, which is still here
+  if (delta_size >= 0) {
+    if (obj_info->obj && obj_info->obj_size == obj_size &&
+        obj_info->version == version) {
+      apply_delta(obj_info->obj, (const uint8_t *)obj, delta_size);
+      obj = obj_info->obj;
+    } else {
+      DEBUG_ERR("No base object for the delta of " << *key << ", drop it");
+      obj = nullptr;
+      obj_size = 0;
+    }
+  }
+
   update_object_info(mp, obj_info, version, obj, obj_size);
+  invalidate_ro_holders(obj_info, map_id, key);
 
   if (scaling.on && obj_info->transfer_key_ownership_to >= 0) {
     uint32_t waiters = -1;
@@ -1226,7 +1916,7 @@ int SWObjectManager::remote_notify_expire_rwref(int map_id, const Key *key,
         cbus, node_id, obj_info->transfer_key_ownership_to,
         key_space->get_version(), map_id, key, obj_info->version, obj_info->obj,
         obj_info->obj_size, waiters);
-    worker->send_message(obj_info->transfer_key_ownership_to, m);
+    send_message(obj_info->transfer_key_ownership_to, m);
 
     stats.own_objects--;
 
@@ -1248,6 +1938,7 @@ int SWObjectManager::remote_notify_expire_rwref(int map_id, const Key *key,
   if (next == node_id) {
     obj_info->is_owned = true;
     obj_info->cur_worker = node_id;
+    record_rw_grant(obj_info, node_id);
 
     set_rwobj(map_id, key, obj_info->version, obj_info->obj_size, obj_info->obj,
               node_id);
@@ -1275,6 +1966,7 @@ int SWObjectManager::remote_notify_return_key_ownership(
 
   if (obj != nullptr) {
     update_object_info(mp, obj_info, version, obj, obj_size);
+    invalidate_ro_holders(obj_info, map_id, key);
     stats.obj_import++;
   }
 
@@ -1295,6 +1987,7 @@ int SWObjectManager::remote_notify_return_key_ownership(
   if (to == node_id) {
     obj_info->is_owned = true;
     obj_info->cur_worker = node_id;
+    record_rw_grant(obj_info, node_id);
 
     set_rwobj(map_id, key, obj_info->version, obj_info->obj_size, obj_info->obj,
               node_id);
@@ -6,9 +6,12 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "access_tracker.hh"
 #include "key.hh"
+#include "key_map.hh"
 #include "log.hh"
 #include "type.hh"
+#include "worker_config.hh"
 
 class Worker;
 class KeySpace;
@@ -20,11 +23,27 @@ class MessageBuffer;
 
 struct ObjectInfo;
 struct ObjReturn;
+struct Prefetch;
 struct RefState;
 
-typedef std::unordered_map<const Key *, ObjectInfo *, _dr_key_hash,
-                           _dr_key_equal_to>
-    ObjInfoMap;
+typedef KeyMap<ObjectInfo *> ObjInfoMap;
+
+// a key moves to the worker that took its rw lease this many times more than
+// the others did (see move_home())
+#define SW_HOME_MOVE_GRANTS 8
+
+#define SW_LEASE_BATCH_SIZE 4096  // bytes of a batched lease message
+#define SW_LEASE_BATCH_US 10      // the oldest lease in a batch waits this long
+
+// a prefetched object not referenced by then goes back (see prefetch_object())
+#define SW_PREFETCH_TIMEOUT_US 10000
+
+// rw lease requests (or responses) to a worker, sent as one message
+struct LeaseBatch {
+  uint64_t init_tsc;
+  uint32_t offset;  // 0 while empty
+  uint8_t buf[SW_LEASE_BATCH_SIZE];
+};
 
 /*
    Map between key and istance_id in charge of the key
@@ -45,6 +64,15 @@ class SWObjectManager {
 
   std::unordered_map<const Key *, ObjReturn *, _dr_key_hash, _dr_key_equal_to>
       object_ret_map[_MAX_DMAPS];
+  // copies for read-only replicas, see get_roobj()
+  std::unordered_map<const Key *, ObjReturn *, _dr_key_hash, _dr_key_equal_to>
+      object_ro_ret_map[_MAX_DMAPS];
+  // copies of large objects as leased from others, to return only the delta
+  std::unordered_map<const Key *, ObjReturn *, _dr_key_hash, _dr_key_equal_to>
+      lease_base_map[_MAX_DMAPS];
+  // requested at rx time, not yet claimed by a reference; [is_const]
+  std::unordered_map<const Key *, Prefetch *, _dr_key_hash, _dr_key_equal_to>
+      prefetch_map[2][_MAX_DMAPS];
 
   WorkerID node_id;
 
@@ -53,6 +81,8 @@ class SWObjectManager {
   KeySpace *key_space = nullptr;
   MemPool *mp = nullptr;
 
+  AccessTracker access_tracker;  // accesses to the objects I manage
+
   struct {
     bool dmz_to_scaling_on = false;
     bool dmz_to_quiescent_on = false;
@@ -63,6 +93,13 @@ class SWObjectManager {
   ControlBus *cbus;
   Worker *worker = nullptr;
 
+  // per destination, see add_to_lease_batch()
+  LeaseBatch lease_req_batch[MAX_WORKER_CNT] = {};
+  LeaseBatch lease_res_batch[MAX_WORKER_CNT] = {};
+  int lease_batch_cnt = 0;       // non-empty ones
+  bool batch_responses = false;  // while serving a batch of requests
+  uint64_t lease_batch_tsc;      // SW_LEASE_BATCH_US
+
   struct {
     uint32_t counter;
 
@@ -89,6 +126,31 @@ class SWObjectManager {
                                   int version);
   void obj_map_clean_up();
 
+  // a message to a worker goes after the leases batched for it
+  void send_message(WorkerID to, MessageBuffer *m);
+  void *add_to_lease_batch(LeaseBatch *batch, WorkerID to, uint16_t mtype,
+                           uint32_t size);
+  void flush_lease_batch(LeaseBatch *batch, WorkerID to);
+  void request_object_ownership(WorkerID to, int map_id, const Key *key,
+                                bool force_to_create);
+  void response_object_ownership(WorkerID to, int map_id, const Key *key,
+                                 int version, void *obj, uint32_t obj_size);
+
+  void keep_lease_base(int map_id, const Key *key, int version,
+                       uint32_t obj_size, void *obj, WorkerID created_from);
+  // nullptr if none of the version; the caller frees it
+  ObjReturn *take_lease_base(int map_id, const Key *key, int version);
+  void free_lease_base(ObjReturn *base);
+
+  Prefetch *create_prefetch(int map_id, const Key *key, bool is_const);
+  void delete_prefetch(Prefetch *p);
+  // true if the object is on the way, as requested by prefetch_*()
+  bool claim_prefetch(int map_id, const Key *key, bool is_const);
+  Prefetch *get_prefetch(int map_id, const Key *key, bool is_const);
+  // gives back the object, which has arrived, unused
+  void return_prefetched(Prefetch *p);
+  static void on_prefetch_timeout(void *arg);
+
   /* for scaling */
   ObjectInfo *create_object_info_in_nextspace(int map_id, const Key *key);
   void move_object_info_to_nextspace(int map_id, const Key *key);
@@ -99,6 +161,16 @@ class SWObjectManager {
                                 const Key *key, WorkerID from_id);
   void delete_object_binary(ObjectInfo *obj_info, int map_id, const Key *key,
                             int version, bool cleanup);
+  // the committed object changes, so the replicas of it are stale
+  void invalidate_ro_holders(ObjectInfo *obj_info, int map_id,
+                             const Key *key);
+
+  /* per-key home, over the manager by the rule */
+  bool should_move_home(ObjectInfo *obj_info, int map_id, const Key *key,
+                        WorkerID to);
+  void move_home(ObjectInfo *obj_info, int map_id, const Key *key,
+                 WorkerID to);
+  void return_home(int map_id, const Key *key);
 
   // might blocking until satisyfing wake-up condition by set_rwobj()
   void get_rwobj(int map_id, const Key *key, int &version, uint32_t &obj_size,
@@ -106,25 +178,23 @@ class SWObjectManager {
 
   // satisfying wake-up condition locally/remotely
   // previously blocked by get_rwobj()
+  // data is a delta against zeros unless delta_size < 0
   void set_rwobj(int map_id, const Key *key, int version, uint32_t obj_size,
-                 void *data, WorkerID created_from);
+                 void *data, WorkerID created_from, int delta_size = -1);
+
+  // might blocking until remote_set_cache()
+  void get_roobj(int map_id, const Key *key, int &version, uint32_t &obj_size,
+                 void **data);
 
  public:
   SWObjectManager(uint32_t node_id, Worker *worker, DroutineScheduler *sch,
-                  ControlBus *cbus, KeySpace *key_space, MemPool *mp) {
-    this->node_id = node_id;
-
-    this->scheduler = sch;
-    this->key_space = key_space;
-
-    this->worker = worker;
-    this->cbus = cbus;
-    this->mp = mp;
-  }
+                  ControlBus *cbus, KeySpace *key_space, MemPool *mp);
   ~SWObjectManager() {}
 
   void set_keyspace(KeySpace *key_space) { this->key_space = key_space; }
 
+  AccessTracker *get_access_tracker() { return &access_tracker; }
+
   void set_swstub_manager(SwStubManager *swstub_manager) {
     this->swstub_manager = swstub_manager;
   }
@@ -156,6 +226,22 @@ class SWObjectManager {
   void print_object_stats();
   int force_scaling(int max_objects);
 
+  // the responses to the requests served in between are sent as one batch
+  void begin_lease_batch() { batch_responses = true; }
+  void end_lease_batch();
+  // sends the batches older than SW_LEASE_BATCH_US (all, if force, e.g.,
+  // when no routine can run until the leases come)
+  void flush_lease_batches(bool force);
+
+  // without blocking, for the reference of a packet yet to be processed
+  void prefetch_object(int map_id, const Key *key);
+  void prefetch_cache(int map_id, const Key *key);
+  // an invalidated replica is not worth claiming
+  void drop_prefetched_cache(int map_id, const Key *key);
+  // the manager wants back a prefetched lease, which no reference has yet;
+  // returns -1 if there is no such lease
+  int expire_prefetched(int map_id, const Key *key, int version);
+
   void teardown(bool force);
 
   // Called by application thread: May call yield()
@@ -167,7 +253,10 @@ class SWObjectManager {
                           WorkerID created_from);
   int local_cleanup_meta(int map_id, const Key *key, int version,
                          WorkerID created_from);
-  int local_create_cache(int map_id, const Key *key, int &version);
+  // a copy of the last committed object (in the pool) for a read-only
+  // replica; valid until the holder is invalidated
+  int local_create_cache(int map_id, const Key *key, int &version,
+                         uint32_t &obj_size, void **obj);
   int local_notify_expire_rwref(int map_id, const Key *key, int version,
                                 uint32_t obj_size, void *obj,
                                 WorkerID created_from);
@@ -175,6 +264,11 @@ class SWObjectManager {
   // Called by control network thread
   void remote_create_object(int map_id, const Key *key, WorkerID from_id);
   void remote_lookup_object(int map_id, const Key *key, WorkerID from_id);
+  void remote_create_cache(int map_id, const Key *key, WorkerID from_id);
+  void remote_set_cache(int map_id, const Key *key, int version,
+                        uint32_t obj_size, void *data);
+  void remote_accept_home(int map_id, const Key *key, int version,
+                          uint32_t obj_size, void *data, WorkerID from_id);
   void remote_return_key_ownership(int map_id, const Key *key,
                                    WorkerID from_id);
   int remote_delete_object(int map_id, const Key *key, int version,
@@ -184,10 +278,10 @@ class SWObjectManager {
 
   void remote_set_object_ownership(int map_id, const Key *key, int version,
                                    uint32_t obj_size, void *data,
-                                   WorkerID created_from);
+                                   WorkerID created_from, int delta_size);
   int remote_notify_expire_rwref(int map_id, const Key *key, int version,
                                  uint32_t obj_size, void *obj,
-                                 WorkerID created_from);
+                                 WorkerID created_from, int delta_size);
   int remote_notify_return_key_ownership(int map_id, const Key *key,
                                          int version, uint32_t obj_size,
                                          void *obj, WorkerID from_id,
@@ -6,6 +6,7 @@
 #include "stub_factory.hh"
 #include "sw_stub.hh"
 #include "swstub_manager.hh"
+#include "time.hh"
 
 int active_references = 0;
 
@@ -18,6 +19,14 @@ struct SwStubInfo {
   int local_rw_cnt;
 
   SwStubBase *ref = nullptr;
+
+  // idle timeout; the timer may fire before expire_tsc, then it is re-armed
+  int map_id;
+  const Key *key;  // the one in swstub_map
+  SwStubManager *manager;
+  uint64_t ttl_tsc = 0;
+  uint64_t expire_tsc = 0;
+  Timer *expiry = nullptr;
 };
 
 struct SWDeadObjInfo {
@@ -30,11 +39,24 @@ struct SWDeadObjInfo {
 
 struct SwStubROInfo {
   bool is_blocked;  // access is now blocking to make SwStub remotely
+  bool is_stale;    // invalidated, fetched again for new references
 
   int version;
   int local_ro_cnt;
 
   SwStubBase *ref = nullptr;
+
+  // copy of the last committed object, unless read through the local rw ref
+  SwStubBase *replica = nullptr;
+  uint64_t lease_expire_tsc = 0;
+  Timer *lease = nullptr;
+
+  int map_id;
+  const Key *key;  // the one in swstub_ro_map
+  SwStubManager *manager;
+
+  bool in_lru = false;  // unreferenced replica
+  TAILQ_ENTRY(SwStubROInfo) lru_elem;
 };
 
 inline static void reset_swstub_info(SwStubInfo *swstub_info) {
@@ -84,7 +106,21 @@ inline static void delete_all_swstub_info(MemPool *mp,
   delete swstub_info;
 }
 
-inline static void delete_all_swstub_ro_info(SwStubROInfo *swstub_info) {
+inline static void drop_replica(MemPool *mp, SwStubROInfo *swstub_info) {
+  if (!swstub_info->replica)
+    return;
+
+  mp->free(swstub_info->replica->_obj);
+  delete swstub_info->replica;
+  swstub_info->replica = nullptr;
+}
+
+inline static void delete_all_swstub_ro_info(MemPool *mp, TimerWheel *timers,
+                                             SwStubROInfo *swstub_info) {
+  if (swstub_info->lease)
+    timers->cancel(swstub_info->lease);
+
+  drop_replica(mp, swstub_info);
   delete swstub_info->ref;
   delete swstub_info;
 }
@@ -133,7 +169,7 @@ void SwStubManager::teardown(bool force) {
       it = swstub_map.erase(it);
 
       delete key;
-      delete_all_swstub_ro_info(info);
+      delete_all_swstub_ro_info(mp, timers, info);
     }
   }
 
@@ -145,6 +181,7 @@ void SwStubManager::teardown(bool force) {
 
       it = swstub_map.erase(it);
 
+      cancel_expiry(info);
       delete key;
       delete_all_swstub_info(mp, info);
     }
@@ -188,7 +225,10 @@ SwStubInfo *SwStubManager::create_swstub_info(int map_id, const Key *key) {
 
   reset_swstub_info(swstub_info);
 
-  swstub_map[key->clone()] = swstub_info;
+  swstub_info->map_id = map_id;
+  swstub_info->key = key->clone();
+  swstub_info->manager = this;
+  swstub_map[swstub_info->key] = swstub_info;
 
   return swstub_info;
 }
@@ -204,6 +244,7 @@ void SwStubManager::erase_swstub_info(int map_id, const Key *key, int version) {
   const Key *it_key = it->first;
   SwStubInfo *swstub_info = it->second;
 
+  cancel_expiry(swstub_info);
   swstub_map.erase(it);
   delete it_key;
 }
@@ -241,11 +282,15 @@ SwStubROInfo *SwStubManager::create_swstub_ro_info(int map_id, const Key *key) {
   }
 
   swstub_info->is_blocked = false;
+  swstub_info->is_stale = false;
   swstub_info->version = -1;
   swstub_info->local_ro_cnt = 0;
   swstub_info->ref = nullptr;
 
   const Key *ckey = key->clone();
+  swstub_info->map_id = map_id;
+  swstub_info->key = ckey;
+  swstub_info->manager = this;
   swstub_map[ckey] = swstub_info;
 
   return swstub_info;
@@ -339,13 +384,22 @@ SwStubBase *SwStubManager::create_rwref(int map_id, const Key *key,
     return StubFactory::GetSwStubBase(map_id, key, version, obj,
                                       false /* is new */);
   } else {
+    // a new flow, unless shedding load; the manager drops the key again
+    if (scheduler && !scheduler->admit_new_flow()) {
+      swobj_manager->local_delete_object(map_id, key, version, true,
+                                         created_from);
+      active_references--;
+      errno = -ENOMEM;
+      return nullptr;
+    }
+
     state.created = true;
     DEBUG_DEV("SET SWREF " << *key << " with object creation ver." << version);
 
     void *obj = mp->malloc(__global_dobj_size[map_id]);
     if (!obj) {
       DEBUG_ERR("Fail to malloc");
-      assert(0);
+      errno = -ENOMEM;
       return nullptr;
     }
     return StubFactory::GetSwStubBase(map_id, key, version, obj,
@@ -377,6 +431,7 @@ int SwStubManager::delete_rwref(int map_id, const Key *key,
                                    << swstub_info->local_rw_cnt);
 
   if (swstub_info->local_rw_cnt == 0) {
+    keep_ro_readers(map_id, key, swstub_info);
     erase_swstub_info(map_id, key, swstub_info->version);
     delete_all_swstub_info(mp, swstub_info);
   } else {
@@ -388,29 +443,131 @@ int SwStubManager::delete_rwref(int map_id, const Key *key,
   return 0;
 }
 
-SwStubBase *SwStubManager::create_roref(int map_id, const Key *key,
-                                        int &version) {
-  int ret = swobj_manager->local_create_cache(map_id, key, version);
-  if (ret < 0) {
-    return nullptr;
+// (re)validates swstub_info, in place since references may share its ref
+int SwStubManager::fetch_roref(int map_id, const Key *key,
+                               SwStubROInfo *swstub_info) {
+  int version;
+
+  // invalidations from here on are for what is fetched now
+  swstub_info->is_stale = false;
+
+  SwStubInfo *rw_info = get_swstub_info(map_id, key);
+  if (rw_info && rw_info->ref) {
+    // the rw reference is here, read through it
+    version = rw_info->version;
+    drop_replica(mp, swstub_info);
+  } else {
+    uint32_t obj_size;
+    void *obj;
+    // this could be blocked
+    int ret = swobj_manager->local_create_cache(map_id, key, version, obj_size,
+                                                &obj);
+    if (ret < 0)
+      return -1;
+
+    SwStubBase *replica =
+        StubFactory::GetSwStubBase(map_id, key, version, obj, false);
+    if (!replica) {
+      mp->free(obj);
+      return -1;
+    }
+
+    drop_replica(mp, swstub_info);
+    swstub_info->replica = replica;
+
+    uint64_t lease_tsc = get_tsc_freq() / 1000000 * SW_RO_LEASE_US;
+    swstub_info->lease_expire_tsc = get_cur_rdtsc() + lease_tsc;
+    if (timers && !swstub_info->lease)
+      swstub_info->lease = timers->schedule_at(swstub_info->lease_expire_tsc,
+                                               on_lease_expiry, swstub_info);
   }
   assert(version >= 0);
 
-  DEBUG_DEV("SET SWREF for RO" << *key << " with object creation ver."
-                               << version);
-  return StubFactory::GetSwStubBase_RO(map_id, key, version, this);
+  if (!swstub_info->ref) {
+    swstub_info->ref =
+        StubFactory::GetSwStubBase_RO(map_id, key, version, this);
+    if (!swstub_info->ref)
+      return -1;
+  }
+
+  DEBUG_DEV("SET SWREF for RO " << *key << " ver." << version
+                                << (swstub_info->replica ? " (replica)" : ""));
+
+  // the references read this version from now on
+  swstub_info->version = version;
+  swstub_info->ref->_obj_version = version;
+  return 0;
 }
 
 int SwStubManager::delete_roref(int map_id, const Key *key,
                                 SwStubROInfo *swstub_info) {
   DEBUG_DEV("delete read only reference with version " << swstub_info->version);
 
+  if (swstub_info->in_lru)
+    TAILQ_REMOVE(&ro_lru, swstub_info, lru_elem);
+
   erase_swstub_ro_info(map_id, key, swstub_info->version);
-  delete_all_swstub_ro_info(swstub_info);
+  delete_all_swstub_ro_info(mp, timers, swstub_info);
 
   return 0;
 }
 
+bool SwStubManager::is_ro_fresh(int map_id, const Key *key,
+                                SwStubROInfo *swstub_info) {
+  if (!swstub_info->ref || swstub_info->is_stale)
+    return false;
+
+  if (!swstub_info->replica)
+    return is_obj_alive(map_id, key, swstub_info->version);
+
+  return get_cur_rdtsc() < swstub_info->lease_expire_tsc;
+}
+
+// the rw reference is going; its readers keep the object until released
+void SwStubManager::keep_ro_readers(int map_id, const Key *key,
+                                    SwStubInfo *swstub_info) {
+  SwStubROInfo *ro_info = get_swstub_ro_info(map_id, key);
+  if (!ro_info || ro_info->replica || ro_info->local_ro_cnt == 0 ||
+      ro_info->version != swstub_info->version || !swstub_info->ref)
+    return;
+
+  ro_info->replica = swstub_info->ref;
+  ro_info->is_stale = true;
+  swstub_info->ref = nullptr;
+}
+
+void SwStubManager::on_lease_expiry(void *arg) {
+  SwStubROInfo *swstub_info = static_cast<SwStubROInfo *>(arg);
+  SwStubManager *manager = swstub_info->manager;
+
+  swstub_info->lease = nullptr;
+
+  // renewed since armed
+  if (swstub_info->lease_expire_tsc > get_cur_rdtsc()) {
+    swstub_info->lease = manager->timers->schedule_at(
+        swstub_info->lease_expire_tsc, on_lease_expiry, swstub_info);
+    return;
+  }
+
+  // referenced ones are deleted at the last release
+  if (swstub_info->in_lru)
+    manager->delete_roref(swstub_info->map_id, swstub_info->key, swstub_info);
+}
+
+size_t SwStubManager::evict_replicas(void *arg, size_t bytes) {
+  SwStubManager *manager = static_cast<SwStubManager *>(arg);
+  size_t freed = 0;
+
+  while (freed < bytes && !TAILQ_EMPTY(&manager->ro_lru)) {
+    SwStubROInfo *swstub_info = TAILQ_FIRST(&manager->ro_lru);
+
+    freed += manager->mp->chunk_size_of(swstub_info->replica->_obj);
+    manager->delete_roref(swstub_info->map_id, swstub_info->key, swstub_info);
+  }
+
+  return freed;
+}
+
 /*
  * Return SwStub states - alive, accessible, transferrable
  * */
@@ -456,8 +613,14 @@ SwStubBase *SwStubManager::create(int map_id, const Key *key, RefState &state) {
       WorkerID created_from;
       // this could be blocked
       SwStubBase *ref = create_rwref(map_id, key, version, state, created_from);
-      if (!ref)
+      if (!ref) {
+        // the waiters retry by themselves, e.g., a flow not admitted leaves
+        // nothing behind
+        erase_swstub_info(map_id, key, swstub_info->version);
+        delete swstub_info;
+        notify_rw_ref_is_ready(scheduler, map_id, key);
         return nullptr;
+      }
 
       swstub_info->created_from = created_from;
       swstub_info->ref = ref;
@@ -583,46 +746,116 @@ void SwStubManager::delete_object(int map_id, const Key *key, int version) {
   delete_rwref(map_id, key, swstub_info);
 }
 
+void SwStubManager::set_idle_timeout(int map_id, const Key *key, int version,
+                                     uint64_t ttl_us) {
+  SwStubInfo *swstub_info = get_swstub_info(map_id, key);
+  if (!swstub_info || swstub_info->version != version || !timers)
+    return;
+
+  if (ttl_us == 0) {
+    cancel_expiry(swstub_info);
+    swstub_info->ttl_tsc = 0;
+    return;
+  }
+
+  // moves the deadline only; the timer catches up when it fires
+  swstub_info->ttl_tsc = timers->us_to_tsc(ttl_us);
+  swstub_info->expire_tsc = get_cur_rdtsc() + swstub_info->ttl_tsc;
+  if (!swstub_info->expiry)
+    swstub_info->expiry =
+        timers->schedule_at(swstub_info->expire_tsc, on_expiry, swstub_info);
+}
+
+void SwStubManager::on_expiry(void *arg) {
+  SwStubInfo *swstub_info = static_cast<SwStubInfo *>(arg);
+
+  swstub_info->expiry = nullptr;
+  swstub_info->manager->expire_idle_object(swstub_info);
+}
+
+void SwStubManager::expire_idle_object(SwStubInfo *swstub_info) {
+  uint64_t now = get_cur_rdtsc();
+
+  // accessed since armed, or referenced (e.g., by a blocked routine)
+  if (swstub_info->expire_tsc > now || swstub_info->local_rw_cnt > 0 ||
+      swstub_info->is_blocked || !swstub_info->ref) {
+    uint64_t deadline = swstub_info->expire_tsc;
+    if (deadline <= now)
+      deadline = now + swstub_info->ttl_tsc;
+
+    swstub_info->expiry = timers->schedule_at(deadline, on_expiry, swstub_info);
+    return;
+  }
+
+  // the key in swstub_map is freed on the way
+  const Key *key = swstub_info->key->clone();
+  DEBUG_DEV("expire idle object " << *key << " ver." << swstub_info->version);
+
+  sw_expire_func fn = __global_sw_expire_func[swstub_info->map_id];
+  if (fn && swstub_info->ref->_obj)
+    fn(key, swstub_info->ref->_obj);
+
+  // as if the application deletes it through a reference
+  swstub_info->local_rw_cnt++;
+  delete_object(swstub_info->map_id, key, swstub_info->version);
+  delete key;
+}
+
+void SwStubManager::cancel_expiry(SwStubInfo *swstub_info) {
+  if (!swstub_info->expiry)
+    return;
+
+  timers->cancel(swstub_info->expiry);
+  swstub_info->expiry = nullptr;
+}
+
 SwStubBase *SwStubManager::lookup_cache(int map_id, const Key *key) {
   SwStubROInfo *swstub_info = get_swstub_ro_info(map_id, key);
-  if (!swstub_info)
-    swstub_info = create_swstub_ro_info(map_id, key);
-
-  while (!swstub_info->ref) {
-    if (!swstub_info->is_blocked) {
-      swstub_info->is_blocked = true;
 
-      int version;
-      SwStubBase *ref = create_roref(map_id, key, version);
-      // FIX ME: it is possible to create to request cache, but not actually
-      // exisit
-      if (!ref) {
-        // XXX do not notify swstub_ro is not available to other coroutines
-        erase_swstub_ro_info(map_id, key, -1);
-        delete_all_swstub_ro_info(swstub_info);
+  while (!swstub_info || !is_ro_fresh(map_id, key, swstub_info)) {
+    if (!swstub_info) {
+      swstub_info = create_swstub_ro_info(map_id, key);
+      if (!swstub_info)
         return nullptr;
-      }
-
-      swstub_info->ref = ref;
-      swstub_info->is_blocked = false;
-      swstub_info->version = version;
+    }
 
-      notify_ro_ref_is_ready(scheduler, map_id, key);
-    } else {
+    if (swstub_info->is_blocked) {
       // while loop, since,
       // object may deleted between notification and actual scheduling
       wait_ro_ref_is_ready(scheduler, map_id, key);
+      swstub_info = get_swstub_ro_info(map_id, key);
+      if (!swstub_info)
+        return nullptr;  // no object to read
+      continue;
+    }
+
+    swstub_info->is_blocked = true;
+    if (swstub_info->in_lru) {
+      TAILQ_REMOVE(&ro_lru, swstub_info, lru_elem);
+      swstub_info->in_lru = false;
     }
 
-    assert(swstub_info->ref);
-    swstub_info->local_ro_cnt++;
+    int ret = fetch_roref(map_id, key, swstub_info);
+    swstub_info->is_blocked = false;
+    notify_ro_ref_is_ready(scheduler, map_id, key);
+
+    if (ret < 0) {
+      if (swstub_info->local_ro_cnt == 0)
+        delete_roref(map_id, key, swstub_info);
+      return nullptr;
+    }
 
-    return swstub_info->ref;
+    // even if invalidated meanwhile, as of the request
+    break;
   }
 
+  if (swstub_info->in_lru) {
+    TAILQ_REMOVE(&ro_lru, swstub_info, lru_elem);
+    swstub_info->in_lru = false;
+  }
   swstub_info->local_ro_cnt++;
 
-  return (SwStubBase *)swstub_info->ref;
+  return swstub_info->ref;
 }
 
 int SwStubManager::release_cache(int map_id, const Key *key, int version) {
@@ -633,19 +866,67 @@ int SwStubManager::release_cache(int map_id, const Key *key, int version) {
   }
 
   swstub_info->local_ro_cnt--;
+  if (swstub_info->local_ro_cnt > 0 || swstub_info->is_blocked)
+    return 0;
 
-  // XXX delaying delete ro reference
-  if (swstub_info->local_ro_cnt == 0) {
+  // a replica is kept for the next references, until the lease expires
+  if (swstub_info->replica && is_ro_fresh(map_id, key, swstub_info)) {
+    TAILQ_INSERT_TAIL(&ro_lru, swstub_info, lru_elem);
+    swstub_info->in_lru = true;
+  } else {
     delete_roref(map_id, key, swstub_info);
   }
 
   return 0;
 }
 
+void SwStubManager::invalidate_cache(int map_id, const Key *key) {
+  swobj_manager->drop_prefetched_cache(map_id, key);
+
+  SwStubROInfo *swstub_info = get_swstub_ro_info(map_id, key);
+  if (!swstub_info)
+    return;
+
+  DEBUG_DEV("invalidate read only reference " << *key << " ver."
+                                              << swstub_info->version);
+
+  if (swstub_info->in_lru) {
+    delete_roref(map_id, key, swstub_info);
+    return;
+  }
+
+  // current references keep reading it
+  swstub_info->is_stale = true;
+}
+
+void SwStubManager::prefetch(int map_id, const Key *key, bool is_const) {
+  // held, or being requested by a reference
+  if (get_swstub_info(map_id, key))
+    return;
+
+  if (!is_const) {
+    if (scheduler && !scheduler->is_admitting())
+      return;
+    swobj_manager->prefetch_object(map_id, key);
+    return;
+  }
+
+  SwStubROInfo *swstub_info = get_swstub_ro_info(map_id, key);
+  if (swstub_info &&
+      (swstub_info->is_blocked || is_ro_fresh(map_id, key, swstub_info)))
+    return;
+
+  swobj_manager->prefetch_cache(map_id, key);
+}
+
 int SwStubManager::request_expire_local_rwref(int map_id, const Key *key,
                                               int version) {
   SwStubInfo *swstub_info = get_swstub_info(map_id, key);
   if (!swstub_info) {
+    // a prefetched lease no reference has claimed yet
+    if (swobj_manager->expire_prefetched(map_id, key, version) == 0)
+      return 0;
+
     DEBUG_ERR("No SwStubInfo");
     return -1;
   }
@@ -695,18 +976,29 @@ void SwStubManager::execute_rpc(int map_id, const Key *key, int version,
                                 uint32_t flag, uint32_t method_id, void *args,
                                 uint32_t args_size, void *ret,
                                 uint32_t ret_size) {
+  SwStubBase *ref = nullptr;
+
+  // the rw reference, its dead one, then the replica
   SwStubInfo *swstub_info = get_swstub_info(map_id, key);
+  if (swstub_info && swstub_info->version == version)
+    ref = swstub_info->ref;
 
-  if (!swstub_info || swstub_info->version != version) {
+  if (!ref) {
     SWDeadObjInfo *deadobj_info = get_deadobj_info(map_id, key, version);
-    if (!deadobj_info) {
-      DEBUG_ERR("request rpc for dead objects");
-      exit(EXIT_FAILURE);
-    }
+    if (deadobj_info)
+      ref = deadobj_info->ref;
+  }
 
-    deadobj_info->ref->exec(method_id, args, args_size, &ret, &ret_size);
+  if (!ref) {
+    SwStubROInfo *ro_info = get_swstub_ro_info(map_id, key, version);
+    if (ro_info)
+      ref = ro_info->replica;
   }
 
-  swstub_info->ref->exec(method_id, args, args_size, &ret, &ret_size);
-  return;
+  if (!ref) {
+    DEBUG_ERR("request rpc for dead objects");
+    exit(EXIT_FAILURE);
+  }
+
+  ref->exec(method_id, args, args_size, &ret, &ret_size);
 }
@@ -3,13 +3,20 @@
 
 #include <cstdint>
 #include <queue>
+#include <sys/queue.h>
 #include <unordered_map>
 
 #include "key.hh"
+#include "key_map.hh"
 #include "mem_pool.hh"
 #include "swobj_manager.hh"
+#include "timer_wheel.hh"
 #include "type.hh"
 
+// a replica of a remote object is used without asking the owner for this
+// long, unless invalidated earlier by a new version of the object
+#define SW_RO_LEASE_US 100000
+
 class SwStubBase;
 
 struct SwStubInfo;     // RW Reference for single-writable objects
@@ -21,9 +28,7 @@ class DroutineScheduler;
 
 struct RefState;
 
-typedef std::unordered_map<const Key *, SwStubInfo *, _dr_key_hash,
-                           _dr_key_equal_to>
-    SwStubMap;
+typedef KeyMap<SwStubInfo *> SwStubMap;
 
 typedef std::unordered_map<const Key *, SwStubROInfo *, _dr_key_hash,
                            _dr_key_equal_to>
@@ -42,6 +47,10 @@ class SwStubManager {
   DroutineScheduler *scheduler;
   SWObjectManager *swobj_manager = nullptr;
   MemPool *mp = nullptr;
+  TimerWheel *timers = nullptr;
+
+  // unreferenced replicas, least recently used first
+  TAILQ_HEAD(ro_lru_head, SwStubROInfo) ro_lru;
 
   /* handle 'swstub info' for rw */
   SwStubInfo *get_swstub_info(int map_id, const Key *key);
@@ -69,21 +78,40 @@ class SwStubManager {
   SwStubBase *lookup_rwref(int map_id, const Key *key, int &version,
                            WorkerID &created_from);
   int delete_rwref(int map_id, const Key *key, SwStubInfo *swstub_info);
-  SwStubBase *create_roref(int map_id, const Key *key, int &version);
+  int fetch_roref(int map_id, const Key *key, SwStubROInfo *swstub_info);
   int delete_roref(int map_id, const Key *key, SwStubROInfo *swstub_info);
+  bool is_ro_fresh(int map_id, const Key *key, SwStubROInfo *swstub_info);
+  void keep_ro_readers(int map_id, const Key *key, SwStubInfo *swstub_info);
+
+  /* lease and eviction of ro replicas */
+  static void on_lease_expiry(void *arg);
+  static size_t evict_replicas(void *arg, size_t bytes);
 
   void execute_rpc(int map_id, const Key *key, int version, uint32_t flag,
                    uint32_t method_id, void *args, uint32_t args_size,
                    void *ret, uint32_t ret_size);
 
+  /* idle timeout of rw objects */
+  static void on_expiry(void *arg);
+  void expire_idle_object(SwStubInfo *swstub_info);
+  void cancel_expiry(SwStubInfo *swstub_info);
+
  public:
-  SwStubManager(DroutineScheduler *sch, MemPool *mp) : scheduler(sch), mp(mp){};
+  SwStubManager(DroutineScheduler *sch, MemPool *mp) : scheduler(sch), mp(mp) {
+    for (int map_id = 0; map_id < ADT_cnt; map_id++)
+      swstub_rw_map_arr[map_id].set_key_ops(__get_key_ops(map_id));
+
+    TAILQ_INIT(&ro_lru);
+    mp->add_evictor(evict_replicas, this);
+  };
   ~SwStubManager(){};
 
   void set_swobj_manager(SWObjectManager *swobj_manager) {
     this->swobj_manager = swobj_manager;
   }
 
+  void set_timer_wheel(TimerWheel *timers) { this->timers = timers; }
+
   void teardown(bool force);
 
   // swstub status checking
@@ -100,9 +128,17 @@ class SwStubManager {
   SwStubBase *lookup(int map_id, const Key *key);  // can be blocked
   int release(int map_id, const Key *key, int version);
   void delete_object(int map_id, const Key *key, int version);
+  // deletes the object after ttl_us without another call, 0 to disable
+  void set_idle_timeout(int map_id, const Key *key, int version,
+                        uint64_t ttl_us);
 
   SwStubBase *lookup_cache(int map_id, const Key *key);  // can be blocked
   int release_cache(int map_id, const Key *key, int version);
+  // a new version of the object is committed by its owner
+  void invalidate_cache(int map_id, const Key *key);
+
+  // requests the object of a later reference, unless it is here already
+  void prefetch(int map_id, const Key *key, bool is_const);
 
   // Called locally or remotely
   int request_expire_local_rwref(int map_id, const Key *key, int version);
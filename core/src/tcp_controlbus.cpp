@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 
 #include <cassert>
@@ -10,6 +11,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "log.hh"
@@ -17,18 +19,34 @@
 
 typedef struct {
   std::size_t total_size;  // required to use stream as datagram
+  struct recv_slab *slab;  // (receiver only) slab holding the message
 } VirtualHeader __attribute__((packed));
 
+// MessageBuffer and VirtualHeader, i.e., what is needed to get the frame size
+#define FRAME_HEAD_SIZE (sizeof(MessageBuffer) + sizeof(VirtualHeader))
+#define FRAME_ALIGN 8
+
+static const u_char zero_pad[FRAME_ALIGN] = {0};
+
+static inline int frame_size(std::size_t total_size) {
+  std::size_t len = sizeof(MessageBuffer) + total_size;
+  return (len + FRAME_ALIGN - 1) & ~(std::size_t)(FRAME_ALIGN - 1);
+}
+
 TCPControlBus::TCPControlBus() {}
 
 TCPControlBus::~TCPControlBus() {
   addr_to_fdinfo.clear();
 
   for (auto it = fd_to_fdinfo.begin(); it != fd_to_fdinfo.end();) {
-    delete it->second;
+    free_fd_info(it->second);
     it = fd_to_fdinfo.erase(it);
   }
   fd_to_fdinfo.clear();
+
+  for (auto slab : free_slabs)
+    std::free(slab);
+  free_slabs.clear();
 }
 
 // note: identical to the one in the SharedMemControlBus (except size)
@@ -45,6 +63,7 @@ MessageBuffer *TCPControlBus::allocate_message(
   if (ret != nullptr) {
     ret->body_offset = header_size;
     ret->body_size = messageSize;
+    reinterpret_cast<VirtualHeader *>(ret->buf)->slab = nullptr;
   }
   return ret;
 }
@@ -54,10 +73,52 @@ MessageBuffer *TCPControlBus::init_message(uint8_t *buf,
   MessageBuffer *mb = (MessageBuffer *)buf;
   mb->body_offset = sizeof(VirtualHeader);
   mb->body_size = buf_size - sizeof(MessageBuffer) - mb->body_offset;
+  reinterpret_cast<VirtualHeader *>(mb->buf)->slab = nullptr;
 
   return mb;
 }
 
+void TCPControlBus::free_message(MessageBuffer *message) const {
+  struct recv_slab *slab =
+      reinterpret_cast<VirtualHeader *>(message->buf)->slab;
+
+  if (slab)
+    release_slab(slab);
+  else
+    std::free(message);
+}
+
+struct recv_slab *TCPControlBus::alloc_slab(int cap) const {
+  struct recv_slab *slab = nullptr;
+
+  if (cap == MAX_BUFF_SIZE && !free_slabs.empty()) {
+    slab = free_slabs.back();
+    free_slabs.pop_back();
+  } else {
+    // 16-byte header keeps buf (and so every frame) 8-byte aligned
+    slab = (struct recv_slab *)std::malloc(sizeof(struct recv_slab) + cap);
+    if (!slab)
+      return nullptr;
+    slab->cap = cap;
+  }
+
+  slab->refcnt = 1;
+  slab->offset = 0;
+  slab->size = 0;
+  return slab;
+}
+
+void TCPControlBus::release_slab(struct recv_slab *slab) const {
+  assert(slab->refcnt > 0);
+  if (--slab->refcnt > 0)
+    return;
+
+  if (slab->cap == MAX_BUFF_SIZE && free_slabs.size() < MAX_FREE_SLABS)
+    free_slabs.push_back(slab);
+  else
+    std::free(slab);
+}
+
 Connector *TCPControlBus::register_address(const WorkerAddress &addr) {
   sockaddr_in s_addr;
   int so_reuseaddr = 1;
@@ -192,23 +253,54 @@ bool TCPControlBus::send(MessageBuffer *msg, const WorkerAddress &from,
       const_cast<void *>(msg->get_message_header()));
   header->total_size = msg->body_offset + msg->body_size;
 
-  std::queue<message_buffer_info> &send_queue = fi->send_queue;
-  if (send_queue.size() >= 256) {
+  std::deque<message_buffer_info> &send_queue = fi->send_queue;
+  if (send_queue.size() >= MAX_SEND_QUEUE) {
     flush_send_queue(fi);
     return false;
   }
-  send_queue.push(message_buffer_info(msg, 0, header->total_size));
+  int len = sizeof(MessageBuffer) + header->total_size;
+  send_queue.push_back(
+      message_buffer_info(msg, 0, len, frame_size(header->total_size)));
 
+  // msg may be freed from here on
   flush_send_queue(fi);
   return true;
 }
 
 bool TCPControlBus::flush_send_queue(struct fd_info *fi) {
-  std::queue<message_buffer_info> &send_queue = fi->send_queue;
+  std::deque<message_buffer_info> &send_queue = fi->send_queue;
   while (!send_queue.empty()) {
-    message_buffer_info &info = send_queue.front();
-    int ret = ::send(fi->fd, info.msgbuf->buf + info.offset,
-                     info.size - info.offset, MSG_NOSIGNAL);
+    struct iovec iov[MAX_SEND_IOV];
+    int iovcnt = 0;
+    ssize_t to_send = 0;
+
+    // gathers as many queued messages as possible (two entries per message)
+    for (auto &info : send_queue) {
+      if (iovcnt + 2 > MAX_SEND_IOV)
+        break;
+
+      if (info.offset < info.len) {
+        iov[iovcnt].iov_base = (u_char *)info.msgbuf + info.offset;
+        iov[iovcnt].iov_len = info.len - info.offset;
+        iovcnt++;
+      }
+
+      int pad_offset = std::max(info.offset, info.len);
+      if (pad_offset < info.size) {
+        iov[iovcnt].iov_base = (void *)(zero_pad + pad_offset - info.len);
+        iov[iovcnt].iov_len = info.size - pad_offset;
+        iovcnt++;
+      }
+
+      to_send += info.size - info.offset;
+    }
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = iovcnt;
+
+    ssize_t ret = sendmsg(fi->fd, &mh, MSG_NOSIGNAL);
     if (ret < 0) {
       if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
         // connection closed
@@ -219,13 +311,23 @@ bool TCPControlBus::flush_send_queue(struct fd_info *fi) {
       break;
     }
 
-    info.offset += ret;
     stats.send_bytes += ret;
 
-    if (info.offset != info.size)
-      break;
+    // frees the fully sent messages (send() took the ownership)
+    for (ssize_t sent = ret; sent > 0;) {
+      message_buffer_info &info = send_queue.front();
+      if (sent < info.size - info.offset) {
+        info.offset += sent;
+        break;
+      }
+
+      sent -= info.size - info.offset;
+      free_message(info.msgbuf);
+      send_queue.pop_front();
+    }
 
-    send_queue.pop();
+    if (ret != to_send)
+      break;
   }
 
   return true;
@@ -298,10 +400,15 @@ bool TCPControlBus::receive_from_all_fds() {
       auto iter = fd_to_fdinfo.find(fd);
       assert(iter != fd_to_fdinfo.end());
 
-      struct binary_buff *b = &iter->second->recv_buff;
+      if (!prepare_recv_slab(iter->second)) {
+        DEBUG_ERR("Fail to allocate a receive slab for " << iter->second->addr);
+        continue;
+      }
+
+      struct recv_slab *b = iter->second->rslab;
 
       ssize_t received = recv(fd, b->buf + b->offset + b->size,
-                              MAX_BUFF_SIZE - b->offset - b->size,
+                              b->cap - b->offset - b->size,
                               MSG_NOSIGNAL | MSG_DONTWAIT);
       if (received <= 0) {
         if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
@@ -324,9 +431,49 @@ bool TCPControlBus::receive_from_all_fds() {
   return new_recv_data;
 }
 
-MessageBuffer *TCPControlBus::receive(const WorkerAddress &me) {
-  static int rfd_remain = 0;
+/*
+ * Makes room for the frame being received: the slab must hold the whole frame
+ * and have MIN_RECV_ROOM free bytes. The received part of the frame is moved
+ * to the slab head if no message of the slab is alive, otherwise copied to a
+ * new slab (the old one is freed with its last message).
+ */
+bool TCPControlBus::prepare_recv_slab(struct fd_info *fi) {
+  struct recv_slab *b = fi->rslab;
+
+  if (!b) {
+    fi->rslab = alloc_slab(MAX_BUFF_SIZE);
+    return fi->rslab != nullptr;
+  }
+
+  int need = b->size + MIN_RECV_ROOM;
+  if (b->size >= (int)FRAME_HEAD_SIZE) {
+    MessageBuffer *msg = reinterpret_cast<MessageBuffer *>(b->buf + b->offset);
+    VirtualHeader *header = reinterpret_cast<VirtualHeader *>(msg->buf);
+    need = std::max(need, frame_size(header->total_size));
+  }
+
+  if (b->cap - b->offset >= need)
+    return true;
+
+  if (b->refcnt == 1 && b->cap >= need) {
+    memmove(b->buf, b->buf + b->offset, b->size);
+    b->offset = 0;
+    return true;
+  }
+
+  struct recv_slab *n = alloc_slab(std::max(need, MAX_BUFF_SIZE));
+  if (!n)
+    return false;
+
+  memcpy(n->buf, b->buf + b->offset, b->size);
+  n->size = b->size;
+  fi->rslab = n;
+  release_slab(b);
+
+  return true;
+}
 
+MessageBuffer *TCPControlBus::receive(const WorkerAddress &me) {
   if (rfd_remain <= 0) {
     // no more bytes to process, then accepts, and receives new bytes
     rfd_idx = 0;
@@ -343,19 +490,23 @@ MessageBuffer *TCPControlBus::receive(const WorkerAddress &me) {
   for (int i = rfd_idx; i < rfd_count; i = (i + 1) % rfd_count) {
     if (g_recv_fd[i] > 0) {
       int cur_fd = g_recv_fd[i];
-      struct binary_buff *recv_buff = &fd_to_fdinfo[cur_fd]->recv_buff;
+      struct recv_slab *recv_buff = fd_to_fdinfo[cur_fd]->rslab;
+
+      MessageBuffer *msg =
+          reinterpret_cast<MessageBuffer *>(recv_buff->buf + recv_buff->offset);
+      VirtualHeader *header = reinterpret_cast<VirtualHeader *>(msg->buf);
 
-      int size = *(int *)(recv_buff->buf + recv_buff->offset);
-      // DEBUG_ERR("index " << i << " has " << recv_buff->size
-      //		<< " bytes and will read " << size << " bytes" );
+      int size = recv_buff->size >= (int)FRAME_HEAD_SIZE
+                     ? frame_size(header->total_size)
+                     : INT_MAX;
       if (recv_buff->size >= size) {
-        MessageBuffer *msg = allocate_message(size - sizeof(VirtualHeader));
-        memcpy(msg->buf, recv_buff->buf + recv_buff->offset, size);
+        // hands out the message in place; the slab lives until it is freed
+        header->slab = recv_buff;
+        recv_buff->refcnt++;
         recv_buff->offset += size;
         recv_buff->size -= size;
 
         if (recv_buff->size == 0) {
-          recv_buff->offset = 0;
           g_recv_fd[i] = 0;
           rfd_remain--;
         }
@@ -363,19 +514,8 @@ MessageBuffer *TCPControlBus::receive(const WorkerAddress &me) {
         rfd_idx = (i + 1) % rfd_count;
         return msg;
       } else {
-        // DEBUG_ERR("msg size is " << size << " but in buffer, offset is "
-        //		<< recv_buff->offset << " to read is " << recv_buff->size
-        //		<< " buff_size is " << MAX_BUFF_SIZE);
-        // wait more message body and go to next fd to read
-        if (size >= MAX_BUFF_SIZE - 2)
-          perror("Error message is bigger than maximum buffer size");
-        // else if (size >= MAX_BUFF_SIZE - 2 - recv_buff->offset) {
-        // DEBUG_ERR("Move buffer offset into zero");
-        memmove(recv_buff->buf, recv_buff->buf + recv_buff->offset,
-                recv_buff->size);
-        recv_buff->offset = 0;
-        //}
-
+        // wait more message body (prepare_recv_slab() makes room for it)
+        // and go to next fd to read
         g_recv_fd[i] = 0;
         rfd_remain--;
         continue;
@@ -400,6 +540,19 @@ void TCPControlBus::close_connection(const WorkerAddress &addr) {
 
   addr_to_fdinfo.erase(iter);
   fd_to_fdinfo.erase(fi->fd);
+  free_fd_info(fi);
+}
+
+// messages still queued are dropped; received ones keep the slab alive
+void TCPControlBus::free_fd_info(struct fd_info *fi) {
+  for (auto &info : fi->send_queue)
+    free_message(info.msgbuf);
+  fi->send_queue.clear();
+
+  if (fi->rslab)
+    release_slab(fi->rslab);
+  fi->rslab = nullptr;
+
   delete fi;
 }
 
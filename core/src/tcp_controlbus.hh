@@ -1,10 +1,11 @@
 #ifndef _DISTREF_TCP_CONTROL_BUS_HH_
 #define _DISTREF_TCP_CONTROL_BUS_HH_
 
+#include <deque>
 #include <map>
-#include <queue>
 #include <sys/epoll.h>
 #include <unordered_map>
+#include <vector>
 
 #include "controlbus.hh"
 #include "worker_address.hh"
@@ -20,32 +21,44 @@
  * - address <-> fd translation is not really necessary. To eliminate this,
  *		1. Connector needs to embed fd directly, and
  *		2. We should use epoll (which supports cookie), not poll.
+ * - The whole MessageBuffer goes on the wire, padded to 8 bytes, so that a
+ *   received message can be handed out in place of the receive slab. The
+ *   slab is freed when the connection and all its messages have released it.
+ * - Queued messages are sent in one sendmsg() and freed once fully sent.
  */
 
 #define MAX_EVENTS 20
-#define MAX_BUFF_SIZE (1024 * 1024)
+#define MAX_BUFF_SIZE (1024 * 1024)  // default receive slab size
 #define MAX_CONN MAX_WORKER_CNT
-
-struct binary_buff {
-  u_char buf[MAX_BUFF_SIZE];
-  int offset = 0;
-  int size = 0;
+#define MAX_SEND_IOV 64
+#define MAX_SEND_QUEUE 256
+#define MIN_RECV_ROOM (64 * 1024)  // less room than this, get a new slab
+#define MAX_FREE_SLABS 8
+
+struct recv_slab {
+  int refcnt;  // the connection and every message handed out from the slab
+  int cap;
+  int offset;  // the first byte not handed out yet
+  int size;    // bytes received after offset
+  u_char buf[0];
 };
 
 struct message_buffer_info {
   MessageBuffer* msgbuf;
   int offset;
-  int size;
+  int len;   // bytes of msgbuf
+  int size;  // len + padding
 
-  message_buffer_info(MessageBuffer* _msgbuf, int _offset, int _size)
-      : msgbuf(_msgbuf), offset(_offset), size(_size) {}
+  message_buffer_info(MessageBuffer* _msgbuf, int _offset, int _len,
+                      int _size)
+      : msgbuf(_msgbuf), offset(_offset), len(_len), size(_size) {}
 };
 
 struct fd_info {
   int fd = -1;
   WorkerAddress addr;
-  std::queue<message_buffer_info> send_queue;
-  struct binary_buff recv_buff;
+  std::deque<message_buffer_info> send_queue;
+  struct recv_slab* rslab = nullptr;
 
   fd_info(int new_fd, WorkerAddress new_addr) : fd(new_fd), addr(new_addr) {}
 };
@@ -61,6 +74,10 @@ class TCPControlBus : public ControlBus {
   int g_recv_fd[MAX_CONN];
   int rfd_count = 0;
   int rfd_idx = 0;
+  int rfd_remain = 0;
+
+  // recycled default-sized slabs (released from the const free_message())
+  mutable std::vector<struct recv_slab*> free_slabs;
 
  public:
   TCPControlBus();
@@ -70,6 +87,7 @@ class TCPControlBus : public ControlBus {
   virtual Connector* register_address(const WorkerAddress& addr);
   virtual MessageBuffer* allocate_message(const std::size_t messageSize) const;
   virtual MessageBuffer* init_message(uint8_t* buf, std::size_t buf_size) const;
+  virtual void free_message(MessageBuffer* message) const;
 
  private:
   virtual bool send(MessageBuffer* pkt, const WorkerAddress& from,
@@ -80,6 +98,10 @@ class TCPControlBus : public ControlBus {
 
   bool flush_send_queue(struct fd_info*);
   bool receive_from_all_fds();
+  bool prepare_recv_slab(struct fd_info*);
+  struct recv_slab* alloc_slab(int cap) const;
+  void release_slab(struct recv_slab*) const;
+  void free_fd_info(struct fd_info*);
   void close_connection(const WorkerAddress& worker);
   void close_connection(int fd);
 };
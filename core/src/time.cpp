@@ -38,8 +38,9 @@ uint64_t get_tsc_freq(void) {
   return freq;
 };
 
+// cached per thread, as each lcore worker refreshes its own clock
 uint64_t get_cur_rdtsc(bool _refresh) {
-  static uint64_t tsc = 0;
+  static thread_local uint64_t tsc = 0;
 
   if (_refresh) {
     tsc = rte_rdtsc();
@@ -50,7 +51,7 @@ uint64_t get_cur_rdtsc(bool _refresh) {
 }
 
 struct timeval s6_gettimeofday(bool _refresh) {
-  static timeval now = {0};
+  static thread_local timeval now = {0};
 
   if (_refresh || now.tv_sec == 0)
     gettimeofday(&now, NULL);
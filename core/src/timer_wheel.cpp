@@ -0,0 +1,169 @@
+#include "timer_wheel.hh"
+
+#include <cstring>
+
+#include "log.hh"
+#include "time.hh"
+
+#define TIMER_WHEEL_MASK (TimerWheel::SLOT_CNT - 1)
+#define TIMER_WHEEL_RANGE (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+thread_local TimerWheel *TimerWheel::pInstance = 0;
+
+TimerWheel::TimerWheel(uint64_t tick_us) {
+  memset(slots, 0, sizeof(slots));
+
+  tsc_hz = get_tsc_freq();
+  tick_tsc = us_to_tsc(tick_us);
+  if (tick_tsc == 0)
+    tick_tsc = 1;
+
+  base_tsc = get_cur_rdtsc(true);
+  next_tick_tsc = base_tsc + tick_tsc;
+}
+
+TimerWheel::~TimerWheel() {
+  for (Timer *chunk : chunks)
+    delete[] chunk;
+}
+
+Timer *TimerWheel::alloc() {
+  if (free_timers.empty()) {
+    Timer *chunk = new Timer[TIMER_CHUNK];
+    if (!chunk)
+      return nullptr;
+
+    chunks.push_back(chunk);
+    for (int i = TIMER_CHUNK - 1; i >= 0; i--)
+      free_timers.push_back(&chunk[i]);
+  }
+
+  Timer *t = free_timers.back();
+  free_timers.pop_back();
+  return t;
+}
+
+// t->expire >= cur_tick; a timer due now goes to the slot being run
+void TimerWheel::link(Timer *t) {
+  uint64_t expire = t->expire;
+  uint64_t delta = expire - cur_tick;
+
+  if (delta >= TIMER_WHEEL_RANGE)
+    expire = cur_tick + TIMER_WHEEL_RANGE - 1;
+
+  int level = 0;
+  while (level < TIMER_WHEEL_LEVELS - 1 &&
+         delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1))))
+    level++;
+
+  Timer **head =
+      &slots[level][(expire >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+
+  t->next = *head;
+  if (t->next)
+    t->next->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+}
+
+void TimerWheel::unlink(Timer *t) {
+  *t->pprev = t->next;
+  if (t->next)
+    t->next->pprev = t->pprev;
+  t->next = nullptr;
+  t->pprev = nullptr;
+}
+
+// moves the timers of the current slot of the level one level down
+void TimerWheel::cascade(int level) {
+  int idx = (cur_tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+  Timer *t = slots[level][idx];
+  slots[level][idx] = nullptr;
+
+  while (t) {
+    Timer *next = t->next;
+    link(t);
+    t = next;
+  }
+}
+
+Timer *TimerWheel::schedule_at(uint64_t tsc, timer_func cb, void *arg) {
+  Timer *t = alloc();
+  if (!t) {
+    DEBUG_ERR("Fail to allocate a timer");
+    return nullptr;
+  }
+
+  // rounds up, and at least to the next tick
+  uint64_t expire = 0;
+  if (tsc > base_tsc)
+    expire = (tsc - base_tsc + tick_tsc - 1) / tick_tsc;
+  if (expire <= cur_tick)
+    expire = cur_tick + 1;
+
+  t->expire = expire;
+  t->cb = cb;
+  t->arg = arg;
+  link(t);
+  cnt++;
+
+  return t;
+}
+
+Timer *TimerWheel::schedule_after_us(uint64_t us, timer_func cb, void *arg) {
+  return schedule_at(get_cur_rdtsc() + us_to_tsc(us), cb, arg);
+}
+
+void TimerWheel::cancel(Timer *t) {
+  if (!t || !t->pprev)
+    return;
+
+  unlink(t);
+  free_timers.push_back(t);
+  cnt--;
+}
+
+int TimerWheel::advance(uint64_t now_tsc) {
+  if (now_tsc < next_tick_tsc)
+    return 0;
+
+  uint64_t target = (now_tsc - base_tsc) / tick_tsc;
+  next_tick_tsc = base_tsc + (target + 1) * tick_tsc;
+
+  int fired = 0;
+  while (cur_tick < target) {
+    // nothing to cascade or run
+    if (cnt == 0) {
+      cur_tick = target;
+      break;
+    }
+
+    cur_tick++;
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+      if ((cur_tick >> (TIMER_WHEEL_BITS * (level - 1))) & TIMER_WHEEL_MASK)
+        break;
+      cascade(level);
+    }
+
+    // callbacks may cancel the other timers of the slot, so pops one by one
+    Timer *pending = slots[0][cur_tick & TIMER_WHEEL_MASK];
+    slots[0][cur_tick & TIMER_WHEEL_MASK] = nullptr;
+    if (pending)
+      pending->pprev = &pending;
+
+    while (pending) {
+      Timer *t = pending;
+      timer_func cb = t->cb;
+      void *arg = t->arg;
+
+      unlink(t);
+      free_timers.push_back(t);
+      cnt--;
+
+      cb(arg);
+      fired++;
+    }
+  }
+
+  return fired;
+}
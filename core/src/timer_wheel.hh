@@ -0,0 +1,98 @@
+#ifndef _DISTREF_TIMER_WHEEL_HH_
+#define _DISTREF_TIMER_WHEEL_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define TIMER_WHEEL_TICK_US 100  // resolution
+#define TIMER_WHEEL_BITS 6       // 64 slots per level
+#define TIMER_WHEEL_LEVELS 4     // 2^24 ticks (~28 min) before re-cascading
+#define TIMER_CHUNK 256          // timers allocated at once
+
+typedef void (*timer_func)(void *arg);
+
+struct Timer {
+  Timer *next;
+  Timer **pprev;    // nullptr while not scheduled
+  uint64_t expire;  // in ticks
+  timer_func cb;
+  void *arg;
+};
+
+/*
+ * Hierarchical timing wheel
+ *
+ * Level i has 2^TIMER_WHEEL_BITS slots of 2^(i * TIMER_WHEEL_BITS) ticks
+ * each. A timer goes to the lowest level its deadline fits in, and moves a
+ * level down (cascades) when the lower level wraps around, so scheduling and
+ * cancelling are O(1) and advancing costs O(1) per elapsed tick. Deadlines
+ * beyond the top level wait in its last slot and are re-cascaded.
+ *
+ * Driven by the caller with advance(now), e.g., with get_cur_rdtsc() from the
+ * worker loop; callbacks run from advance() and may schedule or cancel
+ * timers.
+ *
+ * NOTE:
+ * - Not thread-safe; one wheel per worker (lcore), see GetTimerWheel().
+ * - A Timer handle is valid until its callback is called or it is cancelled.
+ */
+class TimerWheel {
+ public:
+  static const int SLOT_CNT = 1 << TIMER_WHEEL_BITS;
+
+ private:
+  thread_local static TimerWheel *pInstance;
+
+  Timer *slots[TIMER_WHEEL_LEVELS][SLOT_CNT];
+  std::size_t cnt = 0;
+
+  uint64_t tsc_hz;
+  uint64_t tick_tsc;
+  uint64_t base_tsc;
+  uint64_t cur_tick = 0;       // every tick up to this one has been run
+  uint64_t next_tick_tsc = 0;  // advance() does nothing before
+
+  std::vector<Timer *> free_timers;
+  std::vector<Timer *> chunks;
+
+  Timer *alloc();
+  void link(Timer *t);
+  void unlink(Timer *t);
+  void cascade(int level);
+
+ public:
+  explicit TimerWheel(uint64_t tick_us = TIMER_WHEEL_TICK_US);
+  ~TimerWheel();
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  // wheel of the calling thread (worker)
+  static TimerWheel *GetTimerWheel() {
+    if (pInstance == nullptr)
+      pInstance = new TimerWheel();
+    return pInstance;
+  }
+
+  uint64_t us_to_tsc(uint64_t us) const { return tsc_hz * (us / 1.0E+6); }
+  std::size_t size() const { return cnt; }
+
+  // returns nullptr on failure; runs at the first advance() past the deadline
+  Timer *schedule_at(uint64_t tsc, timer_func cb, void *arg);
+  Timer *schedule_after_us(uint64_t us, timer_func cb, void *arg);
+  void cancel(Timer *t);
+
+  // runs the expired timers, returns how many
+  int advance(uint64_t now_tsc);
+};
+
+// for applications: runs fn(arg) on the calling worker after us
+inline Timer *schedule_after_us(timer_func fn, void *arg, uint64_t us) {
+  return TimerWheel::GetTimerWheel()->schedule_after_us(us, fn, arg);
+}
+
+inline void cancel_timer(Timer *t) {
+  TimerWheel::GetTimerWheel()->cancel(t);
+}
+
+#endif /* _DISTREF_TIMER_WHEEL_HH_ */
@@ -25,5 +25,7 @@ struct _DR_ADTInfo {
 typedef int (*init_func)(int param);
 typedef int (*packet_func)(struct rte_mbuf *);
 typedef void (*background_func)(void);
+// at rx time, calls prefetch() of the maps the packet will access
+typedef void (*key_extract_func)(struct rte_mbuf *);
 
 #endif /* _DISTREF_TYPE_HH_ */
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cstring>
 #include <fcntl.h>
@@ -5,25 +6,75 @@
 #include <queue>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <vector>
 
 #include <rte_cycles.h>
+#include <rte_lcore.h>
 
+#include "access_tracker.hh"
 #include "controlbus.hh"
 #include "d_routine.hh"
 #include "key_space.hh"
 #include "mw_skeleton.hh"
 #include "rapidjson/document.h"
 #include "reference_interceptor.hh"
+#include "stub_factory.hh"
 #include "swobj_manager.hh"
 #include "time.hh"
 #include "worker.hh"
 #include "worker_address.hh"
 
 #define UNIX_PATH_MAX 108
-#define BUFFSIZE 1024
+#define BUFFSIZE 8192  // < 10000, as the length prefix has 4 digits
+#define MNG_MSG_MAX 9999  // the longest message the length prefix can tell
+#define LOAD_REPORT_KEYS 16
+#define AGGR_CHECK_INTERVAL_US 1000
+#define MEM_CHECK_INTERVAL_US 10000
 
 using namespace rapidjson;
 
+/*
+ * Reads one message of the controller: a 4-digit length of the whole message,
+ * the JSON and a NUL (see CommThread.send() of s6ctl). A message may come in
+ * several segments, and the next one is left in the socket. Returns the
+ * length, 0 if no message has started yet (unless wait), or -1.
+ */
+static int recv_mng_message(int sock, char *buffer, int size, bool wait) {
+  int len = 4;
+  int got = 0;
+
+  while (got < len) {
+    int ret = recv(sock, buffer + got, len - got, MSG_NOSIGNAL);
+    if (ret == 0) {
+      DEBUG_ERR("Mng connection closed");
+      return -1;
+    }
+
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return -1;
+      if (got == 0 && !wait)
+        return 0;
+      continue;  // the rest of the message is on the way
+    }
+
+    got += ret;
+    if (len == 4 && got == 4) {
+      char len_str[5] = {buffer[0], buffer[1], buffer[2], buffer[3], '\0'};
+      len = atoi(len_str);
+      if (len <= 5 || len > size) {
+        DEBUG_ERR("Invalid mng message length " << len_str);
+        return -1;
+      }
+    }
+  }
+
+  buffer[len - 1] = '\0';
+  return len;
+}
+
 static LBPolicy *get_policy(rapidjson::Document &d) {
   // XXX Need to add src/dst ip/port semantic
   int offset = d["rules"]["offset"].GetInt();
@@ -104,6 +155,14 @@ static int update_keyspace(rapidjson::Document &d, KeySpace *key_space,
     key_space->set_rule(version, map_id, loc_type, param);
   }
 
+  // [[placement hash, worker id], ...] for _LC_LOADAWARE
+  if (d["keyspace"].HasMember("overrides")) {
+    const Value &overrides = d["keyspace"]["overrides"];
+    for (SizeType i = 0; i < overrides.Size(); i++)
+      key_space->set_override(version, overrides[i][0].GetUint64(),
+                              overrides[i][1].GetInt());
+  }
+
   DEBUG_DEV("Update KeySpace: " << version);
 
   return 0;
@@ -124,20 +183,47 @@ Worker::Worker(WorkerConfig *wconf, bool is_dpdk, ControlBus *cbus) {
   this->cbus = cbus;
   this->wconf = wconf;
   this->ref_interceptor = ReferenceInterceptor::GetReferenceInterceptor();
-  this->scheduler = new DroutineScheduler(wconf->id, is_dpdk, wconf->log_fld);
+  this->timers = TimerWheel::GetTimerWheel();
+  this->scheduler = new DroutineScheduler(wconf->id, is_dpdk, wconf->log_fld,
+                                          wconf->queue_id);
+  if (wconf->sched_policy) {
+    SchedPolicy policy;
+    if (parse_sched_policy(wconf->sched_policy, &policy) == 0)
+      scheduler->set_policy(policy);
+  }
 
   this->key_space = new KeySpace();
 
-  if (wconf->max_swobj_size <= 0)
-    this->mp_sw = new MemPool();
-  else
-    this->mp_sw = new MemPool(wconf->max_swobj_size, wconf->max_expected_flows);
-
-  if (wconf->max_mwobj_size <= 0)
-    this->mp_mw = new MemPool();
-  else
-    this->mp_mw =
-        new MemPool(wconf->max_mwobj_size, wconf->max_expected_shared_objs);
+  // packet workers take the dpdk hugepages of their socket
+  int socket_id = -1;
+  if (wconf->hugepage_objs && is_dpdk && wconf->type == PACKET_WORKER)
+    socket_id = rte_socket_id();
+
+  // the expected counts bound the reserved memory, if given; otherwise the
+  // two pools of each worker of the process split the memory, so that the
+  // watermarks are reached before it runs out (other processes not counted)
+  size_t mem_share =
+      MemPool::get_memory_size(socket_id) / (2 * wconf->queue_cnt);
+
+  size_t sw_capacity = mem_share;
+  if (wconf->max_swobj_size > 0 && wconf->max_expected_flows > 0)
+    sw_capacity = (size_t)wconf->max_swobj_size * wconf->max_expected_flows;
+
+  size_t mw_capacity = mem_share;
+  if (wconf->max_mwobj_size > 0 && wconf->max_expected_shared_objs > 0)
+    mw_capacity =
+        (size_t)wconf->max_mwobj_size * wconf->max_expected_shared_objs;
+
+  this->mp_sw = new MemPool(sw_capacity, wconf->hugepage_objs, socket_id);
+  this->mp_mw = new MemPool(mw_capacity, wconf->hugepage_objs, socket_id);
+
+  // an exact size class per map
+  for (int map_id = 0; map_id < num_dmap; map_id++) {
+    if (__global_dobj_type[map_id] == DOBJECT_SW)
+      mp_sw->add_size_class(__global_dobj_size[map_id]);
+    else
+      mp_mw->add_size_class(__global_dobj_size[map_id]);
+  }
 
   this->swobj_manager = new SWObjectManager(wconf->node_id, this, scheduler,
                                             cbus, key_space, this->mp_sw);
@@ -147,12 +233,15 @@ Worker::Worker(WorkerConfig *wconf, bool is_dpdk, ControlBus *cbus) {
                                            cbus, key_space, this->mp_mw);
 
   this->swstub_manager->set_swobj_manager(swobj_manager);
+  this->swstub_manager->set_timer_wheel(timers);
   this->swobj_manager->set_swstub_manager(swstub_manager);
 
   this->ref_interceptor->set_managers(swstub_manager, mwstub_manager);
 
   this->status = {false, false};
-  this->bgf = {0, 0};
+  for (int fid = 0; fid < MAX_BGFUNC_CNT; fid++)
+    this->bgf_timers[fid] = {this, fid, nullptr};
+  this->bgf_timer_cnt = 0;
 }
 
 Worker::~Worker() {
@@ -199,33 +288,96 @@ void Worker::set_keyspace(KeySpace *key_space) {
 
 void Worker::set_application(Application *app, WorkerType w_type) {
   this->app = app;
-  if (w_type == PACKET_WORKER)
-    scheduler->set_packet_routine(app->get_packet_func(), NUM_CO_ROUTINES);
+  if (w_type == PACKET_WORKER) {
+    scheduler->set_packet_routine(app->get_packet_func(), get_max_coroutines());
+    scheduler->set_key_extractor(app->get_key_extract_func());
+  }
 
-  // FIXME: multiple get background function
-  scheduler->set_background_routine(app->get_background_func(0));
+  // fid of each is its index in the application
+  for (int i = 0; i < MAX_BGFUNC_CNT && app->get_background_func(i); i++)
+    scheduler->set_background_routine(app->get_background_func(i));
   return;
 }
 
 int Worker::set_routine_function(packet_func packet_processing) {
-  scheduler->set_packet_routine(packet_processing, NUM_CO_ROUTINES);
+  scheduler->set_packet_routine(packet_processing, get_max_coroutines());
   return 0;
 }
 
 int Worker::set_single_function(background_func single_function) {
-  scheduler->set_background_routine(single_function);
-  return 0;
+  return scheduler->set_background_routine(single_function);
 }
 
-// XXX fid is ignored
+// runs along with packets and the other background functions
 void Worker::run_single_function(int fid) {
-  scheduler->run_background_routine();
+  if (scheduler->run_background_routine(fid) < 0)
+    DEBUG_WRK("Background function " << fid << " is running or not set");
   status.run_scheduler = true;
 }
 
+void Worker::on_bgf_timer(void *arg) {
+  BgfTimer *bt = static_cast<BgfTimer *>(arg);
+
+  bt->timer = nullptr;
+  bt->worker->bgf_timer_cnt--;
+  bt->worker->run_single_function(bt->fid);
+}
+
+void Worker::on_aggregation_timer(void *arg) {
+  Worker *w = static_cast<Worker *>(arg);
+
+  w->mwstub_manager->check_to_push_aggregation();
+  w->timers->schedule_after_us(AGGR_CHECK_INTERVAL_US, on_aggregation_timer, w);
+}
+
+void Worker::on_mem_check_timer(void *arg) {
+  Worker *w = static_cast<Worker *>(arg);
+
+  w->check_mem_pressure();
+  w->timers->schedule_after_us(MEM_CHECK_INTERVAL_US, on_mem_check_timer, w);
+}
+
+/*
+ * Past the high watermark of a pool, evicts its cache-only objects down to
+ * the low watermark. If that is not enough, new flows are not admitted until
+ * the pools are below the low watermark again (e.g., flows expire), and the
+ * controller is told so, as a reason to scale out.
+ */
+void Worker::check_mem_pressure() {
+  struct {
+    const char *name;
+    MemPool *mp;
+  } pools[] = {{"sw", mp_sw}, {"mw", mp_mw}};
+
+  bool pressure = false;
+  for (auto &p : pools) {
+    if (p.mp->get_occupancy() >= MEM_HIGH_WATERMARK)
+      p.mp->evict_to(MEM_LOW_WATERMARK);
+    if (p.mp->update_pressure())
+      report_mem_pressure(p.name, p.mp);
+    pressure |= p.mp->is_under_pressure();
+  }
+
+  scheduler->set_admission(!pressure);
+}
+
+// a later call for the same fid replaces the deadline
 void Worker::run_single_function_after_us(int fid, useconds_t us) {
-  bgf.time = get_cur_rdtsc(true) + get_tsc_freq() * (us / 1.0E+6);
-  bgf.id = fid;
+  if (fid < 0 || fid >= MAX_BGFUNC_CNT) {
+    DEBUG_ERR("Invalid background function " << fid);
+    return;
+  }
+
+  BgfTimer *bt = &bgf_timers[fid];
+  if (bt->timer)
+    timers->cancel(bt->timer);
+  else
+    bgf_timer_cnt++;
+
+  uint64_t deadline = get_cur_rdtsc(true) + timers->us_to_tsc(us);
+  bt->timer = timers->schedule_at(deadline, on_bgf_timer, bt);
+  if (!bt->timer)
+    bgf_timer_cnt--;
 }
 
 void Worker::set_num_packets_to_proc(int cnt) {
@@ -246,7 +398,7 @@ void Worker::send_message(WorkerID to, MessageBuffer *mb) {
 #endif
 
   static const uint64_t hz = get_tsc_freq();
-  static uint64_t max_diff_tsc = 0;
+  static thread_local uint64_t max_diff_tsc = 0;
 
   uint64_t cur_tsc = get_cur_rdtsc(true);
 
@@ -342,6 +494,18 @@ void Worker::transfer_objects(int map_id, WorkerID to, uint32_t pair_count,
   return;
 }
 
+// buffer: 4 bytes for the length, then nbytes of json and the null character
+void Worker::write_to_controller(char *buffer, int nbytes) {
+  char len_str[5];
+  snprintf(len_str, 5, "%04u", nbytes + 5);
+  memcpy(buffer, len_str, 4);
+  int ret = write(mng_sock, buffer, nbytes + 5);
+  if (ret != nbytes + 5) {
+    DEBUG_ERR("Fail to sent " << nbytes + 5 << " actual sent " << ret);
+    return;
+  }
+}
+
 void Worker::send_msg_to_controller(const char *msg_type) {
   int nbytes;
   char buffer[BUFFSIZE];
@@ -351,14 +515,111 @@ void Worker::send_msg_to_controller(const char *msg_type) {
       snprintf(buffer + 4, BUFFSIZE - 4,
                "{\"msg_type\":\"%s\", \"worker_id\": %d}", msg_type, wconf->id);
 
-  char len_str[5];
-  snprintf(len_str, 5, "%04u", nbytes + 5);
-  memcpy(buffer, len_str, 4);
-  int ret = write(mng_sock, buffer, nbytes + 5);
-  if (ret != nbytes + 5) {
-    DEBUG_ERR("Fail to sent " << nbytes + 5 << " actual sent " << ret);
-    return;
+  write_to_controller(buffer, nbytes);
+}
+
+/*
+ * Reports the accesses to the objects this worker manages since the last
+ * report, with the heaviest keys (by placement hash), so that the controller
+ * can override their placement. Starts a new interval.
+ */
+void Worker::report_load() {
+  std::vector<HotKey> hot_keys;
+  uint64_t accesses = 0;
+
+  for (AccessTracker *t : {swobj_manager->get_access_tracker(),
+                           mwstub_manager->get_access_tracker()}) {
+    accesses += t->get_accesses();
+    t->get_hot_keys(LOAD_REPORT_KEYS, hot_keys);
+    t->reset();
   }
+
+  // the same key may be hot in both managers
+  std::sort(hot_keys.begin(), hot_keys.end());
+  std::vector<HotKey> merged;
+  for (auto &hk : hot_keys) {
+    if (!merged.empty() && merged.back().first == hk.first)
+      merged.back().second += hk.second;
+    else
+      merged.push_back(hk);
+  }
+
+  std::size_t k = std::min((std::size_t)LOAD_REPORT_KEYS, merged.size());
+  std::partial_sort(merged.begin(), merged.begin() + k, merged.end(),
+                    [](const HotKey &a, const HotKey &b) {
+                      return a.second > b.second;
+                    });
+
+  char buffer[BUFFSIZE];
+  int nbytes = snprintf(buffer + 4, BUFFSIZE - 4,
+                        "{\"msg_type\":\"load_report\", \"worker_id\": %d, "
+                        "\"accesses\": %lu, \"hot_keys\": [",
+                        wconf->id, accesses);
+  for (std::size_t i = 0; i < k; i++)
+    nbytes += snprintf(buffer + 4 + nbytes, BUFFSIZE - 4 - nbytes,
+                       "%s[%lu, %lu]", i ? ", " : "", merged[i].first,
+                       merged[i].second);
+  nbytes += snprintf(buffer + 4 + nbytes, BUFFSIZE - 4 - nbytes, "]}");
+
+  write_to_controller(buffer, nbytes);
+  DEBUG_WRK("Worker " << wconf->id << " reported load: " << accesses
+                      << " accesses, " << k << " hot keys");
+}
+
+// per-class packet latency (us) since the last report
+void Worker::report_latency() {
+  double us_per_tsc = 1.0E+6 / get_tsc_freq();
+  LatencyHist all;
+
+  char buffer[BUFFSIZE];
+  int nbytes = snprintf(buffer + 4, BUFFSIZE - 4,
+                        "{\"msg_type\":\"latency_report\", \"worker_id\": %d, "
+                        "\"classes\": {",
+                        wconf->id);
+  for (int pl = 0; pl < PL_MAX; pl++) {
+    const LatencyHist &h = scheduler->get_pkt_latency(pl);
+    all.merge(h);
+
+    nbytes += snprintf(
+        buffer + 4 + nbytes, BUFFSIZE - 4 - nbytes,
+        "%s\"%s\": {\"pkts\": %lu, \"p50\": %.1f, \"p99\": %.1f, "
+        "\"p999\": %.1f, \"max\": %.1f}",
+        pl ? ", " : "", DroutineScheduler::pkt_latency_name(pl), h.count(),
+        h.percentile(50) * us_per_tsc, h.percentile(99) * us_per_tsc,
+        h.percentile(99.9) * us_per_tsc, h.max() * us_per_tsc);
+  }
+  nbytes += snprintf(buffer + 4 + nbytes, BUFFSIZE - 4 - nbytes,
+                     "}, \"pkts\": %lu, \"p99\": %.1f}", all.count(),
+                     all.percentile(99) * us_per_tsc);
+
+  scheduler->reset_pkt_latency();
+
+  write_to_controller(buffer, nbytes);
+  DEBUG_WRK("Worker " << wconf->id << " reported latency: " << all.count()
+                      << " packets, p99 " << all.percentile(99) * us_per_tsc
+                      << " us");
+}
+
+void Worker::report_mem_pressure(const char *pool, MemPool *mp) {
+  bool pressure = mp->is_under_pressure();
+  DEBUG_WRK("Worker " << wconf->id << " " << pool << " objects "
+                      << (pressure ? "under" : "out of") << " pressure: "
+                      << mp->get_occupancy() << "% occupied");
+
+  if (!with_controller)
+    return;
+
+  char buffer[BUFFSIZE];
+  int nbytes = snprintf(
+      buffer + 4, BUFFSIZE - 4,
+      "{\"msg_type\":\"mem_report\", \"worker_id\": %d, \"pool\": \"%s\", "
+      "\"pressure\": %s, \"occupancy\": %d, \"used_mb\": %lu, "
+      "\"capacity_mb\": %lu, \"overflows\": %lu}",
+      wconf->id, pool, pressure ? "true" : "false", mp->get_occupancy(),
+      mp->get_used_bytes() >> 20, mp->get_capacity() >> 20,
+      mp->get_overflow_cnt());
+
+  write_to_controller(buffer, nbytes);
 }
 
 void Worker::notify_ready() {
@@ -421,7 +682,7 @@ bool Worker::check_state_channel_connectivity() {
 
 int Worker::connect_controller() {
   int nbytes;
-  char buffer[BUFFSIZE];
+  char buffer[MNG_MSG_MAX];
   rapidjson::Document d;
 
   // create socket and connect
@@ -456,10 +717,9 @@ int Worker::connect_controller() {
   }
 
   // get policy and config from controller
-  nbytes = recv(mng_sock, buffer, sizeof(buffer), 0);
-  if (nbytes != atoi(buffer)) {
-    DEBUG_ERR("received " << nbytes << " msg_size is " << atoi(buffer) << " ["
-                          << buffer + 4 << "] ");
+  nbytes = recv_mng_message(mng_sock, buffer, sizeof(buffer), true);
+  if (nbytes < 0) {
+    DEBUG_ERR("Fail to receive the rules from the controller");
     return -1;
   }
 
@@ -507,19 +767,12 @@ int Worker::connect_controller() {
 
 int Worker::wait_to_be_all_ready() {
   int nbytes;
-  char buffer[BUFFSIZE];
+  char buffer[MNG_MSG_MAX];
   rapidjson::Document d;
 
-  nbytes = recv(mng_sock, buffer, sizeof(buffer), 0);
-  if (nbytes <= 0)
-    return -1;
-
-  if (nbytes != atoi(buffer)) {
-    DEBUG_ERR("fail to receive msg bytes in buffer: " << nbytes << " received "
-                                                      << atoi(buffer) << " [ "
-                                                      << buffer << " ] ");
+  nbytes = recv_mng_message(mng_sock, buffer, sizeof(buffer), true);
+  if (nbytes < 0)
     return -1;
-  }
 
   d.ParseInsitu<0>(buffer + 4);
   if (!d.HasMember("msg_type"))
@@ -537,57 +790,38 @@ int Worker::wait_to_be_all_ready() {
 }
 
 void Worker::wait_to_finish() {
-  int nbytes = 0;
-  char buffer[BUFFSIZE];
+  int nbytes;
+  char buffer[MNG_MSG_MAX];
   rapidjson::Document d;
 
-  while (nbytes <= 0) {
-    // it is set to non-blocking
-    nbytes = recv(mng_sock, buffer, sizeof(buffer), MSG_NOSIGNAL | MSG_WAITALL);
-    if (nbytes <= 0) {
-      if (errno != EINTR && errno != EAGAIN) {
-        DEBUG_ERR("Mng connection failed");
-        return;
-      }
-    } else {
-      if (nbytes != atoi(buffer)) {
-        DEBUG_ERR("fail to receive msg bytes in buffer: "
-                  << nbytes << " received " << atoi(buffer) << " [ " << buffer
-                  << " ] ");
-        return;
-      }
+  // it is set to non-blocking
+  nbytes = recv_mng_message(mng_sock, buffer, sizeof(buffer), true);
+  if (nbytes < 0) {
+    DEBUG_ERR("Mng connection failed");
+    return;
+  }
 
-      d.ParseInsitu<0>(buffer + 4);
-      int fid = d["bg_fid"].GetInt();
-      if (fid >= 0) {
-        DEBUG_WRK("Worker start background function " << fid);
-        run_single_function(fid);
-        scheduler->call_scheduler();
-      }
-    }
+  d.ParseInsitu<0>(buffer + 4);
+  int fid = d["bg_fid"].GetInt();
+  if (fid >= 0) {
+    DEBUG_WRK("Worker start background function " << fid);
+    run_single_function(fid);
+    scheduler->call_scheduler();
   }
   close(mng_sock);
 }
 
 void Worker::process_command_from_controller() {
   int nbytes;
-  char buffer[BUFFSIZE];
+  char buffer[MNG_MSG_MAX];
   rapidjson::Document d;
 
-  nbytes = recv(mng_sock, buffer, sizeof(buffer), MSG_NOSIGNAL | MSG_DONTWAIT);
-  if (nbytes <= 0) {
-    if (errno != EINTR && errno != EAGAIN) {
-      DEBUG_ERR("Mng connection failed\n");
-      exit(EXIT_FAILURE);
-    }
-    return;
-  }
-
-  if (nbytes != atoi(buffer)) {
-    DEBUG_ERR("fail to receive msg bytes in buffer: " << nbytes << " received "
-                                                      << atoi(buffer) << " [ "
-                                                      << buffer << " ] ");
+  nbytes = recv_mng_message(mng_sock, buffer, sizeof(buffer), false);
+  if (nbytes == 0)
     return;
+  if (nbytes < 0) {
+    DEBUG_ERR("Mng connection failed\n");
+    exit(EXIT_FAILURE);
   }
 
   d.ParseInsitu<0>(buffer + 4);
@@ -729,6 +963,10 @@ void Worker::process_command_from_controller() {
       } else {
         DEBUG_ERR("[mng_channel] no 'bg_fid' is specified. " << buffer + 4);
       }
+    } else if (strncmp(msg_type, "report_load", strlen(msg_type)) == 0) {
+      report_load();
+    } else if (strncmp(msg_type, "report_latency", strlen(msg_type)) == 0) {
+      report_latency();
     } else if (strncmp(msg_type, "tear_down", strlen(msg_type)) == 0) {
       reserve_quit();
     } else {
@@ -744,6 +982,7 @@ void Worker::run(bool work_with_controller) {
   int ret;
 
   status.run_scheduler = false;
+  with_controller = work_with_controller;
 
   // set-up communication channel with controller
   if (work_with_controller) {
@@ -823,6 +1062,9 @@ void Worker::run(bool work_with_controller) {
 
   int count = 0;
 
+  timers->schedule_after_us(AGGR_CHECK_INTERVAL_US, on_aggregation_timer, this);
+  timers->schedule_after_us(MEM_CHECK_INTERVAL_US, on_mem_check_timer, this);
+
   // when quit is set?
   // 1. when processor is ordered quit with SIG_TERM
   // 2. when processor is finish their job (status.run_scheduler == false) AND
@@ -834,15 +1076,12 @@ void Worker::run(bool work_with_controller) {
 
 #ifdef D_TIME
     static const uint64_t hz = get_tsc_freq();
-    static uint64_t last_tsc = get_cur_rdtsc();
-    static CbusStats last_stats = state_sock->get_stats();
+    static thread_local uint64_t last_tsc = get_cur_rdtsc();
+    static thread_local CbusStats last_stats = state_sock->get_stats();
 #endif
 
     process_state_plane(1);
 
-    if (count % 10 == 0)
-      mwstub_manager->check_to_push_aggregation();
-
     if (work_with_controller && count % 1000 == 0)
       process_command_from_controller();
 
@@ -862,15 +1101,15 @@ void Worker::run(bool work_with_controller) {
       status.run_scheduler = scheduler->call_scheduler();
     }
 
+    // blocked routines would wait for the batch age with nothing else to do
+    swobj_manager->flush_lease_batches(scheduler->is_idle());
+
     // no more task to be scheduled and no remote_service
-    if (!status.run_scheduler && bgf.time == 0 && !status.remote_serving)
+    if (!status.run_scheduler && bgf_timer_cnt == 0 && !status.remote_serving)
       status.reserve_quit = true;
 
-    if (bgf.time > 0 && bgf.time < get_cur_rdtsc()) {
-      bgf.time = 0;
-      status.run_scheduler = true;
-      run_single_function(bgf.id);
-    }
+    // the clock is not refreshed by the state plane without a control bus
+    timers->advance(get_cur_rdtsc(cbus == nullptr));
 
     if (working_state == WORKER_ST_DOING_SCALING &&
         stats.tobe_export_flow_cnt <= 0 && stats.tobe_import_flow_cnt <= 0 &&
@@ -924,12 +1163,14 @@ void Worker::run(bool work_with_controller) {
 
   scheduler->print_micro_threads_stat();
   scheduler->print_stat(wconf->id);
+  mp_sw->print_stats("sw");
+  mp_mw->print_stats("mw");
   DEBUG_WRK("Worker " << wconf->id << " stop. ");
 }
 
 int Worker::process_state_plane(uint32_t max_msg) {
-  static uint64_t hz = get_tsc_freq();
-  static uint64_t max_diff_tsc = 0;
+  static const uint64_t hz = get_tsc_freq();
+  static thread_local uint64_t max_diff_tsc = 0;
 
   if (!cbus)
     return 0;
@@ -941,7 +1182,7 @@ int Worker::process_state_plane(uint32_t max_msg) {
 
   while (m) {
     process_state_packet(m);
-    free(m);
+    cbus->free_message(m);
 
     // breaks the loop after processing max_msg messages
     // if max_msg equals zero, process all available control messages
@@ -999,6 +1240,14 @@ void Worker::process_state_packet(MessageBuffer *mb) {
     case MSG_RWLEASE_RESPONSE:
       process_rwlease_response((RWLeaseResponse *)(void *)m->buf, m->from_id);
       break;
+    case MSG_RWLEASE_REQUEST_MULTI:
+      process_rwlease_request_multi((RWLeaseMulti *)(void *)m->buf,
+                                    m->from_id);
+      break;
+    case MSG_RWLEASE_RESPONSE_MULTI:
+      process_rwlease_response_multi((RWLeaseMulti *)(void *)m->buf,
+                                     m->from_id);
+      break;
     case MSG_RWLEASE_EXPIRE_REQUEST:
       process_rwlease_expire_request((RWLeaseExpireRequest *)(void *)m->buf,
                                      m->from_id);
@@ -1022,6 +1271,18 @@ void Worker::process_state_packet(MessageBuffer *mb) {
       process_rw_cleanup_meta_request((RWCleanupMetaRequest *)(void *)m->buf,
                                       m->from_id);
       break;
+    case MSG_RO_CACHE_REQUEST:
+      process_ro_cache_request((ROCacheRequest *)(void *)m->buf, m->from_id);
+      break;
+    case MSG_RO_CACHE_RESPONSE:
+      process_ro_cache_response((ROCacheResponse *)(void *)m->buf);
+      break;
+    case MSG_RO_CACHE_INVALIDATE:
+      process_ro_cache_invalidate((ROCacheInvalidate *)(void *)m->buf);
+      break;
+    case MSG_HOME_TRANSFER:
+      process_home_transfer((HomeTransfer *)(void *)m->buf, m->from_id);
+      break;
     case MSG_MW_SKELETON_STREAM:
       process_skeleton_stream((SkeletonStream *)(void *)m->buf, m->from_id);
       break;
@@ -1064,12 +1325,20 @@ void Worker::process_mw_rpc_request(RPCRequest *r, WorkerID from) {
   void *ret = malloc(sizeof(int));
   uint32_t ret_size;
 
-  mwstub_manager->execute_rpc(r->map_id, key, r->flag, r->method_id, args, &ret,
-                              &ret_size);
+  int err = mwstub_manager->execute_rpc(r->map_id, key, r->flag, r->method_id,
+                                        args, &ret, &ret_size);
 
   DEBUG_DEV("RPC_REQUEST from " << from << " " << r->r_idx << " method_id "
                                 << r->method_id);
 
+  // the caller may be blocked on a return; it zeroes it on an empty one
+  if (err < 0 && r->ret_size > 0) {
+    MessageBuffer *m = create_mw_rpc_response(
+        cbus, wconf->node_id, from, r->r_idx, r->map_id, key,
+        r->flag | _FLAG_RPC_ERROR, r->method_id, nullptr, 0);
+    send_message(from, m);
+  }
+
   if (ret_size <= 0) {
     free(ret);
     return;
@@ -1101,6 +1370,10 @@ void Worker::process_mw_rpc_request_multi_sym(RPCRequestMultiSym *r,
 void Worker::process_mw_rpc_response(RPCResponse *r) {
   DEBUG_DEV("RPC_RESPONSE to " << r->r_idx << " method_id " << r->method_id);
 
+  if (r->flag & _FLAG_RPC_ERROR)
+    DEBUG_ERR("RPC failed at the manager, map_id " << r->map_id << " method_id "
+                                                   << r->method_id);
+
   if (r->flag & _FLAG_STALE) {
     const Key *key = (const Key *)(void *)r->buf;
     void *args = r->buf + r->key_size;
@@ -1156,8 +1429,8 @@ void Worker::process_rwlease_response(RWLeaseResponse *r, WorkerID from) {
   DEBUG_DEV("RW_RESPONSE for " << *key << " with version " << r->version
                                << " with size " << r->obj_size);
 
-  swobj_manager->remote_set_object_ownership(r->map_id, key, r->version,
-                                             r->obj_size, data, from);
+  swobj_manager->remote_set_object_ownership(
+      r->map_id, key, r->version, r->obj_size, data, from, r->delta_size);
 
   stats.complete_import_flow_cnt++;
 
@@ -1171,6 +1444,29 @@ void Worker::process_rwlease_response(RWLeaseResponse *r, WorkerID from) {
   }
 }
 
+void Worker::process_rwlease_request_multi(RWLeaseMulti *r, WorkerID from) {
+  swobj_manager->begin_lease_batch();
+
+  int offset = 0;
+  for (int i = 0; i < r->count; i++) {
+    RWLeaseRequest *req = (RWLeaseRequest *)(r->rwlease + offset);
+    process_rwlease_request(req, from);
+    offset += sizeof(RWLeaseRequest) + req->key_size;
+  }
+
+  swobj_manager->end_lease_batch();
+}
+
+void Worker::process_rwlease_response_multi(RWLeaseMulti *r, WorkerID from) {
+  int offset = 0;
+  for (int i = 0; i < r->count; i++) {
+    RWLeaseResponse *res = (RWLeaseResponse *)(r->rwlease + offset);
+    process_rwlease_response(res, from);
+    offset += sizeof(RWLeaseResponse) + res->key_size +
+              (res->delta_size >= 0 ? res->delta_size : res->obj_size);
+  }
+}
+
 void Worker::process_rwlease_expire_request(RWLeaseExpireRequest *r,
                                             WorkerID from) {
   const Key *key = (const Key *)(void *)r->buf;
@@ -1190,7 +1486,8 @@ void Worker::process_rwlease_expire_response(RWLeaseExpireResponse *r) {
     data = r->buf + r->key_size;
 
   swobj_manager->remote_notify_expire_rwref(r->map_id, key, r->version,
-                                            r->obj_size, data, -1);
+                                            r->obj_size, data, -1,
+                                            r->delta_size);
 }
 
 void Worker::process_key_request(RWKeyRequest *r, WorkerID from) {
@@ -1235,6 +1532,46 @@ void Worker::process_rw_cleanup_meta_request(RWCleanupMetaRequest *r,
   swobj_manager->remote_cleanup_meta(r->map_id, key, r->version, from);
 }
 
+void Worker::process_ro_cache_request(ROCacheRequest *r, WorkerID from) {
+  DEBUG_DEV("RO_CACHE_REQUEST from " << from);
+  const Key *key = (const Key *)(void *)r->buf;
+
+  swobj_manager->remote_create_cache(r->map_id, key, from);
+}
+
+void Worker::process_ro_cache_response(ROCacheResponse *r) {
+  const Key *key = (const Key *)(void *)r->buf;
+  DEBUG_DEV("RO_CACHE_RESPONSE for " << *key << " with version "
+                                     << r->version);
+
+  void *data = nullptr;
+  if (r->obj_size)
+    data = r->buf + r->key_size;
+
+  swobj_manager->remote_set_cache(r->map_id, key, r->version, r->obj_size,
+                                  data);
+}
+
+void Worker::process_ro_cache_invalidate(ROCacheInvalidate *r) {
+  const Key *key = (const Key *)(void *)r->buf;
+  DEBUG_DEV("RO_CACHE_INVALIDATE for " << *key << " with version "
+                                       << r->version);
+
+  swstub_manager->invalidate_cache(r->map_id, key);
+}
+
+void Worker::process_home_transfer(HomeTransfer *r, WorkerID from) {
+  const Key *key = (const Key *)(void *)r->buf;
+  DEBUG_DEV("HOME_TRANSFER for " << *key << " from " << from);
+
+  void *data = nullptr;
+  if (r->obj_size)
+    data = r->buf + r->key_size;
+
+  swobj_manager->remote_accept_home(r->map_id, key, r->version, r->obj_size,
+                                    data, from);
+}
+
 void Worker::process_skeleton_stream(SkeletonStream *s, WorkerID from) {
   DEBUG_DEV("IMPORTING SKELETON_STREAM");
 
@@ -10,6 +10,7 @@
 #include "application.hh"
 #include "mem_pool.hh"
 #include "message.hh"
+#include "timer_wheel.hh"
 #include "worker_config.hh"
 
 #define NUM_CO_ROUTINES 65536
@@ -47,10 +48,13 @@ class Worker {
     bool run_scheduler;
     bool remote_serving;
   } status;
-  struct {
-    uint64_t time;
-    int id;
-  } bgf;
+  TimerWheel *timers;
+  struct BgfTimer {
+    Worker *worker;
+    int fid;
+    Timer *timer;  // nullptr for none
+  } bgf_timers[MAX_BGFUNC_CNT];
+  int bgf_timer_cnt;
 
   ControlBus *cbus;
   Connector *state_sock;
@@ -74,16 +78,30 @@ class Worker {
     uint32_t complete_import_flow_cnt = 0;
   } stats;
   bool force_scaling_completed = false;
+  bool with_controller = false;
 
   Worker(const Worker &me);
 
+  static void on_bgf_timer(void *arg);
+  static void on_aggregation_timer(void *arg);
+  static void on_mem_check_timer(void *arg);
+
   bool check_state_channel_connectivity();
 
+  int get_max_coroutines() const {
+    return wconf->max_coroutines > 0 ? wconf->max_coroutines : NUM_CO_ROUTINES;
+  }
+
   int connect_controller();
   int wait_to_be_all_ready();
   void wait_to_finish();
 
+  void write_to_controller(char *buffer, int nbytes);
   void send_msg_to_controller(const char *msg_type);
+  void report_load();
+  void report_latency();
+  void report_mem_pressure(const char *pool, MemPool *mp);
+  void check_mem_pressure();
   void notify_ready();
   void notify_run();
   void notify_prepared_scaling();
@@ -112,6 +130,8 @@ class Worker {
   void process_mw_aggr_request(MWAggrRequest *r);
   void process_rwlease_request(RWLeaseRequest *r, WorkerID from);
   void process_rwlease_response(RWLeaseResponse *r, WorkerID from);
+  void process_rwlease_request_multi(RWLeaseMulti *r, WorkerID from);
+  void process_rwlease_response_multi(RWLeaseMulti *r, WorkerID from);
   void process_rwlease_expire_request(RWLeaseExpireRequest *r, WorkerID from);
   void process_rwlease_expire_response(RWLeaseExpireResponse *r);
   void process_key_request(RWKeyRequest *r, WorkerID from);
@@ -119,6 +139,10 @@ class Worker {
   void process_rw_del_request(RWDeleteRequest *r, WorkerID from);
   void process_rw_del_response(RWDeleteResponse *r);
   void process_rw_cleanup_meta_request(RWCleanupMetaRequest *r, WorkerID from);
+  void process_ro_cache_request(ROCacheRequest *r, WorkerID from);
+  void process_ro_cache_response(ROCacheResponse *r);
+  void process_ro_cache_invalidate(ROCacheInvalidate *r);
+  void process_home_transfer(HomeTransfer *r, WorkerID from);
   void process_skeleton_stream(SkeletonStream *s, WorkerID from);
 
  public:
@@ -139,9 +163,9 @@ class Worker {
   // TODO Only for tests -- Should be removed
   void set_num_packets_to_proc(int cnt);
   int set_routine_function(packet_func cb);
-  int set_single_function(background_func sf);
+  int set_single_function(background_func sf);  // returns the fid
 
-  void run_single_function(int fid);  // XXX currently ignored fid
+  void run_single_function(int fid);
   void run_single_function_after_us(int fid, useconds_t us);
 
   void run(bool connect_controller = true);
@@ -16,12 +16,17 @@ struct WorkerConfig {
   WorkerAddress *state_addr;
   WorkerAddress *mng_addr;
   int function_id;  // in case of background workers
+  uint16_t queue_id = 0;  // dpdk rx/tx queue polled by this worker
+  uint16_t queue_cnt = 1;  // workers (queues) of the process
+  int max_coroutines = 0;  // packet coroutines, 0 for NUM_CO_ROUTINES
+  char *sched_policy = nullptr;  // see parse_sched_policy()
   char *log_fld = nullptr;
 
   int max_swobj_size;
   int max_expected_flows;
   int max_mwobj_size;
   int max_expected_shared_objs;
+  bool hugepage_objs = false;  // back object slabs with hugepages
 
   bool pong_received_from[MAX_WORKER_CNT];
 };
@@ -1,14 +1,20 @@
+#include <arpa/inet.h>
 #include <unistd.h>
 
 #include <csignal>
 #include <iostream>
+#include <string>
 
 #include <rte_eal.h>
+#include <rte_launch.h>
 #include <rte_lcore.h>
 
 #include "../src/application.hh"
+#include "../src/d_routine.hh"
 #include "../src/dpdk.hh"
 #include "../src/log.hh"
+#include "../src/shm_ring_controlbus.hh"
+#include "../src/spsc_controlbus.hh"
 #include "../src/stub_factory.hh"
 #include "../src/tcp_controlbus.hh"
 #include "../src/worker.hh"
@@ -17,16 +23,41 @@
 #define RPC_WORKER_ID MAX_PWORKER_CNT
 
 /* FIXME: BETTER INTERFACE
- * For efficient memory allocation structure
- * -1: use normall malloc
- * > 0: use efficient malloc
+ * Bound of object memory per worker (size * count)
+ * -1: a share of the memory of the host (or of the dpdk socket)
+ * > 0: reserve only that much
  */
 int MAX_SWOBJ_SIZE = -1;
 int MAX_MWOBJ_SIZE = -1;
 int MAX_FLOWS = -1;
 int MAX_SHARED_OBJS = -1;
 
-Worker *worker = nullptr;
+/* One worker per dpdk queue; worker q runs on lcore (core + q) */
+Worker *workers[MAX_DPDK_QUEUES] = {nullptr};
+uint16_t num_workers = 1;
+
+/* State channel transport: "tcp", "shm" for workers on the same host, or
+ * "spsc" for the workers of this process (-q) */
+std::string cbus_type = "tcp";
+
+/* Upper bound of packet coroutines per worker, created on demand */
+int max_coroutines = 0;
+
+/* Scheduler policy of packet workers, e.g., "wake=64,pkt=2" */
+char *sched_policy = nullptr;
+
+/* Back object memory with hugepages */
+bool hugepage_objs = false;
+
+/* Hugepage memory of DPDK in MB, also for objects with -H */
+const char *dpdk_mem_mb = "1024";
+
+struct LcoreWorkerArg {
+  WorkerConfig wconfig;
+  WorkerType w_type;
+  bool with_controller;
+  int core;
+};
 
 static void show_usage(char *prog_name) {
   DEBUG_ERR("Usage: " << prog_name
@@ -38,16 +69,31 @@ static void show_usage(char *prog_name) {
                          "-C <control network ip:port> \n"
                          "-m <management socket with controller> \n"
                          "[-b background worker (default: packet worker)] \n"
-                         "[-c <core id>] \n");
+                         "[-c <core id>] \n"
+                         "[-H back objects with hugepages] \n"
+                         "[-M <dpdk hugepage memory in MB (default: 1024)>] \n"
+                         "[-q <number of rx/tx queues, one worker per queue "
+                         "on consecutive cores (default: 1)>] \n"
+                         "[-p <scheduler policy: key=value,... of wake, "
+                         "pkt, slice, idle, wake_first "
+                         "(e.g., wake=64,pkt=2)>] \n"
+                         "[-r <maximum number of packet coroutines per "
+                         "worker>] \n"
+                         "[-t <state channel: tcp | shm (shared memory with "
+                         "workers on the same host, tcp otherwise) | spsc "
+                         "(rings between the workers of this process, tcp "
+                         "otherwise)> (default: tcp)] \n");
   return;
 }
 
 void signal_handler(int signo) {
   if (signo == SIGTERM) {
-    if (worker)
-      worker->reserve_quit();
-    else
+    if (!workers[0])
       exit(EXIT_FAILURE);
+
+    for (int i = 0; i < num_workers; i++)
+      if (workers[i])
+        workers[i]->reserve_quit();
   }
 }
 
@@ -61,6 +107,70 @@ void dump_maps() {
   exit(EXIT_SUCCESS);
 }
 
+static ControlBus *create_control_bus() {
+  if (cbus_type == "shm")
+    return new ShmRingControlBus();
+  if (cbus_type == "spsc")
+    return new SpscControlBus();
+
+  return new TCPControlBus();
+}
+
+// worker q serves dpdk queue q, listening on state port + q with id + q
+static int launch_worker(void *arg) {
+  LcoreWorkerArg *larg = static_cast<LcoreWorkerArg *>(arg);
+  WorkerConfig *wconfig = &larg->wconfig;
+  uint16_t q = wconfig->queue_id;
+
+  // ReferenceInterceptor is per thread, so create worker on its own lcore
+  Worker *worker = new Worker(wconfig, true, create_control_bus());
+  workers[q] = worker;
+
+  if (larg->w_type == BACKGROUND_WORKER)
+    worker->set_remote_serving();
+
+  if (!larg->with_controller) {
+    // FIXME load configuration from somewhere else
+    ActiveWorkers *active_workers = new ActiveWorkers();
+    active_workers->pworker_cnt = 2;
+    active_workers->state_addrs[RPC_WORKER_ID] =
+        *WorkerAddress::CreateWorkerAddress("127.0.0.1:1000");
+    active_workers->state_addrs[0] =
+        *WorkerAddress::CreateWorkerAddress("127.0.0.1:1001");
+
+    // and the workers of the other queues of this process
+    uint16_t first_node = wconfig->node_id - q;
+    uint16_t first_port = ntohs(wconfig->state_addr->get_port()) - q;
+    for (uint16_t i = 0; i < num_workers; i++)
+      active_workers->state_addrs[first_node + i] = WorkerAddress(
+          wconfig->state_addr->get_ip_addr(), first_port + i);
+    if (active_workers->pworker_cnt < first_node + num_workers)
+      active_workers->pworker_cnt = first_node + num_workers;
+
+    worker->set_active_workers(active_workers);
+  }
+
+  DEBUG_INFO("==================================================");
+  DEBUG_INFO("Worker id: " << wconfig->id);
+  DEBUG_INFO("Node id: " << wconfig->node_id);
+  DEBUG_INFO("Worker type: " << ((wconfig->type == PACKET_WORKER)
+                                     ? "PACKET_WORKER"
+                                     : "BACKGROUND_WORKER"));
+  DEBUG_INFO("State Channel network address: " << *wconfig->state_addr << " ("
+                                                 << cbus_type << ")");
+  DEBUG_INFO("Queue id: " << q << " / " << num_workers);
+  if (larg->core >= 0)
+    DEBUG_INFO("Core id: " << larg->core);
+  DEBUG_INFO("=================================================");
+
+  Application *app = create_application();
+  worker->set_application(app, larg->w_type);
+
+  worker->run(larg->with_controller);
+
+  return 0;
+}
+
 // start worker process
 int main(int argc, char *argv[]) {
   uint16_t w_id = -1;
@@ -77,7 +187,7 @@ int main(int argc, char *argv[]) {
   int opt;
 
   // load cmd options
-  while ((opt = getopt(argc, argv, "bc:d:Dhi:m:n:s:")) != -1) {
+  while ((opt = getopt(argc, argv, "bc:d:DhHi:m:M:n:p:q:r:s:t:")) != -1) {
     switch (opt) {
       case 'b':
         w_type = BACKGROUND_WORKER;
@@ -94,9 +204,15 @@ int main(int argc, char *argv[]) {
       case 'h':
         show_usage(argv[0]);
         exit(EXIT_FAILURE);
+      case 'H':
+        hugepage_objs = true;
+        break;
       case 'i':
         vport = optarg;
         break;
+      case 'M':
+        dpdk_mem_mb = optarg;
+        break;
       case 'm':
         mng_addr = parse_worker_address(optarg);
         if (!mng_addr) {
@@ -108,6 +224,28 @@ int main(int argc, char *argv[]) {
       case 'n':
         n_id = atoi(optarg);
         break;
+      case 'p': {
+        SchedPolicy policy;
+        if (parse_sched_policy(optarg, &policy) < 0)
+          exit(EXIT_FAILURE);
+        sched_policy = optarg;
+        break;
+      }
+      case 'q':
+        num_workers = atoi(optarg);
+        if (num_workers < 1 || num_workers > MAX_DPDK_QUEUES) {
+          DEBUG_ERR("number of queues should be in [1, " << MAX_DPDK_QUEUES
+                                                         << "]");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'r':
+        max_coroutines = atoi(optarg);
+        if (max_coroutines < 1) {
+          DEBUG_ERR("number of coroutines should be positive");
+          exit(EXIT_FAILURE);
+        }
+        break;
       case 's':
         state_addr = parse_worker_address(optarg);
         if (!state_addr) {
@@ -115,6 +253,13 @@ int main(int argc, char *argv[]) {
           exit(EXIT_FAILURE);
         }
         break;
+      case 't':
+        cbus_type = optarg;
+        if (cbus_type != "tcp" && cbus_type != "shm" && cbus_type != "spsc") {
+          DEBUG_ERR("unknown state channel type: " << cbus_type);
+          exit(EXIT_FAILURE);
+        }
+        break;
       default:
         DEBUG_ERR("unknown option: " << opt);
         show_usage(argv[0]);
@@ -139,6 +284,10 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
+  // background workers do not touch packets, so they need no extra queue
+  if (w_type == BACKGROUND_WORKER)
+    num_workers = 1;
+
   if (w_type == PACKET_WORKER) {
     // Initiate DPDK
     int rte_argc = 0;
@@ -147,77 +296,78 @@ int main(int argc, char *argv[]) {
     char file_prefix[100];
     sprintf(file_prefix, "%s%2d", "--file-prefix=s6", w_id);
 
+    char lcores[32];
+    sprintf(lcores, "%u-%u", core, core + num_workers - 1);
+
     rte_argv[rte_argc++] = argv[0];
     rte_argv[rte_argc++] = "-l";
-    rte_argv[rte_argc++] = "0";
+    rte_argv[rte_argc++] = lcores;
     rte_argv[rte_argc++] = "-m";
-    rte_argv[rte_argc++] = "1024";
+    rte_argv[rte_argc++] = dpdk_mem_mb;
     rte_argv[rte_argc++] = file_prefix;
     rte_argv[rte_argc++] = "--no-pci";
     rte_argv[rte_argc++] = vport;
     rte_argv[rte_argc] = nullptr;
 
-    init_dpdk(rte_argc, rte_argv);
-  }
-
-  // Core affinitize
-  if (core >= 0) {
+    init_dpdk(rte_argc, rte_argv, num_workers);
+  } else if (core >= 0) {
+    // Core affinitize (dpdk pins its lcores by itself)
     cpu_set_t set;
     CPU_ZERO(&set);
     CPU_SET(core, &set);
     rte_thread_set_affinity(&set);
   }
 
-  // Create worker configuration
-  WorkerConfig wconfig;
-  wconfig.id = w_id;
-  wconfig.node_id = n_id;
-  wconfig.type = w_type;
+  // Create worker configurations, one per queue
+  LcoreWorkerArg largs[MAX_DPDK_QUEUES];
+
+  for (uint16_t q = 0; q < num_workers; q++) {
+    WorkerConfig &wconfig = largs[q].wconfig;
+    wconfig.id = w_id + q;
+    wconfig.node_id = n_id + q;
+    wconfig.type = w_type;
+    wconfig.queue_id = q;
+    wconfig.queue_cnt = num_workers;
+    wconfig.max_coroutines = max_coroutines;
+    wconfig.sched_policy = sched_policy;
+
+    for (int i = 0; i < MAX_WORKER_CNT; i++) {
+      wconfig.pong_received_from[i] = false;
+    }
 
-  for (int i = 0; i < MAX_WORKER_CNT; i++) {
-    wconfig.pong_received_from[i] = false;
+    wconfig.mng_addr = mng_addr;
+    if (q == 0)
+      wconfig.state_addr = state_addr;
+    else
+      wconfig.state_addr = new WorkerAddress(
+          state_addr->get_ip_addr(), ntohs(state_addr->get_port()) + q);
+
+    wconfig.max_swobj_size = MAX_SWOBJ_SIZE;
+    wconfig.max_expected_flows = MAX_FLOWS;
+    wconfig.max_mwobj_size = MAX_MWOBJ_SIZE;
+    wconfig.max_expected_shared_objs = MAX_SHARED_OBJS;
+    wconfig.hugepage_objs = hugepage_objs;
+
+    largs[q].w_type = w_type;
+    largs[q].with_controller = with_controller;
+    largs[q].core = core + q;
   }
 
-  wconfig.mng_addr = mng_addr;
-  wconfig.state_addr = state_addr;
-
-  wconfig.max_swobj_size = MAX_SWOBJ_SIZE;
-  wconfig.max_expected_flows = MAX_FLOWS;
-  wconfig.max_mwobj_size = MAX_MWOBJ_SIZE;
-  wconfig.max_expected_shared_objs = MAX_SHARED_OBJS;
-
-  worker = new Worker(&wconfig, true, new TCPControlBus());
-
-  if (w_type == BACKGROUND_WORKER)
-    worker->set_remote_serving();
-
-  if (!with_controller) {
-    // FIXME load configuration from somewhere else
-    ActiveWorkers *active_workers = new ActiveWorkers();
-    active_workers->pworker_cnt = 2;
-    active_workers->state_addrs[RPC_WORKER_ID] =
-        *WorkerAddress::CreateWorkerAddress("127.0.0.1:1000");
-    active_workers->state_addrs[0] =
-        *WorkerAddress::CreateWorkerAddress("127.0.0.1:1001");
-
-    worker->set_active_workers(active_workers);
+  // queue 0 runs on the master lcore, the others on slave lcores
+  if (num_workers > 1) {
+    unsigned lcore_id;
+    uint16_t q = 1;
+    RTE_LCORE_FOREACH_SLAVE(lcore_id) {
+      if (q >= num_workers)
+        break;
+      rte_eal_remote_launch(launch_worker, &largs[q++], lcore_id);
+    }
   }
 
-  DEBUG_INFO("==================================================");
-  DEBUG_INFO("Worker id: " << wconfig.id);
-  DEBUG_INFO("Node id: " << wconfig.node_id);
-  DEBUG_INFO("Worker type: " << ((wconfig.type == PACKET_WORKER)
-                                     ? "PACKET_WORKER"
-                                     : "BACKGROUND_WORKER"));
-  DEBUG_INFO("State Channel network address: " << *state_addr);
-  if (core >= 0)
-    DEBUG_INFO("Core id: " << core);
-  DEBUG_INFO("=================================================");
-
-  Application *app = create_application();
-  worker->set_application(app, w_type);
+  launch_worker(&largs[0]);
 
-  worker->run(with_controller);
+  if (num_workers > 1)
+    rte_eal_mp_wait_lcore();
 
   return 0;
 }
@@ -72,6 +72,9 @@ def get_var_attrs(cli, var_token, partial_word):
         var_desc = 'one or more of cids'
     elif var_token == 'CORE':
         var_type = 'int'
+    elif var_token == 'QUEUES':
+        var_type = 'int'
+        var_desc = 'rx queues, a worker each with cids from NEW_CID'
     elif var_token == 'CNAME':
         var_type = 'name'
         var_desc = 'container name'
@@ -221,6 +224,11 @@ def init(cli, cid, host_name, core=None):
     cli.s6ctl.init(cid, host_name, core)
 
 
+@cmd('init NEW_CID HOST CORE QUEUES', 'Start a new multi-queue container')
+def init_queues(cli, cid, host_name, core, queues):
+    cli.s6ctl.init(cid, host_name, core, queues=queues)
+
+
 @cmd('start CID...', 'Run NF instances as a cluster')
 def start(cli, cids):
     cli.s6ctl.start(cids)
@@ -236,6 +244,29 @@ def scale_in(cli, cids):
     cli.s6ctl.scale_in(cids)
 
 
+@cmd('rebalance', 'Move hot keys off overloaded workers')
+def rebalance(cli):
+    cli.s6ctl.rebalance()
+
+
+@cmd('latency', 'Show packet latency and the latency-based scaling decision')
+def latency(cli):
+    decision = cli.s6ctl.scaling_decision()
+    print({1: 'Scale out: p99 latency above the SLO or memory pressure',
+           -1: 'Scale in: p99 latency well below the SLO',
+           0: 'No scaling needed'}[decision])
+
+
+@cmd('memory', 'Show the object memory of the workers under pressure')
+def memory(cli):
+    cli.s6ctl.mem_pressure()
+
+
+@cmd('clear-overrides', 'Place all keys by the base hash again')
+def clear_overrides(cli):
+    cli.s6ctl.keyspace.clear_overrides()
+
+
 @cmd('kill CID', 'Kill a running container')
 def kill(cli, cid):
     cli.s6ctl.kill(cid)
@@ -13,6 +13,7 @@ from nfinstance import *
 from s6ctl_config import *
 
 MAX_LISTENING_QSIZE = 16
+MAX_MSG_LEN = 9999  # the length prefix has 4 digits
 
 
 class CommThread(threading.Thread):
@@ -76,6 +77,10 @@ class CommThread(threading.Thread):
         return self.server_address
 
     def send(self, cid, msg):  # called by other threads
+        if len(msg) + 5 > MAX_MSG_LEN:
+            raise ValueError('Message to %d is too long (%d bytes)' %
+                             (cid, len(msg) + 5))
+
         msg_wrap = "%04d%s\x00" % \
             (len(msg) + 5, msg)
 
@@ -129,6 +134,18 @@ class CommThread(threading.Thread):
         self.nf_instances[wid].update(NFInstance.ST_PREPARE_NORMAL,
                                       NFInstance.ST_NORMAL)
 
+    def _process_load_report(self, jmsg):
+        wid = jmsg['worker_id']
+        self.nf_instances[wid].notify_load_report(jmsg)
+
+    def _process_latency_report(self, jmsg):
+        wid = jmsg['worker_id']
+        self.nf_instances[wid].notify_latency_report(jmsg)
+
+    def _process_mem_report(self, jmsg):
+        wid = jmsg['worker_id']
+        self.nf_instances[wid].notify_mem_report(jmsg)
+
     def _process_teared_down(self, jmsg):
         wid = jmsg['worker_id']
         self.nf_instances[wid].notify_teared_down(NFInstance.ST_NORMAL,
@@ -166,6 +183,15 @@ class CommThread(threading.Thread):
             elif msg_type == 'teared_down':
                 self._process_teared_down(jmsg)
 
+            elif msg_type == 'load_report':
+                self._process_load_report(jmsg)
+
+            elif msg_type == 'latency_report':
+                self._process_latency_report(jmsg)
+
+            elif msg_type == 'mem_report':
+                self._process_mem_report(jmsg)
+
             else:
                 print('msg_type "%s" is not specified' %
                       msg_type, file=sys.stderr)
@@ -205,13 +231,17 @@ class CommThread(threading.Thread):
                 data = self.fd_to_socket[fd].recv(1024)
                 if data:
                     self.received[fd] += data
-                    msg_len = int(data[0:4], 10)
 
                     if VERBOSE:
                         (ip, port) = self.fd_to_addr[fd]
                         print('[%s:%d(%d)] Recv: %s' % (ip, port, fd, data))
 
-                    if msg_len <= len(self.received[fd]):
+                    # a message may span several recv()s, or share one
+                    while len(self.received[fd]) >= 4:
+                        msg_len = int(self.received[fd][0:4], 10)
+                        if msg_len > len(self.received[fd]):
+                            break
+
                         jmsg = json.loads(
                             self.received[fd][4:msg_len - 1])  # Remove \00
                         self._process_message(jmsg, fd)
@@ -22,7 +22,8 @@ class NFInstance(object):
              'ST_PREPARE_SCALING', 'ST_SCALING', 'ST_COMPLETED_SCALING',
              'ST_PREPARE_NORMAL', 'ST_TEARDOWN']
 
-    def __init__(self, cid, nf_name, host, core, ctrl_address, bg=False):
+    def __init__(self, cid, nf_name, host, core, ctrl_address, bg=False,
+                 queues=1, queue_id=0):
         self.cid = cid  # FIXME cid and nid
         self.nid = cid
         self.nf_name = nf_name
@@ -33,9 +34,21 @@ class NFInstance(object):
         self.state_port = STATE_PORT + self.cid
         self.ctrl_address = ctrl_address
         self.bg = bg
+        self.queues = queues  # workers of the container, from queue_id 0
+        self.queue_id = queue_id
+        self.cbus = 'tcp'  # state channel, see s6_worker -t
         self.state = self.ST_INIT
+        self.load_report = None
+        self.latency_report = None
+        self.mem_reports = {}  # the last one of each object pool
         self.cv = threading.Condition(threading.Lock())
 
+    # the worker of rx queue q, in the container of this one
+    def queue_instance(self, q):
+        return NFInstance(self.cid + q, self.nf_name, self.host,
+                          self.core + q, self.ctrl_address, self.bg,
+                          self.queues, q)
+
     def start_container(self):
         nf_opts = ['-d %d' % self.cid,  # worker ID
                    '-n %d' % self.nid,  # node ID
@@ -45,6 +58,11 @@ class NFInstance(object):
                    '-s %s:%d' % (self.state_ip, self.state_port),
                    ]
 
+        if self.queues > 1:
+            nf_opts.append('-q %d' % self.queues)
+        if self.cbus != 'tcp':
+            nf_opts.append('-t %s' % self.cbus)
+
         if self.bg:
             nf_opts.append('-b')
         else:
@@ -74,6 +92,8 @@ class NFInstance(object):
 
     def kill_container(self):
         self.host.release_core(self.core)
+        if self.queue_id > 0:
+            return True  # along with queue 0
 
         try:
             cmd = 'docker rm -f {name}'.format(name=self.cname)
@@ -104,3 +124,45 @@ class NFInstance(object):
         while not self.state == st:
             self.cv.wait()
         self.cv.release()
+
+    def notify_load_report(self, report):
+        self.cv.acquire()
+        self.load_report = report
+        self.cv.notify()
+        self.cv.release()
+
+    def wait_load_report(self):
+        self.cv.acquire()
+        while self.load_report is None:
+            self.cv.wait()
+        report = self.load_report
+        self.load_report = None
+        self.cv.release()
+        return report
+
+    def notify_latency_report(self, report):
+        self.cv.acquire()
+        self.latency_report = report
+        self.cv.notify()
+        self.cv.release()
+
+    def wait_latency_report(self):
+        self.cv.acquire()
+        while self.latency_report is None:
+            self.cv.wait()
+        report = self.latency_report
+        self.latency_report = None
+        self.cv.release()
+        return report
+
+    # pushed by the worker when a pool goes under or out of pressure
+    def notify_mem_report(self, report):
+        self.cv.acquire()
+        self.mem_reports[report['pool']] = report
+        self.cv.release()
+
+    def under_mem_pressure(self):
+        self.cv.acquire()
+        pressure = any(r['pressure'] for r in self.mem_reports.values())
+        self.cv.release()
+        return pressure
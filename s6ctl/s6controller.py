@@ -19,6 +19,10 @@ lb_rule = {'offset': 26, 'size': 8, 'ogates': 1,
            'method': 'hashing', 'direction': 'bidirectional'}
 
 SCALING_TIMEOUT = 5  # in seconds
+REBALANCE_THRESHOLD = 0.1  # tolerated load above the average
+REBALANCE_MAX_OVERRIDES = 128  # keeps keyspace messages below 10000 bytes
+LATENCY_SLO_US = 500  # p99 packet latency target of a worker
+SCALE_IN_LATENCY_RATIO = 0.5  # of the SLO, below which workers are spare
 
 
 class KeySpace(object):
@@ -28,11 +32,13 @@ class KeySpace(object):
     LOC_HASHING = 3
     LOC_CHASHING = 4
     LOC_BALANCED = 5
+    LOC_LOADAWARE = 6  # LOC_BALANCED with the override table
 
     def __init__(self, nf_name, host_to_inquire):
         self.default_rule = {'loc_type': self.LOC_LOCAL, 'param': 0}
         self.map_rules = []
         self.map_name_to_id = {}
+        self.overrides = {}  # placement hash -> worker ID
 
         dump_cmd = '%s -D' % nf_bins[nf_name]
         lines = host_to_inquire.ssh_cmd(dump_cmd)
@@ -52,7 +58,50 @@ class KeySpace(object):
 
     def get_json(self):
         return {'default_rule': self.default_rule,
-                'map_rules': self.map_rules}
+                'map_rules': self.map_rules,
+                'overrides': [[h, wid] for h, wid in self.overrides.items()]}
+
+    def uses(self, loctype):
+        return self.default_rule['loc_type'] == loctype or \
+            any(rule['loc_type'] == loctype for rule in self.map_rules)
+
+    # reports: {worker ID: {'accesses': n, 'hot_keys': [[hash, count], ...]}}
+    # Greedily moves the hottest key of the most loaded worker to the least
+    # loaded one, while it lowers the maximum load. Returns # of moved keys.
+    def rebalance(self, reports, threshold):
+        for h, wid in list(self.overrides.items()):
+            if wid not in reports:
+                del self.overrides[h]
+
+        load = dict((wid, r['accesses']) for wid, r in reports.items())
+        hot = dict((wid, sorted(r['hot_keys'], key=lambda hk: hk[1]))
+                   for wid, r in reports.items())
+        avg = sum(load.values()) / float(max(len(load), 1))
+        moved = 0
+
+        while len(self.overrides) < REBALANCE_MAX_OVERRIDES:
+            src = max(load, key=load.get)
+            dst = min(load, key=load.get)
+            if load[src] <= avg * (1 + threshold):
+                break
+
+            # the heaviest key that does not make dst the new hot spot
+            gap = load[src] - load[dst]
+            cands = [hk for hk in hot[src] if hk[1] < gap]
+            if not cands:
+                break
+
+            h, cnt = cands[-1]
+            hot[src].remove(cands[-1])
+            self.overrides[h] = dst
+            load[src] -= cnt
+            load[dst] += cnt
+            moved += 1
+
+        return moved
+
+    def clear_overrides(self):
+        self.overrides = {}
 
     def set_rule_default(self, loctype, param=0):
         self.default_rule = {'loc_type': loctype, 'param': param}
@@ -89,6 +138,17 @@ class Host(object):
                 return i
         raise Exception('No available core')
 
+    # consecutive cores, for a worker per rx queue (see s6_worker -q)
+    def acquire_cores(self, count, core=None):
+        for i in range(self.num_cores - count + 1):
+            if core is not None and core != i:
+                continue
+            if all(self.avail_core[i:i + count]):
+                for j in range(i, i + count):
+                    self.avail_core[j] = False
+                return i
+        raise Exception('No %d available consecutive cores' % count)
+
     def release_core(self, core):
         if core == 0 or core >= self.num_cores:
             raise Exception('Core %d cannot be released' % core)
@@ -338,20 +398,34 @@ class S6Controller(object):
         for host_name, host in self.hosts.items():
             host.stop_measure()
 
-    def init(self, cid, host_name, core=None, bg=False):
+    # with queues, the container runs a worker per rx queue: cid + q on
+    # core + q, each an instance of its own
+    def init(self, cid, host_name, core=None, bg=False, queues=1, cbus='tcp'):
         if host_name not in self.hosts:
             print('Host %s does not exists' % host_name, file=sys.stderr)
             return
 
+        if queues > 1 and bg:
+            print('Background workers have no rx queue', file=sys.stderr)
+            return
+
+        for qcid in range(cid, cid + queues):
+            if qcid in self.nf_instances:
+                print('cid %d is already in use' % qcid, file=sys.stderr)
+                return
+
         host = self.hosts[host_name]
-        core = host.acquire_core(core)
+        core = host.acquire_cores(queues, core)
         instance = NFInstance(
-            cid, self.nf_name, host, core, self.ctrl_address, bg)
+            cid, self.nf_name, host, core, self.ctrl_address, bg, queues)
+        instance.cbus = cbus
 
         if instance.start_container():
             self.nf_instances[cid] = instance
-            print('[Instance %d] Created in %s (core=%d)' %
-                  (cid, host_name, core))
+            for q in range(1, queues):
+                self.nf_instances[cid + q] = instance.queue_instance(q)
+            print('[Instance %d] Created in %s (core=%d, queues=%d)' %
+                  (cid, host_name, core, queues))
 
     # Start NF application as a clusters of cids
     def start(self, cids):
@@ -470,10 +544,15 @@ class S6Controller(object):
         all_cids = self.nf_instances.keys()
         after_scale = list(set(all_cids) - set(in_cids))
 
-        print('Stage1: Prepare scaling in')
+        self._reconfigure(all_cids, after_scale, 'scaling in')
+
+    # Moves objects to their managers under the new keyspace:
+    # prepare (with the new workers and keyspace), start, wait, and quiescent
+    def _reconfigure(self, all_cids, worker_cids, what, stage=1):
+        print('Stage%d: Prepare %s' % (stage, what))
         msg = json.dumps({
             'msg_type': 'prepare_scaling',
-            'workers': self._get_json_instances(after_scale),
+            'workers': self._get_json_instances(worker_cids),
             'keyspace': self.keyspace.get_json()
         })
         for cid in all_cids:
@@ -482,17 +561,17 @@ class S6Controller(object):
             self.nf_instances[cid].wait(NFInstance.ST_PREPARE_SCALING)
             print('[Instance %d] Ready to scale' % cid)
 
-        print('Stage2: Start scaling in')
+        print('Stage%d: Start %s' % (stage + 1, what))
         msg = json.dumps({'msg_type': 'start_scaling'})
         for cid in all_cids:
             self.thread.send(cid, msg)
         for cid in all_cids:
             self.nf_instances[cid].wait(NFInstance.ST_SCALING)
-            print('[Instance %d] Start scaling-in' % cid)
+            print('[Instance %d] Start %s' % (cid, what))
 
         # Change reload-balance
 
-        print('Stage3: Wait scaling in done')
+        print('Stage%d: Wait %s done' % (stage + 2, what))
         time.sleep(SCALING_TIMEOUT)  # wait until scalig down
 
         # XXX force complete scaling after timeout
@@ -504,9 +583,9 @@ class S6Controller(object):
 
         for cid in all_cids:
             self.nf_instances[cid].wait(NFInstance.ST_COMPLETED_SCALING)
-            print('[Instance %d] Completed scaling-in' % cid)
+            print('[Instance %d] Completed %s' % (cid, what))
 
-        print('Stage4: Go Normal mode')
+        print('Stage%d: Go Normal mode' % (stage + 3))
         msg = json.dumps({'msg_type': 'prepare_quiescent'})
         for cid in all_cids:
             self.thread.send(cid, msg)
@@ -521,13 +600,106 @@ class S6Controller(object):
             self.nf_instances[cid].wait(NFInstance.ST_NORMAL)
             print('[Instance %d] Run normal operations' % cid)
 
+    # Collects load reports and moves the hottest keys off overloaded workers
+    # by updating only the override table of the keyspace (LOC_LOADAWARE)
+    def rebalance(self, threshold=REBALANCE_THRESHOLD):
+        if not self.keyspace.uses(KeySpace.LOC_LOADAWARE):
+            print('No map is placed with LOC_LOADAWARE, nothing to rebalance',
+                  file=sys.stderr)
+            return
+
+        all_cids = self.nf_instances.keys()
+        pcids = [cid for cid in all_cids if not self.nf_instances[cid].bg]
+
+        print('Stage1: Collect load reports')
+        msg = json.dumps({'msg_type': 'report_load'})
+        for cid in pcids:
+            self.thread.send(cid, msg)
+        reports = {}
+        for cid in pcids:
+            reports[cid] = self.nf_instances[cid].wait_load_report()
+            print('[Instance %d] %d accesses' %
+                  (cid, reports[cid]['accesses']))
+
+        moved = self.keyspace.rebalance(reports, threshold)
+        if not moved:
+            print('Load is balanced, nothing to move')
+            return
+        print('Override placement of %d keys (%d in total)' %
+              (moved, len(self.keyspace.overrides)))
+
+        self._reconfigure(all_cids, all_cids, 'rebalancing', 2)
+
+    # Collects packet latency (us) of the packet workers since the last call,
+    # per class of what the packets blocked on (local, sw, strict, ...)
+    def collect_latency(self):
+        pcids = [cid for cid in self.nf_instances.keys()
+                 if not self.nf_instances[cid].bg]
+
+        msg = json.dumps({'msg_type': 'report_latency'})
+        for cid in pcids:
+            self.thread.send(cid, msg)
+        reports = {}
+        for cid in pcids:
+            r = self.nf_instances[cid].wait_latency_report()
+            reports[cid] = r
+            print('[Instance %d] %d packets, p99 %.1f us' %
+                  (cid, r['pkts'], r['p99']))
+            for name, c in sorted(r['classes'].items()):
+                if c['pkts'] > 0:
+                    print('    %-8s%10d packets  p50 %.1f  p99 %.1f  '
+                          'p99.9 %.1f  max %.1f us' %
+                          (name, c['pkts'], c['p50'], c['p99'], c['p999'],
+                           c['max']))
+        return reports
+
+    # Workers whose object memory is under pressure, i.e., not admitting new
+    # flows, as they last reported
+    def mem_pressure(self):
+        cids = []
+        for cid, nf in sorted(self.nf_instances.items()):
+            for pool, r in sorted(nf.mem_reports.items()):
+                print('[Instance %d] %s objects %d%% of %d MB, '
+                      '%d overflows%s' %
+                      (cid, pool, r['occupancy'], r['capacity_mb'],
+                       r['overflows'],
+                       ' (under pressure)' if r['pressure'] else ''))
+            if nf.under_mem_pressure():
+                cids.append(cid)
+        return cids
+
+    # Scaling decision from the p99 latency rather than throughput:
+    # 1 (scale out) if a worker misses the SLO or is short of object memory,
+    # -1 (scale in) if all workers are well within it, 0 otherwise
+    def scaling_decision(self, slo_us=LATENCY_SLO_US):
+        reports = self.collect_latency()
+        if self.mem_pressure():
+            return 1
+
+        active = [r['p99'] for r in reports.values() if r['pkts'] > 0]
+        if not active:
+            return 0
+
+        if max(active) > slo_us:
+            return 1
+        if len(reports) > 1 and max(active) < slo_us * SCALE_IN_LATENCY_RATIO:
+            return -1
+        return 0
+
     def kill(self, cid):
         if cid not in self.nf_instances.keys():
             print('No cid %d container exists' % cid, file=sys.stderr)
             return
 
         instance = self.nf_instances[cid]
+        if instance.queue_id > 0:
+            print('cid %d is a queue of cid %d; kill that one' %
+                  (cid, cid - instance.queue_id), file=sys.stderr)
+            return
+
         del self.nf_instances[cid]
+        for q in range(1, instance.queues):
+            self.nf_instances.pop(cid + q).kill_container()
 
         if instance.kill_container():
             print('[Instance %d] Killed' % cid)
@@ -0,0 +1,40 @@
+import pprint
+import threading
+import time
+
+NF_NAME = 'nat'
+CBUS = 'spsc'
+START_TIMEOUT = 60
+
+
+def run(s6ctl):
+    print('State channel over %s between the queue workers of a container' %
+          CBUS)
+
+    print('Start host daemons')
+    s6ctl.start_host_daemon()
+
+    s6ctl.set_application(NF_NAME)
+    s6ctl.keyspace.set_rule_default(s6ctl.keyspace.LOC_HASHING)
+    print('Keyspace configuration:')
+    pprint.pprint(s6ctl.keyspace.get_json())
+
+    # 0 and 1 share a process and talk over the rings; 2 is another process,
+    # so both reach it (and it reaches them) over tcp
+    s6ctl.init(0, 'localhost', core=1, queues=2, cbus=CBUS)
+    s6ctl.init(2, 'localhost', core=3, cbus=CBUS)
+
+    # every worker pings every other one before it runs
+    starter = threading.Thread(target=s6ctl.start, args=([0, 1, 2],))
+    starter.daemon = True
+    starter.start()
+    starter.join(START_TIMEOUT)
+
+    if starter.is_alive():
+        print('FAIL: workers did not connect within %d seconds' %
+              START_TIMEOUT)
+    else:
+        time.sleep(10)
+        print('PASS: workers connected and ran for 10 seconds')
+
+    s6ctl.kill_all()
@@ -0,0 +1,41 @@
+#! /bin/bash
+
+# Throughput of a single S6 process while sweeping the number of RSS queues.
+# Usage: bench_multiqueue.sh <vdev string> [max queues] [duration sec]
+
+S6_HOME="${S6_HOME:-$HOME/S6}"
+S6_APP=$S6_HOME/bin/evals/eval_multiqueue_app
+
+VDEV=$1
+MAX_QUEUES="${2:-4}"
+DURATION="${3:-10}"
+CORE="${CORE:-1}"
+LOG=/tmp/s6_bench_multiqueue.log
+
+if [ -z "$VDEV" ] ; then
+	echo "Usage: $0 <vdev string> [max queues] [duration sec]"
+	exit 1
+fi
+
+for q in $(seq 1 $MAX_QUEUES) ; do
+	sudo $S6_APP -d 0 -n 0 -s 127.0.0.1:1001 -c $CORE -q $q -i "$VDEV" \
+		> $LOG 2>&1 &
+	PID=$!
+
+	sleep $DURATION
+	sudo kill -TERM $PID 2> /dev/null
+	wait $PID 2> /dev/null
+
+	# skip the first report of every worker (warm-up)
+	grep "\[THROUGHPUT\]" $LOG | tail -n +$((q + 1)) | \
+		awk -v q=$q '{ for (i = 1; i <= NF; i++) {
+				if ($i == "Mpps") mpps += $(i - 1);
+				if ($i == "Gbps") gbps += $(i - 1);
+			}
+			n++
+		}
+		END {
+			if (n == 0) { print q " queues: no report"; exit }
+			printf "%d queues: %.3f Mpps %.3f Gbps\n", q, mpps / n * q, gbps / n * q
+		}'
+done
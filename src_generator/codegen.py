@@ -48,6 +48,7 @@ all_keys_include = []
 all_user_classes = []
 all_global_maps = {}
 all_key_classes = []
+typed_key_classes = set()  # keys with equal_to(), see KEY_OPS() in key.hh
 
 output_dir = './'
 apps_dirs = []
@@ -270,6 +271,15 @@ def obj_dump(obj):
     print >> sys.stderr
 
 
+def has_typed_equal(node):
+    for child in node.get_children():
+        if child.kind.name == 'CXX_METHOD' and \
+                child.spelling == 'equal_to' and \
+                child.access_specifier == AccessSpecifier.PUBLIC:
+            return True
+    return False
+
+
 def get_dobj_base(node, filename):
     for child in node.get_children():
         if child.kind.name == 'CXX_BASE_SPECIFIER':
@@ -286,6 +296,8 @@ def get_dobj_base(node, filename):
                 if grandchild.type.spelling in ['SticKey', 'Key']:
                     all_key_classes.append((node.spelling,
                                             grandchild.type.spelling, filename))
+                    if has_typed_equal(node):
+                        typed_key_classes.add(node.spelling)
                     all_keys_include.append(filename[filename.rfind('/') +
                                                      1:])
                     return None
@@ -776,8 +788,15 @@ def generate_code():
     counter = 0
     for (var_name, (class_type, key_type, data_type)) in \
             all_global_maps.items():
-        map_instantiation_list += "\n" + '%s<%s, %s> %s("%s");' % \
-            (data_type, key_type, class_type, var_name, var_name)
+        if key_type in typed_key_classes:
+            map_instantiation_list += "\n" + \
+                '%s<%s, %s> %s("%s", KEY_OPS(%s));' % \
+                (data_type, key_type, class_type, var_name, var_name, key_type)
+        else:
+            print >> sys.stderr, '[WARNING] %s has no equal_to(), ' \
+                '%s uses virtual key operations' % (key_type, var_name)
+            map_instantiation_list += "\n" + '%s<%s, %s> %s("%s");' % \
+                (data_type, key_type, class_type, var_name, var_name)
 
         # user_index = class_index_dict[class_type]
         #(class_name, include_file, base_class) = all_user_classes[user_index]
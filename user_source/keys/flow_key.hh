@@ -46,13 +46,17 @@ class FlowKey : public SticKey {
       DEBUG_ERR("Dynamic cast fail from Key to FlowKey");
       return false;
     }
-    return ((sip == fother->sip) && (dip == fother->dip) &&
-            (sp == fother->sp) && (dp == fother->dp));
+    return equal_to(*fother);
   };
 
  public:
   static KeyTypeID key_tid;
 
+  bool equal_to(const FlowKey& other) const {
+    return ((sip == other.sip) && (dip == other.dip) && (sp == other.sp) &&
+            (dp == other.dp));
+  }
+
   FlowKey(uint32_t sip, uint32_t dip, uint16_t sp, uint16_t dp)
       : SticKey(), sip(sip), dip(dip), sp(sp), dp(dp){};
 
@@ -36,12 +36,14 @@ class IPKey : public SticKey {
       DEBUG_ERR("Dynamic cast fail from Key to IPKey");
       return false;
     }
-    return (ip == other_key->ip);
+    return equal_to(*other_key);
   };
 
  public:
   static KeyTypeID key_tid;
 
+  bool equal_to(const IPKey &other) const { return (ip == other.ip); }
+
   IPKey(uint32_t ip) : SticKey(), ip(ip), loc_annot(_LCAN_NONE){};
 
   IPKey(uint32_t ip, _KEY_LOC_ANNOT loc) : SticKey(), ip(ip), loc_annot(loc){};
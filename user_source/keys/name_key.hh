@@ -0,0 +1,88 @@
+#ifndef _DISTREF_NAME_KEY_HH_
+#define _DISTREF_NAME_KEY_HH_
+
+#include <cstring>
+
+#include "key_base.hh"
+
+#define NAME_KEY_LEN 64
+
+/* Host name (e.g., of a DNS query or an HTTP request), truncated to
+ * NAME_KEY_LEN - 1 characters. Larger than REF_KEY_BUF_SIZE, so references
+ * keep a heap clone of it. */
+class NameKey : public Key {
+ private:
+  char name[NAME_KEY_LEN];
+
+  std::ostream &_print(std::ostream &out) const { return out << name; }
+
+  bool _lessthan(const Key &other) const {
+    const NameKey *kother = KEY_CAST(NameKey, other);
+    if (!kother) {
+      DEBUG_ERR("Dynamic cast fail from Key to NameKey");
+      return false;
+    }
+    return strncmp(name, kother->name, NAME_KEY_LEN) < 0;
+  }
+
+  bool _equalto(const Key &other) const {
+    const NameKey *kother = KEY_CAST(NameKey, other);
+    if (!kother) {
+      DEBUG_ERR("Dynamic cast fail from Key to NameKey");
+      return false;
+    }
+    return equal_to(*kother);
+  }
+
+ public:
+  static KeyTypeID key_tid;
+
+  bool equal_to(const NameKey &other) const {
+    return strncmp(name, other.name, NAME_KEY_LEN) == 0;
+  }
+
+  NameKey(const char *str) : Key() {
+    memset(name, 0, NAME_KEY_LEN);
+    strncpy(name, str, NAME_KEY_LEN - 1);
+  }
+
+  NameKey *clone() const { return new NameKey(*this); }
+
+  NameKey *clone(size_t size, void *buf) const {
+    if (size < sizeof(NameKey))
+      return nullptr;
+
+    memcpy(buf, this, sizeof(NameKey));
+    return (NameKey *)buf;
+  }
+
+  Archive *serialize() const {
+    Archive *ar = (Archive *)malloc(sizeof(Archive) + sizeof(NameKey));
+    ar->size = sizeof(NameKey);
+    ar->class_type = _S6_KEY;
+    ar->class_id = NameKey::key_tid;
+    new (ar->data) NameKey(*this);
+    return ar;
+  }
+
+  uint32_t get_key_size() const { return sizeof(NameKey); }
+
+  uint8_t *get_bytes() const { return (uint8_t *)this; }
+
+  // FNV-1a
+  std::size_t _hash() const {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < NAME_KEY_LEN && name[i]; i++) {
+      hash ^= (uint8_t)name[i];
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  static Key *unserialize(Archive *ar) {
+    assert(ar->class_id == NameKey::key_tid);
+    return new NameKey(*(NameKey *)(void *)ar->data);
+  }
+};
+
+#endif
@@ -32,12 +32,14 @@ class PortKey : public SticKey {
       DEBUG_ERR("Dynamic cast fail from Key to PortKey");
       return false;
     }
-    return (port == pother->port);
+    return equal_to(*pother);
   };
 
  public:
   static KeyTypeID key_tid;
 
+  bool equal_to(const PortKey& other) const { return (port == other.port); }
+
   PortKey(uint16_t p) : SticKey(), port(p), loc_annot(_LCAN_NONE){};
 
   PortKey(uint16_t p, _KEY_LOC_ANNOT loc)
@@ -40,16 +40,19 @@ class SHA1Key : public Key {
       DEBUG_ERR("Dynamic cast fail from Key to SHA1Key");
       return false;
     }
+    return equal_to(*kother);
+  }
+
+ public:
+  static KeyTypeID key_tid;
 
+  bool equal_to(const SHA1Key &other) const {
     for (int i = 0; i < SHA_DIGEST_LENGTH; i++)
-      if (this->hash[i] != kother->hash[i])
+      if (this->hash[i] != other.hash[i])
         return false;
     return true;
   }
 
- public:
-  static KeyTypeID key_tid;
-
   SHA1Key(const char *str) : Key() {
     SHA1((const unsigned char *)str, sizeof(str) - 1, hash);
   }
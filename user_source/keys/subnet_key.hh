@@ -44,13 +44,17 @@ class SubnetKey : public SticKey {
       DEBUG_ERR("Dynamic cast fail from Key to SubnetKey");
       return false;
     }
-    return (subnet == other_key->subnet) &&
-           ((ip >> (32 - subnet)) == (other_key->ip >> (32 - subnet)));
+    return equal_to(*other_key);
   };
 
  public:
   static KeyTypeID key_tid;
 
+  bool equal_to(const SubnetKey& other) const {
+    return (subnet == other.subnet) &&
+           ((ip >> (32 - subnet)) == (other.ip >> (32 - subnet)));
+  }
+
   SubnetKey(uint32_t ip, uint16_t subnet)
       : SticKey(), ip(ip), subnet(subnet), loc_annot(_LCAN_NONE){};
 
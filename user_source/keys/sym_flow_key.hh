@@ -46,13 +46,17 @@ class SymFlowKey : public SticKey {
       DEBUG_ERR("Dynamic cast fail from Key to SymFlowKey");
       return false;
     }
-    return ((sip == fother->sip) && (dip == fother->dip) &&
-            (sp == fother->sp) && (dp == fother->dp));
+    return equal_to(*fother);
   };
 
  public:
   static KeyTypeID key_tid;
 
+  bool equal_to(const SymFlowKey& other) const {
+    return ((sip == other.sip) && (dip == other.dip) && (sp == other.sp) &&
+            (dp == other.dp));
+  }
+
   SymFlowKey(uint32_t sip, uint32_t dip, uint16_t sp, uint16_t dp) : SticKey() {
     if (sip < dip) {
       this->sip = sip;
@@ -0,0 +1,86 @@
+/* Coroutine block/wake-up cost */
+
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
+
+#include "dist.hh"
+
+#include "../src/d_routine.hh"
+
+#include "ip_key.hh"
+
+/*
+ * Microbenchmark tests for DroutineScheduler
+ *
+ * Before the worker starts, runs a private scheduler on synthetic packets
+ * (no dpdk): out of every 'depth' packets, all but the last one block their
+ * coroutines with yield_block(), and the last one wakes them up with
+ * notify_to_wake_up(). Reports the cycles per packet, which include the
+ * coroutine switches, and how many coroutines the pool grew to (depth at
+ * least). Then the pool is resized as if the load went away (one window with
+ * the run, POOL_SHRINK_WINDOWS idle ones) and the remaining count is
+ * reported. Packets of the worker are just forwarded.
+ *
+ */
+
+static const int bench_pkts = 1 << 20;
+static const int bench_depths[] = {2, 64, 1024};
+
+static DroutineScheduler *bench = nullptr;
+static IPKey bench_key(0);
+static int bench_depth;
+static uint64_t bench_pkt_cnt = 0;
+
+static int bench_packet(struct rte_mbuf *mbuf) {
+  if (++bench_pkt_cnt % bench_depth)
+    bench->yield_block(0, &bench_key, 0);
+  else
+    bench->notify_to_wake_up(0, &bench_key, 0);
+
+  return 0;
+}
+
+static void run_bench(int depth) {
+  bench = new DroutineScheduler(0, false /* is_dpdk */);
+  bench->set_packet_routine(bench_packet, MAX_COROUTINE_CNT);
+  bench->set_max_new_packets(bench_pkts);  // a multiple of depth
+  bench_depth = depth;
+  bench_pkt_cnt = 0;
+
+  uint64_t start = rte_rdtsc();
+  while (bench->call_scheduler())
+    ;
+  uint64_t cycles = rte_rdtsc() - start;
+
+  DEBUG_APP("[COROUTINE] depth " << depth << " coroutines "
+                                 << bench->get_pkt_routine_cnt() << ": "
+                                 << (double)cycles / bench_pkts
+                                 << " cycles per packet");
+
+  for (int i = 0; i <= POOL_SHRINK_WINDOWS; i++)
+    bench->adapt_pkt_routines();
+  DEBUG_APP("[COROUTINE] depth " << depth << " coroutines after idle windows "
+                                 << bench->get_pkt_routine_cnt());
+
+  bench->teardown();  // frees the synthetic packets
+  delete bench;
+  bench = nullptr;
+}
+
+static int init(int param) {
+  for (int depth : bench_depths)
+    run_bench(depth);
+  return 0;
+}
+
+static int packet_processing(struct rte_mbuf *mbuf) {
+  return 1;
+}
+
+Application *create_application() {
+  Application *app = new Application();
+  app->set_init_func(init);
+  app->set_packet_func(packet_processing);
+
+  return app;
+}
@@ -0,0 +1,72 @@
+/* Stateless forwarder for multi-queue throughput */
+
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+
+#include "dist.hh"
+
+/*
+ * Microbenchmark tests for multi-queue packet I/O
+ *
+ * Every worker (one per RSS queue, see '-q' of s6_worker) forwards its own
+ * share of the traffic and reports its throughput once per interval.
+ * script/bench_multiqueue.sh sweeps the number of queues and sums up.
+ *
+ */
+
+static uint64_t report_interval_sec = 1;
+
+// each lcore worker keeps its own counters
+static thread_local uint64_t pkt_cnt = 0;
+static thread_local uint64_t byte_cnt = 0;
+static thread_local uint64_t last_report_tsc = 0;
+static thread_local uint32_t ip_sum = 0;
+
+static int init(int param) {
+  if (param > 0)
+    report_interval_sec = param;
+  return 0;
+}
+
+static void report(uint64_t now_tsc) {
+  static const uint64_t hz = get_tsc_freq();
+  double sec = (now_tsc - last_report_tsc) / (double)hz;
+
+  DEBUG_APP("[THROUGHPUT] " << pkt_cnt / sec / 1e6 << " Mpps "
+                            << byte_cnt * 8 / sec / 1e9 << " Gbps ("
+                            << ip_sum << ")");
+
+  pkt_cnt = 0;
+  byte_cnt = 0;
+  last_report_tsc = now_tsc;
+}
+
+static int packet_processing(struct rte_mbuf *mbuf) {
+  static const uint64_t hz = get_tsc_freq();
+
+  // touch the header so that the packet is pulled into the cache
+  struct ipv4_hdr *iph = rte_pktmbuf_mtod_offset(mbuf, struct ipv4_hdr *,
+                                                 sizeof(struct ether_hdr));
+  ip_sum += iph->dst_addr;
+
+  pkt_cnt++;
+  byte_cnt += rte_pktmbuf_pkt_len(mbuf);
+
+  // refreshed by the scheduler on every rx burst
+  uint64_t now_tsc = get_cur_rdtsc();
+  if (last_report_tsc == 0)
+    last_report_tsc = now_tsc;
+  else if (now_tsc - last_report_tsc > hz * report_interval_sec)
+    report(now_tsc);
+
+  return 1;  // forward to the tx queue of this worker
+}
+
+Application *create_application() {
+  Application *app = new Application();
+  app->set_init_func(init);
+  app->set_packet_func(packet_processing);
+
+  return app;
+}
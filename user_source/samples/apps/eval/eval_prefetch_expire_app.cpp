@@ -0,0 +1,100 @@
+/* Prefetched leases taken back before they are used */
+
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_udp.h>
+
+#include "dist.hh"
+
+#include "stub.udp_counter.hh"
+#include "udp_counter.hh"
+#include "udp_key.hh"
+
+/*
+ * Test for RW leases prefetched at rx time (see set_key_extract_func())
+ *
+ * Every worker prefetches one of a few shared counters per packet, and takes
+ * it only after the counter of the flow itself, which is usually remote, so
+ * that the lease requests of the other workers for the shared counter land
+ * between the prefetch and the claim. The manager then asks for the lease
+ * back while no reference has it. Each worker reports the packets done and
+ * still in flight once per interval; a lease that is never given back shows
+ * as in-flight packets that never complete, on every worker.
+ *
+ */
+
+extern SwMap<UDPKey, UDPCounter> g_udp_counter_map;
+
+static uint64_t report_interval_sec = 1;
+static const uint16_t shared_keys = 4;
+
+static thread_local uint64_t started = 0;
+static thread_local uint64_t done = 0;
+static thread_local uint64_t last_report_tsc = 0;
+
+// by the source port, so that every worker sees all of them
+static UDPKey *create_shared_key(struct rte_mbuf *mbuf) {
+  struct ipv4_hdr *iph = rte_pktmbuf_mtod_offset(mbuf, struct ipv4_hdr *,
+                                                 sizeof(struct ether_hdr));
+  struct udp_hdr *udph =
+      (struct udp_hdr *)((u_char *)iph +
+                         ((iph->version_ihl & IPV4_HDR_IHL_MASK) << 2));
+
+  return new UDPKey(0, 0, 0, ntohs(udph->src_port) % shared_keys);
+}
+
+static int init(int param) {
+  if (param > 0)
+    report_interval_sec = param;
+  return 0;
+}
+
+static void key_extract(struct rte_mbuf *mbuf) {
+  UDPKey *key = create_shared_key(mbuf);
+  g_udp_counter_map.prefetch(key);
+  delete key;
+}
+
+static void report() {
+  static const uint64_t hz = get_tsc_freq();
+  uint64_t now_tsc = get_cur_rdtsc();
+
+  if (last_report_tsc == 0) {
+    last_report_tsc = now_tsc;
+  } else if (now_tsc - last_report_tsc > hz * report_interval_sec) {
+    DEBUG_APP("[PREFETCH] done " << done << " in flight " << started - done);
+    last_report_tsc = now_tsc;
+  }
+}
+
+static int packet_processing(struct rte_mbuf *mbuf) {
+  started++;
+  report();
+
+  UDPKey *key = UDPKey::create_key(mbuf);
+  if (key) {
+    SwRef<UDPCounter> counter = g_udp_counter_map.get(key);
+    counter->inc_pkt_cnt();
+  }
+  delete key;
+
+  UDPKey *shared = create_shared_key(mbuf);
+  {
+    SwRef<UDPCounter> counter = g_udp_counter_map.get(shared);
+    counter->inc_pkt_cnt();
+  }
+  delete shared;
+
+  done++;
+  return 1;
+}
+
+Application *create_application() {
+  Application *app = new Application();
+  app->set_init_func(init);
+  app->set_key_extract_func(key_extract);
+  app->set_packet_func(packet_processing);
+
+  return app;
+}
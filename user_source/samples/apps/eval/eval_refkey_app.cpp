@@ -0,0 +1,135 @@
+/* Per-packet reference construction cost */
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+
+#include "dist.hh"
+
+#include "ip_key.hh"
+#include "name_key.hh"
+#include "stub.udp_counter.hh"
+
+/*
+ * Microbenchmark tests for SwRef construction
+ *
+ * Every packet creates a reference to its per-destination counter and copies
+ * it 'param' times, as NFs do when they pass references around, once with an
+ * IPKey and once with a NameKey of the destination. Each SwRef keeps its own
+ * copy of the key: inline for keys up to REF_KEY_BUF_SIZE (IPKey), a heap
+ * clone otherwise (NameKey). Each kind reports its cycles and its heap
+ * allocations (operator new, overridden below) per reference, key copy
+ * included.
+ *
+ */
+
+extern SwMap<IPKey, UDPCounter> g_refkey_counter_map;
+extern SwMap<NameKey, UDPCounter> g_refkey_name_counter_map;
+
+static uint64_t report_interval_sec = 1;
+static int ref_copies = 4;
+
+static thread_local uint64_t alloc_cnt = 0;
+
+struct RefStats {
+  const char *name;
+  uint64_t refs;
+  uint64_t cycles;
+  uint64_t allocs;
+};
+
+static thread_local RefStats inline_stats = {"inline", 0, 0, 0};
+static thread_local RefStats heap_stats = {"heap", 0, 0, 0};
+static thread_local uint64_t last_report_tsc = 0;
+
+void *operator new(std::size_t size) {
+  alloc_cnt++;
+  void *p = malloc(size);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+static int init(int param) {
+  if (param > 0)
+    ref_copies = param;
+  return 0;
+}
+
+static void report_stats(RefStats *s) {
+  if (s->refs == 0)
+    return;
+
+  DEBUG_APP("[REFKEY] " << s->name << " " << s->refs << " refs "
+                        << (double)s->cycles / s->refs << " cycles/ref "
+                        << (double)s->allocs / s->refs << " allocs/ref");
+  s->refs = 0;
+  s->cycles = 0;
+  s->allocs = 0;
+}
+
+static void report(uint64_t now_tsc) {
+  report_stats(&inline_stats);
+  report_stats(&heap_stats);
+  last_report_tsc = now_tsc;
+}
+
+template <class K>
+static void take_refs(SwMap<K, UDPCounter> &map, K *key, RefStats *s) {
+  RefState state;
+
+  uint64_t allocs = alloc_cnt;
+  uint64_t start = rte_rdtsc();
+  {
+    SwRef<UDPCounter> counter = map.create(key, state);
+    counter->inc_pkt_cnt();
+
+    for (int i = 0; i < ref_copies; i++) {
+      SwRef<UDPCounter> copy(counter);
+      copy->inc_pkt_cnt();
+    }
+  }
+  s->cycles += rte_rdtsc() - start;
+  s->allocs += alloc_cnt - allocs;
+  s->refs += 1 + ref_copies;
+}
+
+static int packet_processing(struct rte_mbuf *mbuf) {
+  static const uint64_t hz = get_tsc_freq();
+
+  struct ipv4_hdr *iph = rte_pktmbuf_mtod_offset(mbuf, struct ipv4_hdr *,
+                                                 sizeof(struct ether_hdr));
+  uint32_t dst = ntohl(iph->dst_addr);
+
+  IPKey key(dst, _LCAN_DST);
+  take_refs(g_refkey_counter_map, &key, &inline_stats);
+
+  char name[NAME_KEY_LEN];
+  snprintf(name, sizeof(name), "host-%u.%u.%u.%u.eval.s6", dst >> 24,
+           (dst >> 16) & 0xff, (dst >> 8) & 0xff, dst & 0xff);
+  NameKey name_key(name);
+  take_refs(g_refkey_name_counter_map, &name_key, &heap_stats);
+
+  uint64_t now_tsc = get_cur_rdtsc();
+  if (last_report_tsc == 0)
+    last_report_tsc = now_tsc;
+  else if (now_tsc - last_report_tsc > hz * report_interval_sec)
+    report(now_tsc);
+
+  return 0;
+}
+
+Application *create_application() {
+  Application *app = new Application();
+  app->set_init_func(init);
+  app->set_packet_func(packet_processing);
+
+  return app;
+}
@@ -0,0 +1,90 @@
+/* Timer wheel cost */
+
+#include <cstdlib>
+#include <vector>
+
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
+
+#include "dist.hh"
+
+/*
+ * Microbenchmark tests for TimerWheel
+ *
+ * Before the worker starts, schedules bench_timers timers on a private wheel
+ * with deadlines spread over 'span' seconds (as idle timeouts of flows),
+ * cancels every other one (as flows that see a packet re-arm their timers),
+ * and advances the wheel over the whole span on a synthetic clock. Reports
+ * the cycles per schedule, cancel, and expiry, the latter including the
+ * cascades and the idle ticks. Packets of the worker are just forwarded.
+ *
+ */
+
+static const int bench_timers = 1 << 20;
+static const int bench_spans[] = {1, 60, 3600};  // in seconds
+
+static uint64_t bench_fired = 0;
+
+static void bench_expire(void *arg) {
+  bench_fired++;
+}
+
+static void run_bench(int span) {
+  TimerWheel *wheel = new TimerWheel();
+  std::vector<Timer *> timers(bench_timers);
+  uint64_t start_tsc = get_cur_rdtsc(true);
+  uint64_t span_tsc = wheel->us_to_tsc(span * 1000000ULL);
+
+  std::vector<uint64_t> deadlines(bench_timers);
+  // in double, as random() * span_tsc does not fit 64 bits for long spans
+  for (int i = 0; i < bench_timers; i++)
+    deadlines[i] =
+        start_tsc + (uint64_t)((double)random() / RAND_MAX * span_tsc);
+
+  uint64_t begin = rte_rdtsc();
+  for (int i = 0; i < bench_timers; i++)
+    timers[i] = wheel->schedule_at(deadlines[i], bench_expire, nullptr);
+  uint64_t schedule_cycles = rte_rdtsc() - begin;
+
+  begin = rte_rdtsc();
+  for (int i = 0; i < bench_timers; i += 2)
+    wheel->cancel(timers[i]);
+  uint64_t cancel_cycles = rte_rdtsc() - begin;
+
+  // a tick at a time on the synthetic clock
+  uint64_t step = wheel->us_to_tsc(TIMER_WHEEL_TICK_US);
+  bench_fired = 0;
+  begin = rte_rdtsc();
+  for (uint64_t now = start_tsc; wheel->size() > 0; now += step)
+    wheel->advance(now);
+  uint64_t expire_cycles = rte_rdtsc() - begin;
+
+  DEBUG_APP("[TIMER] span " << span << "s: schedule "
+                            << (double)schedule_cycles / bench_timers
+                            << " cancel "
+                            << (double)cancel_cycles / (bench_timers / 2)
+                            << " expire "
+                            << (double)expire_cycles / bench_fired
+                            << " cycles per timer (" << bench_fired
+                            << " expired)");
+
+  delete wheel;
+}
+
+static int init(int param) {
+  for (int span : bench_spans)
+    run_bench(span);
+  return 0;
+}
+
+static int packet_processing(struct rte_mbuf *mbuf) {
+  return 1;
+}
+
+Application *create_application() {
+  Application *app = new Application();
+  app->set_init_func(init);
+  app->set_packet_func(packet_processing);
+
+  return app;
+}
@@ -1,4 +1,5 @@
 #include <cstdlib>
+#include <vector>
 
 #include "dist.hh"
 #include "flow_key.hh"
@@ -11,6 +12,10 @@ extern SwMap<FlowKey, NatEntry> g_nat_entry_map;
 // NOTE: IPKey is just a placeholder. PortPool is a singleton object.
 extern SwMap<IPKey, PortPool> g_port_pool_map;
 static const uint32_t CLUSTER_ID = 0;
+static const uint64_t NAT_IDLE_TIMEOUT_US = 300 * 1000 * 1000ULL;
+
+// of expired forward entries, until the pool is taken next
+static thread_local std::vector<uint16_t> freed_ports;
 
 static void update_header(ipv4_hdr *iph, tcp_hdr *tcph,
                           const NatEntry::Data &data) {
@@ -38,6 +43,26 @@ static uint16_t find_free_port(PortBitmap &port_used) {
   return 0;
 }
 
+// the reverse entry expires by itself
+static void on_entry_expire(const Key *key, const SWObject *obj) {
+  NatEntry::Data data = static_cast<const NatEntry *>(obj)->read();
+
+  if (data.is_forward)
+    freed_ports.push_back(data.new_port);
+}
+
+static void return_freed_ports() {
+  IPKey ip_key(CLUSTER_ID);
+  SwRef<PortPool> ref_pool = g_port_pool_map.get(&ip_key);
+  PortPool::Data data_pool = ref_pool->read();
+
+  for (uint16_t port : freed_ports)
+    data_pool.port_used[port] = false;
+  freed_ports.clear();
+
+  ref_pool->write(data_pool);
+}
+
 static int packet_processing(struct rte_mbuf *mbuf) {
   ipv4_hdr *iph = rte_pktmbuf_mtod_offset(mbuf, ipv4_hdr *, sizeof(ether_hdr));
   tcp_hdr *tcph = (tcp_hdr *)((char *)iph + ((iph->version_ihl & 0xf) << 2));
@@ -45,10 +70,18 @@ static int packet_processing(struct rte_mbuf *mbuf) {
   FlowKey flow_key(ntohl(iph->src_addr), ntohl(iph->dst_addr),
                    ntohs(tcph->src_port), ntohs(tcph->dst_port));
 
+  if (!freed_ports.empty())
+    return_freed_ports();
+
+  // each packet of either direction keeps its entry alive
   RefState state;
-  SwRef<NatEntry> ref_entry = g_nat_entry_map.create(&flow_key, state);
+  SwRef<NatEntry> ref_entry =
+      g_nat_entry_map.create(&flow_key, state, NAT_IDLE_TIMEOUT_US);
   NatEntry::Data data_entry;
 
+  if (!ref_entry)
+    return 0;  // new connections are not admitted
+
   if (!state.created) {
     data_entry = ref_entry->read();
   } else {
@@ -82,7 +115,11 @@ static int packet_processing(struct rte_mbuf *mbuf) {
         .new_port = ntohs(tcph->src_port),
         .is_forward = false,
     };
-    ref_entry = g_nat_entry_map.get(&flow_key);
+    RefState reverse_state;
+    ref_entry =
+        g_nat_entry_map.create(&flow_key, reverse_state, NAT_IDLE_TIMEOUT_US);
+    if (!ref_entry)
+      return 0;
     ref_entry->write(reverse_entry);
   }
 
@@ -99,6 +136,7 @@ Application *create_application() {
   Application *app = new Application();
   app->set_packet_func(packet_processing);
   app->set_background_func(background);
+  g_nat_entry_map.set_expire_func(on_entry_expire);
 
   return app;
 }
@@ -74,6 +74,9 @@ static int packet_processing(struct rte_mbuf *mbuf) {
   SwRef<ReasmEntry> ref_entry = g_reasm_map.create(&flow_key, state);
   ReasmEntry::Data data_entry;
 
+  if (!ref_entry)
+    return 0;  // not admitted, under memory pressure
+
   if (state.created) {
     // new connection
     fill_new_entry(data_entry);
@@ -232,6 +232,8 @@ static int packet_processing(struct rte_mbuf *mbuf) {
 
   RefState state;
   SwRef<TCPFlow> flow = g_tcp_flow_map.create(&fkey, state);
+  if (!flow)
+    return 0;  // new flows are not admitted
   if (state.created)
     flow->init_c2s(mbuf);
   flow->update_context(mbuf);
@@ -18,37 +18,38 @@
 #define TCP_FLAG_ECE 0x40
 #define TCP_FALG_CWR 0x80
 
+#define TCP_IDLE_TIMEOUT_US (60 * 1000 * 1000)
+
 extern SwMap<FlowKey, TCPFlow> g_tcp_flow_map;
 
 static int packet_processing(struct rte_mbuf *mbuf) {
   FlowKey *fkey = FlowKey::create_key(mbuf);
 
-  // Migrationalble state management
-  SwRef<TCPFlow> flow = g_tcp_flow_map.lookup(fkey);
-  if (!flow) {
-    RefState state;
-    flow = g_tcp_flow_map.create(fkey, state);
+  // Migrationalble state management, removed after TCP_IDLE_TIMEOUT_US idle
+  RefState state;
+  SwRef<TCPFlow> flow =
+      g_tcp_flow_map.create(fkey, state, TCP_IDLE_TIMEOUT_US);
+  if (!flow)
+    return 0;  // not admitted, under memory pressure
 
-    if (state.created) {
+  if (state.created) {
 #if 1  // With TCP packet generator
-      struct ipv4_hdr *iph = rte_pktmbuf_mtod_offset(mbuf, struct ipv4_hdr *,
-                                                     sizeof(struct ether_hdr));
-      struct tcp_hdr *tcph =
-          (struct tcp_hdr *)((u_char *)iph +
-                             ((iph->version_ihl & IPV4_HDR_IHL_MASK) << 2));
-      if ((tcph->tcp_flags & TCP_FLAG_SYN) &&
-          (tcph->tcp_flags & TCP_FLAG_ACK)) {
-        flow->init_s2c(mbuf);
-      } else if (tcph->tcp_flags & TCP_FLAG_SYN) {
-        flow->init_c2s(mbuf);
-      }
+    struct ipv4_hdr *iph = rte_pktmbuf_mtod_offset(mbuf, struct ipv4_hdr *,
+                                                   sizeof(struct ether_hdr));
+    struct tcp_hdr *tcph =
+        (struct tcp_hdr *)((u_char *)iph +
+                           ((iph->version_ihl & IPV4_HDR_IHL_MASK) << 2));
+    if ((tcph->tcp_flags & TCP_FLAG_SYN) && (tcph->tcp_flags & TCP_FLAG_ACK)) {
+      flow->init_s2c(mbuf);
+    } else if (tcph->tcp_flags & TCP_FLAG_SYN) {
+      flow->init_c2s(mbuf);
+    }
 #else
-      if (!flow->is_set()) {
-        flow->init_c2s(packet);
-        flow->init_s2c(packet);
-      }
-#endif
+    if (!flow->is_set()) {
+      flow->init_c2s(packet);
+      flow->init_s2c(packet);
     }
+#endif
   }
 
   flow->update_context(mbuf);
@@ -19,6 +19,15 @@ static int packet_processing(struct rte_mbuf* mbuf) {
   return 0;  // passing all traffic to next hop (whatever)
 }
 
+// the counters of a burst are requested as it is received
+static void key_extract(struct rte_mbuf* mbuf) {
+  UDPKey* key = UDPKey::create_key(mbuf);
+  if (key) {
+    g_udp_counter_map.prefetch(key);
+    delete key;
+  }
+}
+
 static void background() {
   DEBUG_APP("============================================");
   DEBUG_APP("Running Background Function");
@@ -28,6 +37,7 @@ static void background() {
 Application* create_application() {
   Application* app = new Application();
   app->set_packet_func(packet_processing);
+  app->set_key_extract_func(key_extract);
   app->set_background_func(background);
 
   //		g_udp_counter_map.set_locality_local();